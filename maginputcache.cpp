@@ -0,0 +1,270 @@
+/*
+*  maginputcache.cpp
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*
+*/
+
+
+#include "magnetmod.h"
+#include "wx/dir.h"
+#include "wx/filename.h"
+#include <string.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#define INPUTCACHE_MAGIC 0x31504e4954454e4dLL     // "MNETINP1"
+#define INPUTCACHE_VERSION 2     // raised when generated input changes
+
+
+MagInputCache::MagInputCache()
+{
+	mapped = false;
+	mapbase = NULL;
+	mapsize = 0;
+	wfile = NULL;
+	maxbytes = 0;
+#ifdef _WIN32
+	mapfile = NULL;
+	maphandle = NULL;
+#endif
+}
+
+
+MagInputCache::~MagInputCache()
+{
+	Close();
+}
+
+
+void MagInputCache::SetKey(wxString cachekey, wxString cachepath, double cachebytes)
+{
+	key = cachekey;
+	path = cachepath;
+	maxbytes = cachebytes;
+}
+
+
+// Content addressed file name, 64-bit FNV-1a hash of the key, the key itself is checked on open
+wxString MagInputCache::FileName()
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	wxString text;
+
+	for(size_t i=0; i<key.length(); i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 1099511628211ULL;
+	}
+	return path + text.Format("/input-%016llx.bin", hash);
+}
+
+
+// Map the file for the current key, false on a miss or a file that does not match
+// The file's own window length is used, events do not depend on it
+bool MagInputCache::Open(int cells)
+{
+	int w, inputwindows;
+	long long *head;
+	long long *index;
+	wxString filename = FileName();
+
+	Close();
+	if(!wxFileExists(filename)) return false;
+
+#ifdef _WIN32
+	mapfile = CreateFileA(filename.mb_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(mapfile == INVALID_HANDLE_VALUE) { mapfile = NULL; return false; }
+	LARGE_INTEGER filesize;
+	GetFileSizeEx(mapfile, &filesize);
+	mapsize = filesize.QuadPart;
+	maphandle = CreateFileMappingA(mapfile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(maphandle) mapbase = (char *)MapViewOfFile(maphandle, FILE_MAP_READ, 0, 0, 0);
+	if(!mapbase) { Close(); return false; }
+#else
+	struct stat filestat;
+	int fd = open(filename.mb_str(), O_RDONLY);
+	if(fd < 0) return false;
+	if(fstat(fd, &filestat) == 0 && filestat.st_size > 0) {
+		mapsize = filestat.st_size;
+		mapbase = (char *)mmap(NULL, mapsize, PROT_READ, MAP_SHARED, fd, 0);
+		if(mapbase == MAP_FAILED) mapbase = NULL;
+	}
+	close(fd);     // the mapping holds the file
+	if(!mapbase) return false;
+#endif
+
+	// Check the header, key and index before trusting any offsets
+	head = (long long *)mapbase;
+	if(mapsize < 8 * sizeof(long long) || head[0] != INPUTCACHE_MAGIC || head[1] != INPUTCACHE_VERSION || head[2] != cells
+		|| head[3] < 1000 || head[4] < 1 || head[5] != (long long)key.length() || head[7] != (long long)mapsize
+		|| head[6] < 0 || head[6] + head[4] * (long long)sizeof(long long) > (long long)mapsize
+		|| memcmp(mapbase + 8 * sizeof(long long), key.mb_str(), key.length())) {
+		Close();
+		return false;
+	}
+
+	inputcells = cells;
+	inputwin = head[3];
+	inputwindows = head[4];
+	index = (long long *)(mapbase + head[6]);
+	blocks.resize(inputwindows);
+	for(w=0; w<inputwindows; w++) {
+		if(index[w] < 0 || index[w] + 2 * (inputcells + 1) * (long long)sizeof(int) > head[6]) {
+			Close();
+			return false;
+		}
+		blocks[w] = (const int *)(mapbase + index[w]);
+		if(index[w] + (2 * (inputcells + 1) + (long long)blocks[w][inputcells] + blocks[w][2 * inputcells + 1]) * (long long)sizeof(int) > head[6]) {
+			Close();
+			return false;
+		}
+	}
+
+	mapped = true;
+	wxFileName(filename).Touch();     // most recently used, for eviction
+	return true;
+}
+
+
+// Unmap, and discard a file still being written
+void MagInputCache::Close()
+{
+	if(wfile) Finish(false);
+
+#ifdef _WIN32
+	if(mapbase) UnmapViewOfFile(mapbase);
+	if(maphandle) CloseHandle(maphandle);
+	if(mapfile) CloseHandle(mapfile);
+	maphandle = NULL;
+	mapfile = NULL;
+#else
+	if(mapbase) munmap(mapbase, mapsize);
+#endif
+	mapbase = NULL;
+	mapsize = 0;
+	mapped = false;
+	blocks.clear();
+}
+
+
+// Start writing the file for the current key, to a part file renamed into place by Finish()
+bool MagInputCache::Begin(int cells, int win, int inputwindows)
+{
+	long long head[8];
+	char pad[8] = {0};
+
+	wxString partname = FileName() + ".part";
+
+	Close();
+	if(!wxDirExists(path)) wxMkdir(path);
+	wfile = fopen(partname.mb_str(), "wb");
+	if(!wfile) return false;
+
+	inputcells = cells;
+	inputwin = win;
+	head[0] = INPUTCACHE_MAGIC;
+	head[1] = INPUTCACHE_VERSION;
+	head[2] = inputcells;
+	head[3] = inputwin;
+	head[4] = inputwindows;
+	head[5] = key.length();
+	head[6] = 0;
+	head[7] = 0;
+	fwrite(head, sizeof(long long), 8, wfile);
+	fwrite(key.mb_str(), 1, key.length(), wfile);
+	fwrite(pad, 1, (8 - key.length() % 8) % 8, wfile);
+	wbytes = ftell(wfile);
+	wblocks.clear();
+	return true;
+}
+
+
+// Append the next window block from the ring window at 'ringcell', abandons the file if it passes maxbytes
+void MagInputCache::Write(std::vector<std::vector<int>> &Eevents, std::vector<std::vector<int>> &Ievents, int ringcell)
+{
+	int c, count;
+
+	wbuff.resize(2 * (inputcells + 1));
+	count = 0;
+	for(c=0; c<inputcells; c++) {
+		wbuff[c] = count;
+		count += Eevents[ringcell + c].size();
+	}
+	wbuff[inputcells] = count;
+	count = 0;
+	for(c=0; c<inputcells; c++) {
+		wbuff[inputcells + 1 + c] = count;
+		count += Ievents[ringcell + c].size();
+	}
+	wbuff[2 * inputcells + 1] = count;
+	for(c=0; c<inputcells; c++) wbuff.insert(wbuff.end(), Eevents[ringcell + c].begin(), Eevents[ringcell + c].end());
+	for(c=0; c<inputcells; c++) wbuff.insert(wbuff.end(), Ievents[ringcell + c].begin(), Ievents[ringcell + c].end());
+
+	if(wbytes + wbuff.size() * sizeof(int) > maxbytes) {
+		Finish(false);
+		return;
+	}
+	wblocks.push_back(wbytes);
+	fwrite(wbuff.data(), sizeof(int), wbuff.size(), wfile);
+	wbytes += wbuff.size() * sizeof(int);
+}
+
+
+// Write the index and header and move the file into the cache, or discard it
+void MagInputCache::Finish(bool complete)
+{
+	long long head[2];
+	wxString filename = FileName();
+
+	if(!wfile) return;
+
+	if(complete) {
+		head[0] = wbytes;
+		head[1] = wbytes + wblocks.size() * sizeof(long long);
+		fwrite(wblocks.data(), sizeof(long long), wblocks.size(), wfile);
+		fseek(wfile, 6 * sizeof(long long), SEEK_SET);
+		fwrite(head, sizeof(long long), 2, wfile);
+		complete = !ferror(wfile);
+	}
+	fclose(wfile);
+	wfile = NULL;
+
+	if(complete && wxRenameFile(filename + ".part", filename, true)) Evict(filename);
+	else wxRemoveFile(filename + ".part");
+}
+
+
+// Remove least recently used files until the cache fits in maxbytes, 'keep' is removed only if it alone is too large
+void MagInputCache::Evict(wxString keep)
+{
+	size_t i;
+	double total = 0;
+	wxArrayString filenames;
+	std::vector<std::pair<time_t, wxString>> files;
+
+	wxDir::GetAllFiles(path, &filenames, "input-*.bin", wxDIR_FILES);
+	for(i=0; i<filenames.size(); i++) {
+		files.push_back(std::make_pair(wxFileModificationTime(filenames[i]), filenames[i]));
+		total += wxFileName::GetSize(filenames[i]).ToDouble();
+	}
+	std::sort(files.begin(), files.end());
+
+	for(i=0; i<files.size() && total > maxbytes; i++) {
+		if(files[i].second == keep) continue;
+		total -= wxFileName::GetSize(files[i].second).ToDouble();
+		wxRemoveFile(files[i].second);
+	}
+	if(total > maxbytes) wxRemoveFile(keep);
+}
@@ -0,0 +1,189 @@
+/*
+*  maginputmod.cpp
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*
+*/
+
+
+#include "magnetmod.h"
+
+
+MagInputMod::MagInputMod(MagNetModel *magnetmodel)
+	: wxThread(wxTHREAD_JOINABLE)
+{
+	int inpcell;
+	double erate, irate;
+	unsigned long modseed;
+
+	netmod = magnetmodel;
+	mod = netmod->mod;
+	magpop = mod->magpop;
+
+	ParamStore *netparams = netmod->netparams;
+
+	inputcells = netmod->inputcells;           // Number of input (presynaptic) cells, as connected by InputGen()
+	neurosyn = (*netparams)["neurosyn"];       // Number of input (presynaptic) cells connected each neuron in network/population
+	netinput = (*netparams)["netinput"];       // EPSP input rate
+	netIratio = (*netparams)["netIratio"];     // Input Iratio - IPSP/EPSP ratio
+	modseed = (*netparams)["modseed"];
+	numthreads = netmod->inputthreads;
+	celltype = 0;
+
+	eratewin.resize(netmod->inputwin);
+	iratewin.resize(netmod->inputwin);
+
+	// Per cell streams and initial PSP times, carried across windows
+	erate = netinput / neurosyn / 1000;
+	irate = erate * netIratio;
+	epsprng.resize(inputcells);
+	ipsprng.resize(inputcells);
+	epspt.resize(inputcells);
+	ipspt.resize(inputcells);
+	for(inpcell=0; inpcell<inputcells; inpcell++) {
+		epsprng[inpcell].seed(static_cast<uint64_t>(modseed), MAGSTREAM_INPUT + 2 * static_cast<uint64_t>(inpcell));
+		ipsprng[inpcell].seed(static_cast<uint64_t>(modseed), MAGSTREAM_INPUT + 2 * static_cast<uint64_t>(inpcell) + 1);
+		epspt[inpcell] = epsprng[inpcell].exponential() / erate;
+		ipspt[inpcell] = ipsprng[inpcell].exponential() / irate;
+	}
+}
+
+
+void *MagInputMod::Entry()
+{
+	int window;
+	int inputwin = netmod->inputwin;
+	int inputring = netmod->inputring;
+
+	for(window=0; window<netmod->inputwindows; window++) {
+		// Backpressure, the ring window is reused once every neuron has released the window inputring back
+		if(window >= inputring) netmod->inputfree->WaitFor((window - inputring + 1) * inputwin);
+
+		inputwindow(window);
+		netmod->inputfront->Advance((window + 1) * inputwin);     // requeues neuron tasks parked for input
+	}
+	netmod->inputcache->Finish(true);
+	return NULL;
+}
+
+
+// Generate input cell PSP events for steps window * inputwin + 1 to (window + 1) * inputwin into the event list ring
+// Step rates are set serially, then input cells are split across numthreads parts
+// With a mapped input cache only the net signal is recorded, otherwise a cache being written takes the window
+void MagInputMod::inputwindow(int window)
+{
+	int t, p;
+	double inpfreq, erate, irate;
+	double rampstep1ms;
+	std::vector<MagInputPart*> parts;
+
+	int inputwin = netmod->inputwin;
+	int prototype = netmod->prototype;
+	double *rampinput = netmod->rampinput;
+
+	tstart = window * inputwin + 1;
+	tstop = (window + 1) * inputwin;
+	if(tstop > netmod->runtime * 1000) tstop = netmod->runtime * 1000;
+	ringcell = (window % netmod->inputring) * inputcells;
+
+	rampstep1ms = (double)netmod->rampstep[celltype] / 1000;
+	inpfreq = netinput / neurosyn;
+	erate = inpfreq / 1000;
+	irate = erate * netIratio;
+
+	for(t=tstart; t<=tstop; t++) {
+
+		// Variable Input Signal
+		if(prototype == ramp) {
+			if(t < netmod->rampstart[celltype]*1000) rampinput[celltype] = netmod->rampbase[celltype];
+			if(t >= netmod->rampstart[celltype]*1000 && t < netmod->rampstop[celltype]*1000)
+				rampinput[celltype] = netmod->rampinit[celltype] + (t - netmod->rampstart[celltype]*1000) * rampstep1ms;
+			if(t >= netmod->rampstop[celltype]*1000) rampinput[celltype] = netmod->rampafter[celltype];
+			netinput = rampinput[celltype];
+			if(netinput < 0) netinput = 0;
+
+			inpfreq = netinput / neurosyn;
+			erate = inpfreq / 1000;
+			irate = erate * netIratio;
+		}
+
+		if((t - 1) % 1000 == 0) magpop->netsignal[(t - 1) / 1000] = netinput;   // Record net signal at 1s resolution
+
+		eratewin[t - tstart] = erate;
+		iratewin[t - tstart] = irate;
+	}
+
+	if(netmod->inputcache->mapped) return;
+
+	for(p=1; p<numthreads; p++) {
+		parts.push_back(new MagInputPart(this, p));
+		parts.back()->Run();
+	}
+	inputpart(0);
+	for(p=0; p<(int)parts.size(); p++) {
+		parts[p]->Wait();
+		delete parts[p];
+	}
+
+	if(netmod->inputcache->wfile) netmod->inputcache->Write(netmod->Einputevents, netmod->Iinputevents, ringcell);
+}
+
+
+// PSP event steps for one part of the input cells, each cell drawing only from its own streams
+void MagInputMod::inputpart(int part)
+{
+	int t, inpcell;
+	int numsteps = tstop - tstart + 1;
+	int cellstart = (int)((long long)inputcells * part / numthreads);
+	int cellstop = (int)((long long)inputcells * (part + 1) / numthreads);
+	double epsptime, ipsptime;
+	double hstep = 1;
+
+	for(inpcell=cellstart; inpcell<cellstop; inpcell++) {
+		std::vector<int> &esteps = netmod->Einputevents[ringcell + inpcell];
+		std::vector<int> &isteps = netmod->Iinputevents[ringcell + inpcell];
+		MagRand &erng = epsprng[inpcell];
+		MagRand &irng = ipsprng[inpcell];
+		esteps.clear();
+		isteps.clear();
+
+		epsptime = epspt[inpcell];
+		for(t=0; t<numsteps; t++) {
+			while(epsptime < hstep) {
+				esteps.push_back(tstart + t);
+				epsptime = erng.exponential() / eratewin[t] + epsptime;
+			}
+			epsptime = epsptime - hstep;
+		}
+		epspt[inpcell] = epsptime;
+
+		ipsptime = ipspt[inpcell];
+		for(t=0; t<numsteps; t++) {
+			while(ipsptime < hstep) {
+				isteps.push_back(tstart + t);
+				ipsptime = irng.exponential() / iratewin[t] + ipsptime;
+			}
+			ipsptime = ipsptime - hstep;
+		}
+		ipspt[inpcell] = ipsptime;
+	}
+}
+
+
+MagInputPart::MagInputPart(MagInputMod *mod, int p)
+	: wxThread(wxTHREAD_JOINABLE)
+{
+	inputmod = mod;
+	part = p;
+}
+
+
+void *MagInputPart::Entry()
+{
+	inputmod->inputpart(part);
+	return NULL;
+}
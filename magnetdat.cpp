@@ -12,6 +12,15 @@
 #include "magnetmod.h"
 
 
+// Size a run record, autosized so reads and writes past the run still land, and shrunk if a longer run left it larger
+// Constructors only give records RECSMALL entries, RECNEURON per neuron, RunSize() allocates what a run will write
+static void RecSize(datdouble &rec, int size)
+{
+	rec.setsize(size, true);
+	if(rec.data.capacity() > rec.data.size()) rec.data.shrink_to_fit();
+}
+
+
 MagNeuron::MagNeuron()
 {
 	spikeparams = new ParamStore();
@@ -21,22 +30,25 @@ MagNeuron::MagNeuron()
 	synthparams = new ParamStore();
 	protoparams = new ParamStore();
 	spikecount = 0;
+	spikecount2 = 0;
+	maxspikes = MAXSPIKES;
+	type = 0;
 	
 	maxtimeRate1s = 100000;
 	maxtimeRate10s = 10000;
 	maxtime = maxtimeRate1s;
 	maxtimeLong = 35000;
 
-	Secretion.setsize(maxtimeRate1s);
+	Secretion.setsize(RECNEURON, true);
 
-	store.setsize(maxtime); //, mainwin->diagbox->textbox, "b");
-	storeLong.setsize(maxtimeLong); //, mainwin->diagbox->textbox, "storeLong"); 
-	transLong.setsize(maxtimeLong); // mainwin->diagbox->textbox, "transLong"); 
+	store.setsize(RECNEURON, true); //, mainwin->diagbox->textbox, "b");
+	storeLong.setsize(RECNEURON, true); //, mainwin->diagbox->textbox, "storeLong"); 
+	transLong.setsize(RECNEURON, true); // mainwin->diagbox->textbox, "transLong"); 
 	//CaLong.setsize(maxtimeLong); //, mainwin->diagbox->textbox, "CaLong"); 
-	synthstoreLong.setsize(maxtimeLong); //, mainwin->diagbox->textbox, "synthstoreLong"); 
-	synthrateLong.setsize(maxtimeLong); 
-	secLong.setsize(maxtimeLong);
-	secHour.setsize(maxtimeLong);
+	synthstoreLong.setsize(RECNEURON, true); //, mainwin->diagbox->textbox, "synthstoreLong"); 
+	synthrateLong.setsize(RECNEURON, true); 
+	secLong.setsize(RECNEURON, true);
+	secHour.setsize(RECNEURON, true);
 
 	initflag = false;
 	synvar = 1;
@@ -56,6 +68,49 @@ MagNeuron::~MagNeuron()
 }
 
 
+// Size records for a 'runtime' s run, store is sampled every second at 'datsample' ms indexing
+void MagNeuron::RunSize(int runtime, int datsample)
+{
+	int runmins = runtime / 60;
+
+	if(runmins >= maxtimeLong) runmins = maxtimeLong - 1;
+
+	RecSize(Secretion, runtime + 1);
+	RecSize(secLong, runtime / 60 + 1);
+	RecSize(secHour, runtime / 600 + 1);
+	RecSize(store, runtime * 1000 / datsample + 1);
+	RecSize(storeLong, runmins + 1);
+	RecSize(transLong, runmins + 1);
+	RecSize(synthstoreLong, runmins + 1);
+	RecSize(synthrateLong, runmins + 1);
+}
+
+
+// Spike record full below maxspikes, double it and record
+void MagNeuron::SpikeGrow(double time)
+{
+	int size = times.size() * 2;
+
+	if(size < RECSMALL) size = RECSMALL;
+	if(size > maxspikes) size = maxspikes;
+	times.resize(size);
+	times[spikecount++] = time;
+}
+
+
+// Heap bytes held by the spike and run records, for ScaleBench()
+size_t MagNeuron::RecBytes()
+{
+	int i;
+	size_t bytes;
+	datdouble *recs[] = {&Secretion, &Plasma, &secLong, &secHour, &store, &storeLong, &transLong, &CaLong, &synthstoreLong, &synthrateLong};
+
+	bytes = times.capacity() * sizeof(double);
+	for(i=0; i<10; i++) bytes += recs[i]->data.capacity() * sizeof(double);
+	return bytes + sta.Bytes() + stats.Bytes();
+}
+
+
 void MagNeuron::StoreClear()
 {
 	Secretion.reset();
@@ -67,6 +122,75 @@ void MagNeuron::StoreClear()
 }
 
 
+MagNeuroPool::MagNeuroPool(int size)
+{
+	numslots = size;
+	clock = 0;
+	slots.resize(numslots);
+	view.resize(1);
+	owner.resize(numslots);
+	used.resize(numslots);
+	Reset();
+}
+
+
+// Drop slot ownership so the next Get() recopies spike records, call when a run starts
+void MagNeuroPool::Reset()
+{
+	for(int i=0; i<numslots; i++) {
+		owner[i] = NULL;
+		used[i] = 0;
+	}
+	viewneuron = NULL;
+	burstneuron = NULL;
+}
+
+
+// Analysis NeuroDat for 'neuron', reused if the neuron still holds a slot, otherwise the least recently used slot is refilled
+NeuroDat *MagNeuroPool::Get(MagNeuron *neuron)
+{
+	int i, slot;
+
+	clock++;
+	slot = 0;
+	for(i=0; i<numslots; i++) {
+		if(owner[i] == neuron) {
+			used[i] = clock;
+			return &slots[i];
+		}
+		if(used[i] < used[slot]) slot = i;
+	}
+
+	Fill(&slots[slot], neuron);
+	owner[slot] = neuron;
+	used[slot] = clock;
+	return &slots[slot];
+}
+
+
+// Fill the view entry with 'neuron', the NeuroBox mod spike panel always shows the browsed neuron at index 0
+NeuroDat *MagNeuroPool::View(MagNeuron *neuron)
+{
+	if(viewneuron != neuron) Fill(&view[0], neuron);
+	viewneuron = neuron;
+	return &view[0];
+}
+
+
+// Copy the neuron's spike record into 'data'
+void MagNeuroPool::Fill(NeuroDat *data, MagNeuron *neuron)
+{
+	int s;
+
+	data->spikecount = neuron->spikecount;
+	if(data->spikecount > data->maxspikes) data->spikecount = data->maxspikes;
+	for(s=0; s<data->spikecount; s++) data->times[s] = neuron->times[s];
+	data->spikecount2 = neuron->spikecount2;
+	data->type = neuron->type;
+	data->netflag = 0;
+}
+
+
 MagPop::MagPop()
 {
 	maxtime = 200000;
@@ -75,49 +199,68 @@ MagPop::MagPop()
 	maxtimeRate1ms = maxtime * 1000;
 	maxtimeLong = 35000;  // minutes, 30000 sufficient for 20 days simulation and recording
 
-	OxySecretionNet.setsize(maxtimeRate1s);
-	OxyPlasmaNet.setsize(maxtimeRate1s);
-	PlasmaNaConc.setsize(maxtimeRate1s);
-	EVFNaConc.setsize(maxtimeRate1s);
-	DiffNaGrad.setsize(maxtimeRate1s);
-	ICFGrad.setsize(maxtimeRate1s);
-	ICFVol.setsize(maxtimeRate1s);
-	EVFNaVol.setsize(maxtimeRate1s);
-
-	NetSecretion4s.setsize(maxtimeRate1s);
-
-	evfNaConcTemp.setsize(maxtimeRate1ms);   // evfNaConc variable buffer for calculating moving 2s average
-
-	EVFNaConc.setsize(maxtimeRate10ms);
-	PlasmaNaConc.setsize(maxtimeRate10ms);
-	OsmoPress1s.setsize(maxtimeRate10ms);
-	inputsignal.setsize(maxtimeRate10ms);
-	netsignal.setsize(maxtimeRate10ms);
-
-	inputLong.setsize(maxtimeLong);
-	plasmaLong.setsize(maxtimeLong);
-	netsecLong.setsize(maxtimeLong);
-	netsecHour.setsize(maxtimeLong);
-	secLong.setsize(maxtimeLong);
-	secHour.setsize(maxtimeLong);
-	transLong.setsize(maxtimeLong);
-
-	secX.setsize(maxtimeRate1ms);
-	secXcount.setsize(maxtime * 100);
+	// Records are sized for each run by RunSize(), osmotic model and unused records stay at RECSMALL
+	OxySecretionNet.setsize(RECSMALL, true);
+	OxyPlasmaNet.setsize(RECSMALL, true);
+	PlasmaNaConc.setsize(RECSMALL, true);
+	EVFNaConc.setsize(RECSMALL, true);
+	DiffNaGrad.setsize(RECSMALL, true);
+	ICFGrad.setsize(RECSMALL, true);
+	ICFVol.setsize(RECSMALL, true);
+	EVFNaVol.setsize(RECSMALL, true);
+	OsmoPress1s.setsize(RECSMALL, true);
+
+	NetSecretion4s.setsize(RECSMALL, true);
+
+	evfNaConcTemp.setsize(RECSMALL, true);   // evfNaConc variable buffer for calculating moving 2s average
+
+	inputsignal.setsize(RECSMALL, true);
+	netsignal.setsize(RECSMALL, true);
+
+	inputLong.setsize(RECSMALL, true);
+	plasmaLong.setsize(RECSMALL, true);
+	netsecLong.setsize(RECSMALL, true);
+	netsecHour.setsize(RECSMALL, true);
+
+	storesum.setsize(RECSMALL, true);
+	storesumLong.setsize(RECSMALL, true);
+	storesumNorm.setsize(RECSMALL, true);
+	synthstoresumLong.setsize(RECSMALL, true);
+	synthratesumLong.setsize(RECSMALL, true);
+
+	srate1s.setsize(RECSMALL, true);
+	srate10s.setsize(RECSMALL, true);
+	srate30s.setsize(RECSMALL, true);
+	srate300s.setsize(RECSMALL, true);
+	srate600s.setsize(RECSMALL, true);
+}
 
-	storeLong.setsize(maxtimeLong);
-	synthstoreLong.setsize(maxtimeLong);
-	storesum.setsize(maxtime);
-	storesumLong.setsize(maxtimeLong);
-	storesumNorm.setsize(maxtimeLong);
-	synthstoresumLong.setsize(maxtimeLong);
-	synthratesumLong.setsize(maxtimeLong);
 
-	srate1s.setsize(maxtime);
-	srate10s.setsize(maxtime/10);
-	srate30s.setsize(maxtime/30);
-	srate300s.setsize(maxtime/300);
-	srate600s.setsize(maxtime/600);
+// Size the records written by the neuron, plasma, and input stages and PopSum() for a 'runtime' s run
+// inputsignal follows neuron 0 at 100 ms for the first 1000 s
+void MagPop::RunSize(int runtime)
+{
+	int runmins = runtime / 60;
+
+	if(runmins >= maxtimeLong) runmins = maxtimeLong - 1;
+
+	RecSize(OxySecretionNet, runtime + 1);
+	RecSize(OxyPlasmaNet, runtime + 1);
+	RecSize(NetSecretion4s, runtime / 4 + 1);
+	RecSize(plasmaLong, runtime / 60 + 1);
+	RecSize(netsecLong, runtime / 60 + 1);
+	RecSize(netsecHour, runtime / 600 + 1);
+
+	if(runtime < 1000) RecSize(inputsignal, runtime * 10 + 1);
+	else RecSize(inputsignal, 10000);
+	RecSize(netsignal, runtime + 1);
+	RecSize(inputLong, runmins + 1);
+
+	RecSize(storesum, runtime + 1);
+	RecSize(storesumLong, runmins + 1);
+	RecSize(storesumNorm, runmins + 1);
+	RecSize(synthstoresumLong, runmins + 1);
+	RecSize(synthratesumLong, runmins + 1);
 }
 
 
@@ -128,22 +271,34 @@ void MagPop::StoreClear()
 }
 
 
+// Population sums, serial, RunNet() runs the same parts on the pool, see MagNetModel::PopAnalysis()
 void MagPop::PopSum()
 {
-	int i, step, min;
+	PopReset();
+	PopSumSteps(0, runtime);
+	PopSumMins(0, runtime / 60);
+	PopFreq();
+	STASum();
+}
+
+
+// Clear store sums
+void MagPop::PopReset()
+{
+	int step, min;
 
 	//std::vector<int> neuron_srate;
 	//neuron_srate.resize(maxtime);
 
 	// Clear store and rate counts
 	//for(step=0; step<runtime && step<maxtime; step++) {
-	for(step=0; step<maxtime; step++) {
+	for(step=0; step<=runtime && step<maxtime; step++) {
 		//vasosum[step] = 0;
 		//srate[step] = 0;
 		storesum[step] = 0;
 	}
 
-	for(min=0; min<maxtimeLong; min++) {
+	for(min=0; min<=runtime/60 && min<maxtimeLong; min++) {
 		storesumLong[min] = 0;
 		synthstoresumLong[min] = 0;
 		synthratesumLong[min] = 0;
@@ -155,33 +310,58 @@ void MagPop::PopSum()
 	storesumNorm.reset();
 	synthstoresumLong.reset();
 	synthratesumLong.reset();
+}
 
-	popfreq = 0;
 
-	//DiagWrite("")
+// Sum store over the population for steps 'start' to 'stop' - 1, in POPTILE step tiles so the sums stay in cache
+// while each neuron is added, neurons are added in order so sums do not depend on the tiling
+void MagPop::PopSumSteps(int start, int stop)
+{
+	int i, step, tile, tilestop;
 
-	// Sum release and spike rate over population
-	for(i=0; i<numneurons; i++) {
-		//vasomod->currvaso->neurocalc(&(neurons[i]));
-		//(*neurons)[i].ratecalc(neuron_srate);
-		popfreq += (*neurons)[i].freq;
-		for(step=0; step<runtime && step<maxtime; step++) {
-			//vasosum[step] += neurons[i].vaso[step] / numcells;
-			//vasomod->vasopop->srate[step] += vasomod->currvaso->srate[step];
-			//srate[step] += (*neurons)[i].srate[step];
-			//srate1s[step] += neuron_srate[step];
-			storesum[step] += (*neurons)[i].store[step];
+	if(stop > runtime) stop = runtime;
+	if(stop > maxtime) stop = maxtime;
+
+	for(tile=start; tile<stop; tile+=POPTILE) {
+		tilestop = tile + POPTILE;
+		if(tilestop > stop) tilestop = stop;
+		for(i=0; i<numneurons; i++) {
+			datdouble &store = (*neurons)[i].store;
+			for(step=tile; step<tilestop; step++) storesum[step] += store[step];
 		}
+	}
+}
+
 
-		for(min=0; min<runtime/60; min++) {
-			//vasosumLong[min] += neurons[i].vasoLong[min] / numcells;
-			storesumLong[min] += (*neurons)[i].storeLong[min] / numneurons;
-			storesumNorm[min] = storesumLong[min] / 10;
-			synthstoresumLong[min] += (*neurons)[i].synthstoreLong[min] / numneurons;
-			synthratesumLong[min] += (*neurons)[i].synthrateLong[min] / numneurons;
+// Mean store and synthesis over the population for minutes 'start' to 'stop' - 1, tiled as PopSumSteps()
+void MagPop::PopSumMins(int start, int stop)
+{
+	int i, min, tile, tilestop;
+
+	for(tile=start; tile<stop; tile+=POPTILE) {
+		tilestop = tile + POPTILE;
+		if(tilestop > stop) tilestop = stop;
+		for(i=0; i<numneurons; i++) {
+			MagNeuron &neuron = (*neurons)[i];
+			for(min=tile; min<tilestop; min++) {
+				//vasosumLong[min] += neurons[i].vasoLong[min] / numcells;
+				storesumLong[min] += neuron.storeLong[min] / numneurons;
+				synthstoresumLong[min] += neuron.synthstoreLong[min] / numneurons;
+				synthratesumLong[min] += neuron.synthrateLong[min] / numneurons;
+			}
 		}
+		for(min=tile; min<tilestop; min++) storesumNorm[min] = storesumLong[min] / 10;
 	}
+}
 
+
+// Mean spike rate
+void MagPop::PopFreq()
+{
+	int i;
+
+	popfreq = 0;
+	for(i=0; i<numneurons; i++) popfreq += (double)(*neurons)[i].spikecount2 / runtime;    // MagNeuron holds no analysis, rate from the spike count
 	popfreq = popfreq / numneurons;
 
 	// Total spike sum
@@ -190,10 +370,38 @@ void MagPop::PopSum()
 }
 
 
+// Population spike triggered average weighted by spikes, per neuron averages are set by MagNetModel::NeuronDone()
+void MagPop::STASum()
+{
+	int i, v, k;
+	int window, prespikes = 0, postspikes = 0;
+	std::vector<double> presum, postsum;
+	datdouble *recs[MAGSTA_VARS] = {&stapsp, &staca, &stasec};
+
+	if(!numneurons) return;
+	window = (*neurons)[0].sta.window;
+	presum.assign(MAGSTA_VARS * (window + 1), 0);
+	postsum.assign(MAGSTA_VARS * window, 0);
+
+	for(i=0; i<numneurons; i++) {
+		MagSTA &sta = (*neurons)[i].sta;
+		if(!window || sta.window != window) continue;     // off, no sums
+		for(k=0; k<(int)presum.size(); k++) presum[k] += sta.presum[k];
+		for(k=0; k<(int)postsum.size(); k++) postsum[k] += sta.postsum[k];
+		prespikes += sta.prespikes;
+		postspikes += sta.postspikes;
+	}
+
+	for(v=0; v<MAGSTA_VARS; v++) {
+		RecSize(*recs[v], 2 * window + 1);
+		for(k=0; k<=window; k++) (*recs[v])[window - k] = prespikes ? presum[v * (window + 1) + k] / prespikes : 0;
+		for(k=1; k<=window; k++) (*recs[v])[window + k] = postspikes ? postsum[v * window + k - 1] / postspikes : 0;
+	}
+}
+
+
 MagNeuroDat::MagNeuroDat()
 {
-	int storesize = 1000000;
-	int sizeLong = 20000;
 	int sizeSmall = 1000;
 
 	//diagbox = main->diagbox;
@@ -201,17 +409,306 @@ MagNeuroDat::MagNeuroDat()
 	secR.setsize(sizeSmall, true);
 	secX.setsize(sizeSmall, true);
 
-	pspsig.setsize(storesize);
+	// Traces are sized for each run by RunSize(), V, syn, psp, and rand are only written by diagnostic code
+	pspsig.setsize(sizeSmall, true);
 	//inputrate.setsize(storesize);
-	Ca.setsize(storesize);
-	V.setsize(storesize);
-	syn.setsize(storesize);
-	psp.setsize(storesize);
-	rand.setsize(storesize);
+	Ca.setsize(sizeSmall, true);
+	V.setsize(sizeSmall, true);
+	syn.setsize(sizeSmall, true);
+	psp.setsize(sizeSmall, true);
+	rand.setsize(sizeSmall, true);
+
+	stimTL.setsize(sizeSmall, true);
+	stimTS.setsize(sizeSmall, true);
+	mRNAstore.setsize(sizeSmall, true);
+}
+
+
+// Size neuron 0 traces for a 'runtime' s run, pspsig at 1 ms and the rest at 'datsample' ms, each up to storesize entries
+void MagNeuroDat::RunSize(int runtime, int datsample)
+{
+	int storesize = 1000000;
+	int size;
+
+	size = runtime * 1000 + 1;
+	if(size > storesize) size = storesize;
+	RecSize(pspsig, size);
+
+	size = runtime * 1000 / datsample + 1;
+	if(size > storesize) size = storesize;
+	RecSize(Ca, size);
+	RecSize(stimTL, size);
+	RecSize(stimTS, size);
+	RecSize(mRNAstore, size);
+}
 
-	stimTL.setsize(storesize);
-	stimTS.setsize(storesize);
-	mRNAstore.setsize(storesize);
+
+
+
+MagProbe::MagProbe(int probeneuron, int probevar, int probestart, int probestop, int probedecimate, datdouble *proberec)
+{
+	neuron = probeneuron;
+	var = probevar;
+	start = probestart;
+	stop = probestop;
+	decimate = probedecimate;
+	rec = proberec;
+	if(!rec) rec = &data;
+	next = start;
+	count = 0;
+}
+
+
+// Clip the window to a 'modsteps' run and size the record to hold every sample
+void MagProbe::RunSize(int modsteps)
+{
+	int size = 0;
+
+	if(decimate < 1) decimate = 1;
+	if(start < 1) start = 1;
+	if(stop > modsteps) stop = modsteps;
+	if(var < 0 || var >= MAGPROBE_VARS) stop = start - 1;
+	if(stop >= start) size = (stop - start) / decimate + 1;
+
+	RecSize(*rec, size > 0 ? size : 1);
+	next = start;
+	count = 0;
+}
+
+
+wxString MagProbe::VarName(int var)
+{
+	const char *names[MAGPROBE_VARS] = {"V", "pspsig", "nepsp", "nipsp", "Ca", "HAP", "DAP", "AHP", "AHP2", "Dyno", "IKL",
+		"secX", "tR", "tP", "stimTS", "stimTL", "mRNA", "synsig"};
+
+	if(var < 0 || var >= MAGPROBE_VARS) return "none";
+	return names[var];
+}
+
+
+MagSTA::MagSTA()
+{
+	window = 0;
+	ringsize = 1;
+	prespikes = 0;
+	postspikes = 0;
+	pendhead = 0;
+}
+
+
+// Clear for a run with 'stawin' steps either side of the spike, 0 frees the sums
+void MagSTA::RunSize(int stawin)
+{
+	window = stawin;
+	ringsize = window + 1;
+	rdex = 0;
+	prespikes = 0;
+	postspikes = 0;
+	pendhead = 0;
+	pending.clear();
+
+	if(!window) {
+		std::vector<double>().swap(ring);
+		std::vector<double>().swap(presum);
+		std::vector<double>().swap(postsum);
+		return;
+	}
+	ring.assign(MAGSTA_VARS * ringsize, 0);
+	presum.assign(MAGSTA_VARS * (window + 1), 0);
+	postsum.assign(MAGSTA_VARS * window, 0);
+}
+
+
+// Add the window before a spike at the latest step, the whole ring back from rdex
+void MagSTA::PreSum()
+{
+	int v, k;
+	double *sum, *slot;
+
+	for(v=0; v<MAGSTA_VARS; v++) {
+		sum = &presum[v * (window + 1)];
+		slot = &ring[v * ringsize];
+		for(k=0; k<=rdex; k++) sum[k] += slot[rdex - k];
+		for(k=rdex+1; k<=window; k++) sum[k] += slot[rdex - k + ringsize];
+	}
+	prespikes++;
+}
+
+
+// Add the window after the oldest pending spike, 'window' steps back, from the ring slots after its own
+void MagSTA::PostSum()
+{
+	int v, k, r;
+	double *sum, *slot;
+
+	pendhead++;
+	for(v=0; v<MAGSTA_VARS; v++) {
+		sum = &postsum[v * window];
+		slot = &ring[v * ringsize];
+		r = rdex + 2;     // spike slot is rdex + 1
+		for(k=0; k<window; k++, r++) {
+			if(r >= ringsize) r -= ringsize;
+			sum[k] += slot[r];
+		}
+	}
+	postspikes++;
+
+	if(pendhead == pending.size()) {
+		pending.clear();
+		pendhead = 0;
+	}
+}
+
+
+// Averages from the sums, 2 * window + 1 entries with the spike at 'window'
+void MagSTA::Average()
+{
+	int v, k;
+	datdouble *recs[MAGSTA_VARS] = {&psp, &ca, &sec};
+
+	for(v=0; v<MAGSTA_VARS; v++) {
+		RecSize(*recs[v], 2 * window + 1);
+		if(!window) continue;
+		for(k=0; k<=window; k++) (*recs[v])[window - k] = prespikes ? presum[v * (window + 1) + k] / prespikes : 0;
+		for(k=1; k<=window; k++) (*recs[v])[window + k] = postspikes ? postsum[v * window + k - 1] / postspikes : 0;
+	}
 }
 
 
+size_t MagSTA::Bytes()
+{
+	return (ring.capacity() + presum.capacity() + postsum.capacity() + psp.data.capacity() + ca.data.capacity()
+		+ sec.data.capacity()) * sizeof(double) + pending.capacity() * sizeof(int);
+}
+
+
+MagSpikeStats::MagSpikeStats()
+{
+	active = false;
+	isicount = 0;
+	lasttime = -1;
+	isisum = 0;
+	isisq = 0;
+	freq = 0;
+	meanisi = 0;
+	isisd = 0;
+}
+
+
+// Clear for a 'runtime' s run, inactive frees the bins
+void MagSpikeStats::RunSize(int runtime, bool statsflag)
+{
+	active = statsflag;
+	isicount = 0;
+	lasttime = -1;
+	isisum = 0;
+	isisq = 0;
+	freq = 0;
+	meanisi = 0;
+	isisd = 0;
+	hist1.clear();
+	longisi.clear();
+
+	if(!active) {
+		std::vector<int>().swap(hist1);
+		std::vector<double>().swap(longisi);
+		std::vector<int>().swap(rate1s);
+		return;
+	}
+	rate1s.assign(runtime + 1, 0);
+}
+
+
+// Grow the 1 ms bins to hold 'bin', doubling, capped at ISIBINS
+void MagSpikeStats::Hist1Grow(int bin)
+{
+	int size = hist1.size() * 2;
+
+	if(size < 256) size = 256;
+	if(size <= bin) size = bin + 1;
+	if(size > ISIBINS) size = ISIBINS;
+	hist1.resize(size, 0);
+}
+
+
+// 5 ms bins, ISIBINS entries, from the 1 ms bins and the long ISIs
+void MagSpikeStats::Hist5(std::vector<int> &hist5)
+{
+	int i, bin;
+
+	hist5.assign(ISIBINS, 0);
+	for(i=0; i<(int)hist1.size(); i++) hist5[i / 5] += hist1[i];
+	for(i=0; i<(int)longisi.size(); i++) {
+		bin = (int)(longisi[i] / 5);
+		if(bin < ISIBINS) hist5[bin]++;
+	}
+}
+
+
+// Rate over the run and ISI mean and standard deviation, as neurocalc() freq, meanisi, and isivar
+void MagSpikeStats::Summary(int runtime, int spikecount)
+{
+	double var;
+
+	freq = runtime ? (double)spikecount / runtime : 0;
+	meanisi = isicount ? isisum / isicount : 0;
+	var = isicount ? isisq / isicount - meanisi * meanisi : 0;
+	isisd = var > 0 ? sqrt(var) : 0;
+}
+
+
+// Fill 'spikedat' rate, ISI histogram, and hazard records from the bins, in place of neurocalc(), for display
+// Cost is the bins and the recorded spikes, records past 'runtime' are left as they are
+void MagSpikeStats::Fill(SpikeDat *spikedat, std::vector<double> &times, int spikecount, int runtime, int maxtime)
+{
+	int i, remain;
+	int maxrate = runtime + 1;
+	int maxms = runtime * 1000 + 1;
+	std::vector<int> hist5;
+
+	if(maxrate > maxtime) maxrate = maxtime;
+	if(maxms > 1000000) maxms = 1000000;
+
+	for(i=0; i<maxrate/10 + 1 && i<maxtime/10; i++) spikedat->srate10s[i] = 0;
+	for(i=0; i<maxrate/30 + 1 && i<maxtime/30; i++) spikedat->srate30s[i] = 0;
+	for(i=0; i<maxrate/300 + 1 && i<maxtime/300; i++) spikedat->srate300s[i] = 0;
+	for(i=0; i<maxrate/600 + 1 && i<maxtime/600; i++) spikedat->srate600s[i] = 0;
+	for(i=0; i<maxrate; i++) {
+		spikedat->srate1s[i] = i < (int)rate1s.size() ? rate1s[i] : 0;
+		if(i/10 < maxtime/10) spikedat->srate10s[i/10] += spikedat->srate1s[i];
+		if(i/30 < maxtime/30) spikedat->srate30s[i/30] += spikedat->srate1s[i];
+		if(i/300 < maxtime/300) spikedat->srate300s[i/300] += spikedat->srate1s[i];
+		if(i/600 < maxtime/600) spikedat->srate600s[i/600] += spikedat->srate1s[i];
+	}
+
+	// 1 ms bins for individual spikes
+	for(i=0; i<maxms; i++) spikedat->srate1[i] = 0;
+	for(i=0; i<spikecount && times[i] < maxms; i++) spikedat->srate1[(int)times[i]]++;
+
+	Hist5(hist5);
+	for(i=0; i<ISIBINS; i++) {
+		spikedat->hist1[i] = i < (int)hist1.size() ? hist1[i] : 0;
+		spikedat->hist5[i] = hist5[i];
+		spikedat->haz1[i] = 0;
+		spikedat->haz5[i] = 0;
+	}
+	remain = isicount;
+	for(i=0; i<(int)hist1.size() && remain > 0; i++) {
+		spikedat->haz1[i] = (double)hist1[i] / remain;
+		remain -= hist1[i];
+	}
+	remain = isicount;
+	for(i=0; i<ISIBINS && remain > 0; i++) {
+		spikedat->haz5[i] = (double)hist5[i] / remain;
+		remain -= hist5[i];
+	}
+
+	spikedat->spikecount = spikecount;
+	spikedat->freq = freq;
+}
+
+
+size_t MagSpikeStats::Bytes()
+{
+	return (hist1.capacity() + rate1s.capacity()) * sizeof(int) + longisi.capacity() * sizeof(double);
+}
@@ -13,14 +13,130 @@
 #define MAGNETDAT_H
 
 #include "hypomain.h"
+#include <deque>
 
 
-// 'MagNeuron' single magnocellular neuron class derived from NeuroDat
-// NeuroDat contains spiking model variables and analysis storage for FR, ISI and hazard.
+#define RECSMALL 1000     // record length before a run sizes it, see RunSize()
+#define RECNEURON 16      // per neuron record length before a run, large networks allocate only at RunSize()
+#define MAXSPIKES 100000  // spike record cap, times grows on demand up to this
+#define POPTILE 512       // entries per cache blocked population sum tile
+
+
+#define MAGSTA_VARS 3     // spike triggered variables, pspsig, Ca, and secX
+
+
+// 'MagSTA' online spike triggered averages over 'window' steps either side of each spike
+//
+// The engine writes each step's values to a window + 1 step ring with Step() and calls Spike() for each spike,
+// steps must be consecutive.
+// Sums before a spike are taken from the ring at the spike and sums after it 'window' steps later, so the cost
+// is fixed per step and per spike, with no full resolution trace. Average() fills psp, ca, and sec, index
+// 'window' at the spike step, with values before any spike increment.
 //
-class MagNeuron : public NeuroDat
+class MagSTA
 {
 public:
+	int window;
+	int ringsize;
+	int rdex;           // ring slot of the latest step
+	int prespikes;      // spikes with a full window before
+	int postspikes;     // spikes with a full window after
+	std::vector<double> ring;       // [var * ringsize + slot]
+	std::vector<double> presum;     // [var * (window + 1) + k], k steps before the spike
+	std::vector<double> postsum;    // [var * window + k - 1], k steps after
+	std::vector<int> pending;       // spike steps waiting for their window after
+	size_t pendhead;
+	datdouble psp, ca, sec;
+
+	MagSTA();
+	void RunSize(int window);
+	void PreSum();
+	void PostSum();
+	void Average();
+	size_t Bytes();
+
+	inline void Step(int step, double pspval, double caval, double secval) {
+		if(++rdex == ringsize) rdex = 0;
+		ring[rdex] = pspval;
+		ring[ringsize + rdex] = caval;
+		ring[2 * ringsize + rdex] = secval;
+		if(pendhead < pending.size() && pending[pendhead] + window == step) PostSum();
+	}
+
+	// Spike at the latest step
+	inline void Spike(int step) {
+		if(step > window) PreSum();
+		pending.push_back(step);
+	}
+};
+
+
+#define ISIBINS 10000     // ISI histogram and hazard bins, as SpikeDat hist1, hist5, haz1 and haz5
+
+
+// 'MagSpikeStats' ISI histogram and 1 s spike rate counts accumulated by SpikeAdd() during the run
+//
+// Replaces neurocalc() from spike times for the netanalysis population sums, see MagNetStats, and for
+// browsing neurons, see MagNeuroDataBox::NeuroData().
+// 1 ms ISI bins grow on demand to the longest ISI below ISIBINS ms, the rare longer ISIs are kept
+// for the 5 ms histogram. Counts cover all spikes, not only those recorded below maxspikes.
+//
+class MagSpikeStats
+{
+public:
+	bool active;
+	int isicount;
+	double lasttime;       // -1 before the first spike
+	double isisum, isisq;
+	std::vector<int> hist1;         // 1 ms ISI bins
+	std::vector<double> longisi;    // ISIs of ISIBINS ms and over
+	std::vector<int> rate1s;        // spikes per 1 s bin
+
+	// Summary set once by Summary() after the run
+	double freq, meanisi, isisd;
+
+	MagSpikeStats();
+	void RunSize(int runtime, bool active);
+	void Hist1Grow(int bin);
+	void Hist5(std::vector<int> &hist5);
+	void Summary(int runtime, int spikecount);
+	void Fill(SpikeDat *spikedat, std::vector<double> &times, int spikecount, int runtime, int maxtime);
+	size_t Bytes();
+
+	inline void Spike(double time) {
+		int bin = (int)(time / 1000);
+		if(bin < (int)rate1s.size()) rate1s[bin]++;
+		if(lasttime >= 0) {
+			double isi = time - lasttime;
+			if(isi < ISIBINS) {
+				bin = (int)isi;
+				if(bin >= (int)hist1.size()) Hist1Grow(bin);
+				hist1[bin]++;
+			}
+			else longisi.push_back(isi);
+			isicount++;
+			isisum += isi;
+			isisq += isi * isi;
+		}
+		lasttime = time;
+	}
+};
+
+
+// 'MagNeuron' single magnocellular neuron simulation record
+// Holds only the spike times and state the engine uses. NeuroDat analysis storage for FR, ISI and hazard
+// is lent by MagNeuroPool when a neuron is analysed or displayed.
+// Neurons are held in a std::deque so growing the network never moves them, they own their ParamStores and are not copyable.
+//
+class MagNeuron
+{
+public:
+	int spikecount;     // recorded spikes, at most maxspikes
+	int spikecount2;    // all spikes
+	int maxspikes;
+	std::vector<double> times;
+	int type;
+
 	int active;
 	int setactive;
 	int index;
@@ -35,10 +151,6 @@ public:
 	ParamStore *synthparams;
 	ParamStore *protoparams;
 
-	// Pre-generated PSP counts for non-independent network inputs 
-	unsigned char *dendinputE;
-	unsigned char *dendinputI;
-
 	// secretion and diffusion variable recording arrays
 	datdouble Secretion;
 	datdouble Plasma;
@@ -58,9 +170,51 @@ public:
 	datdouble synthstoreLong;
 	datdouble synthrateLong;
 
+	MagSTA sta;     // spike triggered averages, sized when enabled
+	MagSpikeStats stats;     // ISI and rate bins, active with netanalysis
+
 	MagNeuron();
 	~MagNeuron();
+	MagNeuron(const MagNeuron &) = delete;
+	MagNeuron &operator=(const MagNeuron &) = delete;
+	void RunSize(int runtime, int datsample);
 	void StoreClear();
+	void SpikeGrow(double time);
+	size_t RecBytes();
+
+	// Record a spike time, spikecount2 counts spikes past the cap
+	inline void SpikeAdd(double time) {
+		if(spikecount < (int)times.size()) times[spikecount++] = time;
+		else if(spikecount < maxspikes) SpikeGrow(time);
+		spikecount2++;
+		if(stats.active) stats.Spike(time);
+	}
+};
+
+
+// 'MagNeuroPool' NeuroDat analysis storage lent to neurons on demand
+//
+// Get() fills a slot with the neuron's spike record for neurocalc() and panel display,
+// a neuron keeps its slot until least recently used, Reset() drops all at the start of each run
+// View() fills the single entry bound to the NeuroBox mod spike panel with the browsed neuron, called only while
+// the panel is shown and filled once per neuron, NeuroDat owns its spike times so the panel cannot share the neuron's
+//
+class MagNeuroPool{
+public:
+	int numslots;
+	int clock;
+	std::vector<NeuroDat> slots;
+	std::vector<MagNeuron*> owner;     // neuron held in each slot, NULL free
+	std::vector<int> used;      // clock at last Get()
+	std::vector<NeuroDat> view;     // one entry, the browsed neuron
+	MagNeuron *viewneuron;     // neuron in the view entry, NULL none
+	MagNeuron *burstneuron;    // neuron of the last burst scan, see MagNeuroDataBox::NeuroData()
+
+	MagNeuroPool(int numslots);
+	NeuroDat *Get(MagNeuron *neuron);
+	NeuroDat *View(MagNeuron *neuron);
+	void Fill(NeuroDat *data, MagNeuron *neuron);
+	void Reset();
 };
 
 
@@ -78,7 +232,7 @@ public:
 	int numspikes;
 	double oxymean;
 	double oxytotal;
-	std::vector<MagNeuron> *neurons;
+	std::deque<MagNeuron> *neurons;
 	double popfreq;
 	double popsd;
 	double ratemean;
@@ -104,20 +258,17 @@ public:
 	datdouble plasmaLong;
 	datdouble netsecLong;
 	datdouble netsecHour;
-	datdouble secLong;
-	datdouble secHour;
-	datdouble transLong;
 
-	// Synthesis and Stores
-	datdouble storeLong;
-	datdouble synthstoreLong;
-	datdouble synthrateLong;
+	// Synthesis and Stores, the selected neuron's records are shown by binding graphs to them, see NeuroData()
 	datdouble storesum;
 	datdouble storesumLong;
 	datdouble storesumNorm;
 	datdouble synthstoresumLong;
 	datdouble synthratesumLong;
 
+	// Spike triggered averages over all spikes, see MagSTA
+	datdouble stapsp, staca, stasec;
+
 	// Osmotic Pressure model
 	// 1 second bins
 	datdouble PlasmaNaConc;
@@ -145,14 +296,15 @@ public:
 	// 1ms bin
 	datdouble evfNaConcTemp;
 
-	// Summed Population secretion rate
-	datdouble secX;
-	datint secXcount;
-	int secXtime;
-
 	MagPop();
 	//void Output(wxString tag);
+	void RunSize(int runtime);
 	void PopSum();
+	void PopReset();
+	void PopSumSteps(int start, int stop);
+	void PopSumMins(int start, int stop);
+	void PopFreq();
+	void STASum();
 	void StoreClear();
 };
 
@@ -179,6 +331,7 @@ public:
 	datdouble rand;
 
 	datdouble pspsig;
+	datdouble probe;     // panel probe record, see MagProbe
 	//datdouble inputrate;
 
 	datdouble stimTS;
@@ -187,8 +340,62 @@ public:
 	datdouble synthratestore;
 	
 	MagNeuroDat();
+	void RunSize(int runtime, int datsample);
+};
+
+// Probe variables, model state recorded by MagNeuroMod::neuromodloop() at the end of a step
+enum {
+	MAGPROBE_V,
+	MAGPROBE_PSP,       // pspsig
+	MAGPROBE_EPSP,      // EPSP count in the step
+	MAGPROBE_IPSP,
+	MAGPROBE_CA,
+	MAGPROBE_HAP,
+	MAGPROBE_DAP,
+	MAGPROBE_AHP,
+	MAGPROBE_AHP2,
+	MAGPROBE_DYNO,
+	MAGPROBE_IKL,
+	MAGPROBE_SECX,
+	MAGPROBE_RESERVE,   // tR
+	MAGPROBE_POOL,      // tP
+	MAGPROBE_STIMTS,
+	MAGPROBE_STIMTL,
+	MAGPROBE_MRNA,
+	MAGPROBE_SYNSIG,
+	MAGPROBE_VARS
 };
 
+
+// 'MagProbe' records one variable of one neuron every 'decimate' steps from step 'start' to 'stop'
+//
+// RunSize() sizes the record before the run so a sample is a single store, 'rec' is the probe's own
+// 'data' or a display record such as MagNeuroDat::probe. Probed neurons run the scalar engine.
+//
+class MagProbe{
+public:
+	int neuron;
+	int var;
+	int start, stop;
+	int decimate;
+	int next;       // next step to record, past 'stop' when done
+	int count;      // samples recorded
+	datdouble data;
+	datdouble *rec;
+
+	MagProbe(int neuron, int var, int start, int stop, int decimate, datdouble *rec = NULL);
+	MagProbe(const MagProbe &) = delete;
+	MagProbe &operator=(const MagProbe &) = delete;
+	void RunSize(int modsteps);
+	static wxString VarName(int var);
+
+	inline void Add(double value) {
+		(*rec)[count++] = value;
+		next += decimate;
+	}
+};
+
+
 // 'MagNetDat' network/population class containing network parameters and neuron array link
 //
 class MagNetDat{
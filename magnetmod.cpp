@@ -40,6 +40,7 @@ MagNetMod::MagNetMod(int type, wxString name, HypoMain *main)
 	netready = false;
 	modneurons.resize(200);
 	modneurons_max = 200;
+	neuropool = new MagNeuroPool(8);
 
 	currmodneuron = new SpikeDat();
 	currmodneuron->BurstInit();
@@ -122,7 +123,7 @@ MagNetMod::MagNetMod(int type, wxString name, HypoMain *main)
 	neurobox->cellpanel->SetData(&viewcell[0], &celldata);
 
 	// Mod data linking
-	neurobox->AddModSpikePanel(currmodneuron, (std::vector<NeuroDat>*)&modneurons);
+	neurobox->AddModSpikePanel(currmodneuron, &neuropool->view);    // browsed neuron, filled by MagNeuroDataBox::NeuroData()
 
 	// GridBox linking and set up
 	gridbox->celldata = &celldata;
@@ -551,6 +552,7 @@ MagNetMod::~MagNetMod()
 	delete netneuron;
 	delete magpop;
 	delete neurodata;
+	delete neuropool;
 }
 
 
@@ -567,8 +569,9 @@ void MagNetMod::GraphData()
 	// ----------------------------------------------------------------------------------
 	graphbase->Add(GraphDat(magpop->OxySecretion, 0, 50000, 0, 300, "Oxytocin Secretion", 5, 1, green), "OxySecretion");
 	graphbase->Add(GraphDat(magpop->OxyPlasma, 0, 50000, 0, 10000, "Oxytocin Plasma", 5, 1, blue), "OxyPlasma");
-	graphbase->Add(GraphDat(&magpop->secLong, 0, 50000, 0, 300, "Secretion 60s", 5, 60, lightblue), "seclong");
-	graphbase->Add(GraphDat(&magpop->secHour, 0, 50000, 0, 30, "Secretion 10min", 5, 600, lightblue), "sechour");
+	// Neuron records are bound to the selected neuron by NeuroData()
+	graphbase->Add(GraphDat(&modneurons[0].secLong, 0, 50000, 0, 300, "Secretion 60s", 5, 60, lightblue), "seclong");
+	graphbase->Add(GraphDat(&modneurons[0].secHour, 0, 50000, 0, 30, "Secretion 10min", 5, 600, lightblue), "sechour");
 
 	graphbase->Add(GraphDat(&neurodata->secP, 0, 500, 0, 5000, "Secretion P", 5, 1, lightred, 1000/datsample), "oxysecp");
 	graphbase->Add(GraphDat(&neurodata->secR, 0, 500, 0, 20000, "Secretion R", 5, 1, lightred, 1000/datsample), "oxysecr");
@@ -597,19 +600,28 @@ void MagNetMod::GraphData()
 	graphbase->Add(GraphDat(&magpop->inputsignal, 0, 50000, 0, 10000, "Input Signal", 5, 1, lightgreen, 10), "inputsignal");
 	graphbase->Add(GraphDat(&magpop->netsignal, 0, 50000, 0, 1000, "Net Signal", 5, 1, lightblue), "netsignal");
 	graphbase->Add(GraphDat(&magpop->inputLong, 0, 50000, 0, 10000, "Input Long", 5, 60, lightgreen), "inputlong");
-	graphbase->Add(GraphDat(&magpop->transLong, 0, 50000, 0, 10000, "Trans Long", 5, 60, lightred), "translong");
+	graphbase->Add(GraphDat(&modneurons[0].transLong, 0, 50000, 0, 10000, "Trans Long", 5, 60, lightred), "translong");
 
 	graphbase->Add(GraphDat(&neurodata->pspsig, 0, 50000, 0, 1000, "PSP Signal", 5, 1, lightblue), "pspsig");
 	graphbase->Add(GraphDat(&neurodata->V, 0, 50000, 0, 1000, "Rec V", 5, 1, lightgreen), "recV");
 	graphbase->Add(GraphDat(&neurodata->syn, 0, 50000, 0, 1000, "Rec Syn", 5, 1, lightblue), "recsyn");
 	graphbase->Add(GraphDat(&neurodata->psp, 0, 50000, 0, 1000, "Rec PSP", 5, 1, lightred), "recpsp");
 	graphbase->Add(GraphDat(&neurodata->rand, 0, 50000, 0, 1000, "Rec Rand", 5, 1, purple), "recrand");
+	graphbase->Add(GraphDat(&neurodata->probe, 0, 50000, 0, 1000, "Probe", 5, 1, lightred), "probe");
+
+	// Spike triggered averages, spike at the window length, neuron graphs are bound to the selected neuron by NeuroData()
+	graphbase->Add(GraphDat(&modneurons[0].sta.psp, 0, 200, 0, 10, "STA PSP", 5, 1, lightblue), "stapsp");
+	graphbase->Add(GraphDat(&modneurons[0].sta.ca, 0, 200, 0, 500, "STA Ca", 5, 1, lightgreen), "staca");
+	graphbase->Add(GraphDat(&modneurons[0].sta.sec, 0, 200, 0, 30, "STA Secretion", 5, 1, lightred), "stasec");
+	graphbase->Add(GraphDat(&magpop->stapsp, 0, 200, 0, 10, "Pop STA PSP", 5, 1, blue), "popstapsp");
+	graphbase->Add(GraphDat(&magpop->staca, 0, 200, 0, 500, "Pop STA Ca", 5, 1, green), "popstaca");
+	graphbase->Add(GraphDat(&magpop->stasec, 0, 200, 0, 30, "Pop STA Secretion", 5, 1, red), "popstasec");
 	//graphbase->Add(GraphDat(&oxyneurodata->inputrate, 0, 50000, 0, 1000, "Input Signal", 5, 1, lightgreen), "inputrate");
 
 	graphbase->Add(GraphDat(&magpop->storesum, 0, 1000, 0, 1000000, "Summed Store", 5, 1000, blue, 1000), "sumstore");
-	graphbase->Add(GraphDat(&magpop->storeLong, 0, 1000, 0, 300, "Store Long", 5, 60, lightblue), "storelong");
-	graphbase->Add(GraphDat(&magpop->synthstoreLong, 0, 1000, 0, 300, "Synth Store Long", 5, 60, lightred), "synthstorelong");
-	graphbase->Add(GraphDat(&magpop->synthrateLong, 0, 1000, 0, 300, "Synth Rate Long", 5, 60, lightred), "synthratelong");
+	graphbase->Add(GraphDat(&modneurons[0].storeLong, 0, 1000, 0, 300, "Store Long", 5, 60, lightblue), "storelong");
+	graphbase->Add(GraphDat(&modneurons[0].synthstoreLong, 0, 1000, 0, 300, "Synth Store Long", 5, 60, lightred), "synthstorelong");
+	graphbase->Add(GraphDat(&modneurons[0].synthrateLong, 0, 1000, 0, 300, "Synth Rate Long", 5, 60, lightred), "synthratelong");
 	graphbase->Add(GraphDat(&magpop->storesumLong, 0, 1000, 0, 300, "Summed Store Long", 5, 60, lightblue), "sumstorelong");
 	graphbase->Add(GraphDat(&magpop->synthstoresumLong, 0, 1000, 0, 300, "Summed Synth Store", 5, 60, lightred), "sumsynthstorelong");
 	graphbase->Add(GraphDat(&magpop->synthratesumLong, 0, 15, 0, 300, "Summed Synth Rate", 5, 60, lightblue), "synthratesumlong");
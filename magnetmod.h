@@ -7,11 +7,21 @@
 *
 *
 *    Classes:
-*        - "MagNeuron: public NeuroDat"    --->   Single neuron parameters and variables (spiking ones from class NeuroData, the rest included here)
+*        - "MagNeuron"    --->   Single neuron simulation record, spike times, parameters and variables  (see magnetdat.cpp)
+*        - "MagNeuroPool"    --->   NeuroDat analysis storage lent to neurons when analysed or displayed  (see magnetdat.cpp)
 *        - "MagNetDat"    --->   Just getting parameters for the Network (see magnetdat.cpp)
 *        - Boxes for the network and the single neuron starting parameters  (see magnetpanels.cpp)
-*        - "MagNeuroMod : public wxThread"   --->  Thread for working with a single neuron  (see magneuromod.cpp)
-*        - "MagNetMod : public ModThread"   --->  class to work with threads, in this case with the single neuron threads defined by MagNeuroMod  (see magnetmod.cpp)
+*        - "MagNeuroMod : public MagNetTask"   --->  Pool task for running a single neuron  (see magneuromod.cpp, event driven mode in magneuroevent.cpp)
+*        - "MagPoisson"   --->  Per-step Poisson count sampler for PSP input  (see magpoisson.cpp)
+*        - "MagRand"   --->  Counter based Philox random number streams for neuron tasks  (see magrand.h, magrand.cpp)
+*        - "MagNeuroBlock : public MagNetTask"   --->  Pool task running a block of neurons in SIMD lanes, alternative engine to MagNeuroMod  (see magneuroblock.cpp)
+*        - "MagNetStats : public MagNetTask"   --->  Pool task reducing neuron ISI and rate bins into the netanalysis population sums  (see magnetmodel.cpp)
+*        - "MagPopTask : public MagNetTask"   --->  Pool task for one stage or tile of the post-run population analysis  (see magnetmodel.cpp)
+*        - "MagNetPool", "MagNetWorker : public wxThread"   --->  Persistent worker thread pool for neuron tasks  (see magnetpool.cpp)
+*        - "MagNetFrontier"   --->  Simulated time frontier for synchronising the neuron, plasma and osmotic stages  (see magnetpool.cpp)
+*        - "MagInputMod", "MagInputPart : public wxThread"   --->  Network input stage, generates shared PSP counts in windows during the run on inputthreads threads  (see maginputmod.cpp)
+*        - "MagInputCache"   --->  File cache of generated network input, memory mapped on repeat runs  (see maginputcache.cpp)
+*        - "MagNetMod : public ModThread"   --->  class to work with threads, in this case with the single neuron tasks defined by MagNeuroMod  (see magnetmod.cpp)
 *        - "MagNetModel : public Model"   --->  to run the network threads and coordinate the graphs, boxes and data asociated  (see magnetmodel.cpp)
 *
 */
@@ -27,6 +37,12 @@
 #include "magnetpanels.h"
 #include "hyponeuro.h"
 #include "hyporand.h"
+#include "magsimd.h"
+#include "magrand.h"
+#include <deque>
+#include <vector>
+#include <map>
+#include <atomic>
 
 
 enum {
@@ -42,11 +58,225 @@ enum {
     ID_secmode,
     ID_plasmamode,
     ID_AHP2mode,
-    ID_secfix
+    ID_secfix,
+    ID_blockmode,
+    ID_enginecheck,
+    ID_eventmode,
+    ID_expinput,
+    ID_modebench,
+    ID_scalebench,
+    ID_stepcheck,
+    ID_synthmulti,
+    ID_secexact,
+    ID_inputcache,
+    ID_randbench,
+    ID_probe,
+    ID_neurorec,
+    ID_staflag,
+    ID_neurocache
 };
 
+// neuromod() specialisation flags, each combination compiles to its own loop, see magneuromod.cpp
+enum {
+    MAGMODE_SPIKE = 1,
+    MAGMODE_SEC = 2,          // secretion model
+    MAGMODE_PLASMA = 4,       // population secretion buffering, only with MAGMODE_SEC
+    MAGMODE_KL = 8,           // K leak current, gKL non-zero
+    MAGMODE_INPUTGEN = 16,    // pre-generated network input
+    MAGMODE_RAMP = 32,
+    MAGMODE_RAMPCURVE = 64,
+    MAGMODE_PROBE = 128,      // neuron has probes, see MagProbe
+    MAGMODE_GENERIC = 256     // single loop testing the flags above each step
+};
+
+// Random stream offsets from modseed, neuron tasks use MagRand stream neurodex
+#define MAGSTREAM_CONNECT ((uint64_t)1 << 32)    // input cell connections
+#define MAGSTREAM_INPUT ((uint64_t)1 << 33)      // input cell PSP times, EPSP stream 2 * cell, IPSP stream 2 * cell + 1
+
 class MagNetFrame;
 class MagNetModel;
+class MagNetPool;
+class MagNetWorker;
+class MagNetFrontier;
+
+
+// Fixed point secretion sum, integer adds are exact so a total does not depend on add order or thread count
+// hi counts units of 2^-24 and lo units of 2^-76, carried into hi at 2^52, range to 5e11 with resolution 1e-23
+class MagSecSum
+{
+public:
+    long long hi, lo;
+
+    MagSecSum() { hi = 0; lo = 0; }
+
+    MagSecSum &operator+=(double x) {
+        double a = floor(x * 16777216.0);                                   // 2^24
+        hi += (long long)a;
+        lo += (long long)((x * 16777216.0 - a) * 4503599627370496.0);      // 2^52
+        hi += lo >> 52;
+        lo &= (1LL << 52) - 1;
+        return *this;
+    }
+
+    MagSecSum &operator+=(const MagSecSum &s) {
+        hi += s.hi;
+        lo += s.lo;
+        hi += lo >> 52;
+        lo &= (1LL << 52) - 1;
+        return *this;
+    }
+
+    double Value() { return (double)hi / 16777216.0 + (double)lo / 7.5557863725914323e22; }    // 2^76
+};
+
+
+// Base class for work queued on MagNetPool, RunTask() is called on a pool worker thread
+// A task that needs a stage frontier not yet reached calls Park(), saves its state and returns from RunTask(),
+// the frontier requeues it when it passes, and RunTask() is called again to continue
+class MagNetTask
+{
+public:
+    MagNetWorker *worker;    // worker running the task, NULL when run directly
+    MagNetFrontier *parkfront;   // frontier the task is parked on, set by Park() until the pool hands it over
+    int parktime;
+
+    MagNetTask() { worker = NULL; parkfront = NULL; parktime = 0; }
+    virtual ~MagNetTask() {}
+    virtual void RunTask() = 0;
+    bool Park(MagNetFrontier *front, int time);
+};
+
+
+// Pool worker thread, runs tasks from its own queue and steals from the back of other workers' queues when empty
+class MagNetWorker : public wxThread
+{
+public:
+    MagNetPool *pool;
+    int index;
+
+    std::deque<MagNetTask*> queue;
+    wxMutex queuemute;
+
+    // Utilisation, reset by MagNetPool::ResetStats()
+    double busytime;   // ms spent running tasks
+    int taskcount;
+    int stealcount;
+
+    int slot;          // run slot held while running a task, indexes per slot state such as MagNetModel::secpart
+
+    MagNetWorker(MagNetPool *pool, int index);
+    virtual void *Entry();
+
+    MagNetTask *Pop();      // front of own queue
+    MagNetTask *Steal();    // back of queue, called by other workers
+};
+
+
+// Persistent worker pool, created once per model run and reused across RunNet() calls
+// At most numworkers tasks run at once, each holding a run slot. A task that needs a stage frontier parks and
+// returns its worker, so tasks never wait on the tasks queued behind them. Resumed tasks run ahead of queued tasks.
+class MagNetPool
+{
+public:
+    int numworkers;
+    std::vector<MagNetWorker*> workers;
+
+    wxMutex poolmute;
+    wxCondition *workcond;   // signalled when tasks are queued, a run slot is freed, or the pool is closing
+    wxCondition *donecond;   // signalled when all submitted tasks have completed
+    int queued;              // tasks waiting in worker queues
+    int pending;             // tasks submitted and not yet completed
+    int nextworker;          // round robin submission index
+    std::vector<int> freeslots;
+    bool closing;
+
+    wxStopWatch runwatch;    // wall time since ResetStats()
+
+    MagNetPool(int numworkers);
+    ~MagNetPool();
+
+    void Submit(MagNetTask *task);
+    void Resume(MagNetTask *task);
+    void Wait();
+    MagNetTask *GetTask(MagNetWorker *worker);
+    void TaskDone(MagNetWorker *worker, MagNetTask *task);
+    void ResetStats();
+    wxString Stats(int numtasks);
+};
+
+
+// Simulated time frontier shared between pipeline stages, replacing Sleep() polling
+// The producing stage advances the frontier, consuming stages block in WaitFor() until it passes their step
+// Pool tasks park on the frontier instead, see MagNetTask::Park(), and are requeued by Advance()
+class MagNetFrontier
+{
+public:
+    wxMutex frontmute;
+    wxCondition *frontcond;   // signalled each time the frontier advances
+    int time;                 // steps completed by the producing stage
+    std::multimap<int, MagNetTask*> parked;     // parked tasks by frontier time needed
+    MagNetPool *pool;         // pool of the parked tasks
+
+    // Consumer wait, reset by Reset()
+    double waittime;   // ms blocked
+    int waitcount;     // WaitFor() calls that blocked
+    int parkcount;     // tasks parked
+
+    MagNetFrontier();
+    ~MagNetFrontier();
+
+    void Reset(int time);
+    void Advance(int time);
+    bool Passed(int time);
+    void Park(MagNetTask *task, int time, MagNetPool *pool);
+    void WaitFor(int time);
+    wxString Stats(wxString stage, wxString frontier);
+};
+
+// Greatest common divisor of step periods, for recording block lengths
+inline int stepgcd(int a, int b)
+{
+    while(b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Fast tanh approximation for the IKleak activation, shared by all engines, see magsimd.h for the vector version
+static inline double vox_tanh(const double x)
+{
+    const double ax = fabs(x);
+    const double x2 = x * x;
+    const double z = x * (1.0 + ax + (1.05622909486427 + 0.215166815390934 * x2 * ax) * x2);
+
+    return z / (1.02718982441289 + fabs(z));
+}
+
+
+#define MAGPOISSONTAB 64    // inversion table length, covers mean counts below 10 to 1e-16 tail
+
+
+// Per-step Poisson count sampler, replaces summing exponential inter-arrival times
+// Table inversion for small means, transformed rejection (Hormann PTRS) for mean >= 10
+// Tables and rejection constants are kept for the last mean, so constant rates build them once
+class MagPoisson
+{
+public:
+    double mean;     // mean count per step for current table
+    int tablesize;
+    double cdf[MAGPOISSONTAB];
+
+    // PTRS constants
+    double smu, b, a, invalpha, vr;
+    double logmu, loginvalpha;
+
+    MagPoisson();
+    void SetMean(double mean);
+    int Count(double mean, MagRand &rng);
+};
+
 
 class MagPlasmaMod : public wxThread
 {
@@ -71,8 +301,126 @@ public:
 };
 
 
-// Neuron model thread class
-class MagNeuroMod : public wxThread
+// Network input cache, the input cell PSP event lists of a whole run stored in one file named by a hash of the
+// generation parameters and seed. On a hit the file is memory mapped and read in place by InputFill(), on a miss it is
+// written by the input stage as windows are generated. Files are evicted least recently used first to keep the cache
+// within maxbytes.
+//
+// File layout, native byte order: 8 x int64 header (magic, version, inputcells, inputwin, inputwindows, key length,
+// index position, file size), key text padded to 8 bytes, then per window block int32 EPSP offsets (inputcells + 1),
+// IPSP offsets (inputcells + 1), EPSP steps and IPSP steps, then an int64 index of block positions.
+class MagInputCache
+{
+public:
+    wxString path;     // cache directory
+    wxString key;      // generation parameters and seed
+    double maxbytes;
+
+    // Mapped file
+    bool mapped;
+    char *mapbase;
+    size_t mapsize;
+    int inputcells, inputwin;
+    std::vector<const int*> blocks;     // per window block
+#ifdef _WIN32
+    void *mapfile, *maphandle;
+#endif
+
+    // Writer
+    FILE *wfile;
+    double wbytes;
+    std::vector<long long> wblocks;     // block file positions
+    std::vector<int> wbuff;
+
+    MagInputCache();
+    ~MagInputCache();
+
+    void SetKey(wxString key, wxString path, double maxbytes);
+    wxString FileName();
+    bool Open(int inputcells);
+    void Close();
+    bool Begin(int inputcells, int inputwin, int inputwindows);
+    void Write(std::vector<std::vector<int>> &Eevents, std::vector<std::vector<int>> &Ievents, int ringcell);
+    void Finish(bool complete);
+    void Evict(wxString keep);
+
+    // Mapped PSP steps of input 'cell' in the window holding 'step', psptype 0 EPSP, 1 IPSP
+    inline void Events(int step, int psptype, int cell, const int *&first, const int *&last) {
+        const int *block = blocks[(step - 1) / inputwin];
+        const int *offsets = block + psptype * (inputcells + 1);
+        const int *events = block + 2 * (inputcells + 1) + psptype * block[inputcells];
+        first = events + offsets[cell];
+        last = events + offsets[cell + 1];
+    }
+};
+
+
+// Network input stage, fills the ring of input cell PSP event lists one inputwin window at a time, running ahead of
+// the neuron tasks by up to inputring windows. Input cells are split across inputthreads threads, each cell writing
+// only its own lists from its own EPSP and IPSP streams, so results do not depend on thread count.
+class MagInputMod : public wxThread
+{
+public:
+    MagNetModel *netmod;
+    MagNetMod *mod;
+    MagPop *magpop;
+
+    int inputcells;
+    int celltype;
+    int numthreads;
+    int tstart, tstop, ringcell;      // current window, ringcell indexes its input cell 0 in Einputevents/Iinputevents
+    double neurosyn, netinput, netIratio;
+    std::vector<double> epspt, ipspt;     // per input cell time to next PSP
+    std::vector<MagRand> epsprng, ipsprng;     // per input cell streams
+    std::vector<double> eratewin, iratewin;     // per step PSP rates in the window
+
+    MagInputMod(MagNetModel *);
+    virtual void *Entry();
+
+    void inputwindow(int window);
+    void inputpart(int part);
+};
+
+
+// Helper thread generating one part of the input cells for a window, see MagInputMod::inputwindow()
+class MagInputPart : public wxThread
+{
+public:
+    MagInputMod *inputmod;
+    int part;
+
+    MagInputPart(MagInputMod *inputmod, int part);
+    virtual void *Entry();
+};
+
+
+// Dynamic variables of a MagNeuroMod run, saved when the task parks and restored when it continues
+// Engines work on a local copy, 'step' is the next step to run, 0 before the run starts
+class MagNeuroState
+{
+public:
+    int step;
+    double epspt, ipspt, epspt1, ipspt1, epspt2;
+    double inputPSP2, pspsig, V;
+    double tCa, tdendCa, tHAP, tDAP, tAHP, tAHP2;
+    double tDyno, storeDyno, IKL;
+    double tB, tE, tC, tR, tP, CaEnt, secX;
+    double ttime, neurotime;
+    double noisig, synsig, epsprate;
+    double OsmoPress, IrOsmoPress;
+    double secRate1s, secRate60s, secRate600s, plasmaRate1s;
+    double Casum, spikeCa;
+    int nepsp, nipsp;
+    int synthlast, spikestep, nextin;
+    int inputdone;
+    bool flagError;
+
+    MagNeuroState() { step = 0; }
+};
+
+
+// Neuron model task class, queued on the MagNetPool worker pool
+class MagNeuroMod : public MagNetTask
 {
 public:
     MagNeuron *neuron;  // neuron object
@@ -147,6 +495,8 @@ public:
     int scalemode;
     int polymode;
     int decaymode;
+    int synthmulti;    // multi-rate synthesis, advanced every 'synthstep' ms
+    int synthstep;
 
     // Protocol Parameters
     double rampbase;
@@ -185,32 +535,165 @@ public:
     double sigIratio;
     bool noisemode, signalmode;
     
-    // Random Number Generator
-    HypoRand rng;
+    // Random Number Generator, counter based stream (modseed, neurodex)
+    MagRand rng;
+
+    // PSP input count samplers, E, I, signal E and I, NMDA E
+    MagPoisson epspgen, ipspgen;
+    MagPoisson epspgen1, ipspgen1;
+    MagPoisson epspgen2;
+    int expinput;     // 1 for original exponential inter-arrival PSP generation
+
+    int runmode;      // MAGMODE flags for the current run
+
+    // Probes on this neuron, recorded in MAGMODE_PROBE variants only
+    std::vector<MagProbe*> probes;
+    int probestep;    // next step any probe records
+
+    MagNeuroState state;     // run state while parked
+    std::vector<double> synthrec;     // synthesis rate per minute for delayed recall
 
     MagNeuroMod(int index, MagNeuron *neuron, MagNetModel *magnetmodel);
 
     // running the model for a single neuron (each time)
     void neuromod();
-    virtual void *Entry();
+    void neuromod(int mode);     // run a given MAGMODE variant
+    int NeuroMode();
+    template<int MODE> void neuromodloop();
+    int ProbeRecord(int step, const double *probeval);
+    void SynthUpdate(double Cainput, int span);     // exact synthesis update across a span, multi-rate and event modes
+    void eventmod();     // event driven alternative, see magneuroevent.cpp
+    void coarsemod();    // hstep above 1 ms, see magneurocoarse.cpp
+    virtual void RunTask();
     //void calcLognorm();
 };
 
 
+#define MAGBLOCK 8     // neurons per MagNeuroBlock, a multiple of MAGSIMD
+
+
+// Batched neuron engine task, runs the MagNeuroMod::neuromod() model for a block of up to MAGBLOCK neurons
+// with the per-step state held as structure-of-arrays, advancing MAGSIMD neurons per vector instruction
+// Parameters, random number streams and recording stay with each lane's MagNeuroMod
+class MagNeuroBlock : public MagNetTask
+{
+public:
+    MagNetModel *netmod;
+    MagNetMod *mod;
+    MagPop *magpop;
+    MagNeuroMod *lane[MAGBLOCK];
+    int numlanes;
+    int inputgen;
+    int inputdex;      // input count index for the current step, counts are filled per 1000 steps
+    unsigned char *inputE, *inputI;     // per lane input counts, MAGBLOCK x 1000, held by Run() during the run
+    int inputdone;     // input windows released
+    int nextstep;      // next step to run when the task continues after parking, 0 before the run starts
+    double ttime;
+
+    // Lane state
+    double pspsig[MAGBLOCK], V[MAGBLOCK];
+    double tHAP[MAGBLOCK], tDAP[MAGBLOCK];
+    double tAHP[MAGBLOCK], tAHP2[MAGBLOCK];
+    double tCa[MAGBLOCK], tdendCa[MAGBLOCK];
+    double tDyno[MAGBLOCK], storeDyno[MAGBLOCK];
+    double inputPSP[MAGBLOCK], inputPSP1[MAGBLOCK];
+    double inputPSP2[MAGBLOCK], nepsp2[MAGBLOCK];
+    double tB[MAGBLOCK], tE[MAGBLOCK], tC[MAGBLOCK];
+    double CaEnt[MAGBLOCK], secX[MAGBLOCK];
+    double tR[MAGBLOCK], tP[MAGBLOCK], fillR[MAGBLOCK];
+    double stimTS[MAGBLOCK], stimTL[MAGBLOCK];
+    double synthrate[MAGBLOCK], mRNAstore[MAGBLOCK];
+    double secRate1s[MAGBLOCK], secRate60s[MAGBLOCK], secRate600s[MAGBLOCK];
+
+    // Lane input state
+    double epspt[MAGBLOCK], ipspt[MAGBLOCK];
+    double epspt1[MAGBLOCK], ipspt1[MAGBLOCK], epspt2[MAGBLOCK];
+    double epsprate[MAGBLOCK], epsprate2[MAGBLOCK];
+    double noisig[MAGBLOCK], synsig[MAGBLOCK];
+
+    // Lane constants
+    double Vrest[MAGBLOCK], Vthresh[MAGBLOCK];
+    double tauMem[MAGBLOCK], tauPSP2[MAGBLOCK], epspmag2[MAGBLOCK], hstep[MAGBLOCK];
+    double kHAP[MAGBLOCK], tauHAP[MAGBLOCK];
+    double kDAP[MAGBLOCK], tauDAP[MAGBLOCK];
+    double kAHP[MAGBLOCK], tauAHP[MAGBLOCK];
+    double kAHP2[MAGBLOCK], tauAHP2[MAGBLOCK], aAHP2[MAGBLOCK];
+    double kCa[MAGBLOCK], tauCa[MAGBLOCK], Ca_rest[MAGBLOCK];
+    double kDyno[MAGBLOCK], tauDyno[MAGBLOCK], spikeDyno[MAGBLOCK];
+    double kstoreDyno[MAGBLOCK], taudendCa[MAGBLOCK];
+    double gKL[MAGBLOCK], ka[MAGBLOCK], gOsmo[MAGBLOCK];
+    double kB[MAGBLOCK], tauB[MAGBLOCK], Bbase[MAGBLOCK];
+    double kE[MAGBLOCK], tauE[MAGBLOCK], Ethpow[MAGBLOCK];
+    double kC[MAGBLOCK], tauC[MAGBLOCK], Cthpow[MAGBLOCK];
+    double alpha[MAGBLOCK], beta[MAGBLOCK], secExp[MAGBLOCK], secXfix[MAGBLOCK];
+    double Rmax[MAGBLOCK], Pmax[MAGBLOCK];
+    double kTS[MAGBLOCK], tauTS[MAGBLOCK];
+    double kTL[MAGBLOCK], tauTL[MAGBLOCK], basalTL[MAGBLOCK];
+    double synscale[MAGBLOCK], rateSR[MAGBLOCK], shstep[MAGBLOCK];
+    double mRNAtau[MAGBLOCK], mRNAmax[MAGBLOCK];
+
+    MagNeuroBlock(MagNetModel *magnetmodel);
+    void AddLane(MagNeuroMod *neuromod);
+
+    void neuroblock();
+    void LaneInput(int j, int step);
+    virtual void RunTask();
+};
+
+
+// Pool task for the netanalysis population sums, part of the neurons' MagSpikeStats bins, summed here and merged
+// in part order by RunNet(), and part of the 1 ms rate bins, written directly to netdat
+class MagNetStats : public MagNetTask
+{
+public:
+    MagNetModel *netmod;
+    int part, numparts;
+    std::vector<double> hist1, hist5, haz1, haz5;
+    std::vector<double> rate1s;
+
+    MagNetStats(MagNetModel *netmod, int part, int numparts);
+    virtual void RunTask();
+};
+
+
+enum {
+    POPTASK_STORE,         // store sum, one tile of steps
+    POPTASK_STORELONG,     // store and synthesis minute means, one tile of minutes
+    POPTASK_STA,           // population spike triggered average
+    POPTASK_SECRETION      // secretion mean and IoD
+};
+
+
+// Pool task for one stage of the post-run population analysis, or one tile of a reduction, see MagNetModel::PopAnalysis()
+class MagPopTask : public MagNetTask
+{
+public:
+    MagNetModel *netmod;
+    int stage;
+    int start, stop;
+
+    MagPopTask(MagNetModel *netmod, int stage, int start = 0, int stop = 0);
+    virtual void RunTask();
+};
+
+
 // Main MagNet model thread class, to run the network and coordinate the neuron threads
 class MagNetModel : public ModThread
 {
 public:
-    std::vector<MagNeuron> &neurons;
+    std::deque<MagNeuron> &neurons;
     MagNetMod *mod;
     MagNetDat *netdata;
-    MagNeuroMod *neurothread[1000];  // for storing the neuron threads, currently set to a maximum of 1000 neurons
+    std::vector<MagNeuroMod*> neurotasks;  // neuron tasks for the current RunNet(), run on the worker pool
+    std::vector<MagNeuroBlock*> blocktasks;   // block engine tasks, each running up to MAGBLOCK of the neurotasks
+    MagNetPool *pool;
     MagSpikeBox *spikebox;
     MagSynthBox *synthbox;
     MagSecBox *secbox;
     MagNetBox *netbox;
     MagNeuroDat *neurodata;
     MagPlasmaMod *plasmathread;
+    MagInputMod *inputthread;
     //OxyOsmoMod *osmothread;
     //OxySigMod *sigthread;
     MagPop *magpop;
@@ -223,6 +706,13 @@ public:
     int netrate, osmorate, buffrate;
     int osmo_hstep;
     int spikemode, secmode, osmomode, plasmamode;
+    int eventmode;
+    int neurorec;      // neuron 0 monitor records, pspsig, input signal, and datsample synthesis and Ca traces
+    int stawin;        // spike triggered average window in steps either side of the spike, 0 off, see MagSTA
+    int spikestats;    // neuron ISI and rate bins for netanalysis, see MagSpikeStats
+    std::vector<MagNetStats*> statsparts;     // netanalysis parts running on the pool
+    std::vector<int> hetsynbin, hetratebin;   // per neuron hetero population histogram bins, set by NeuronDone()
+    int secexact;      // fixed point population secretion sum, bitwise reproducible across thread counts
     int secfix;
     unsigned long modseed;
     HypoRand rng;
@@ -233,7 +723,9 @@ public:
     double OsmoPress;  // not currently used, see OsmoStore
 
     datdouble OsmoStore;   // osmotic pressure buffer for feeding neuron threads
-    int osmotime;
+    MagNetFrontier *osmofront;   // osmotic stage time, neuron tasks park at osmorate steps
+    MagNetFrontier *secfront;    // last complete population secretion buffer, plasma stage waits at buffrate steps
+    MagNetFrontier *secfree;     // population secretion consumed by the plasma stage, neuron tasks park for a free ring epoch
 
     // Protocol Flags
     bool rampflag;
@@ -247,14 +739,77 @@ public:
 
     int runtime;
     int numneurons;
+    int numworkers;     // worker pool size, 0 for hardware thread count
     wxMutex *diagmute;
     bool initflag;
 
     void Initialise();
     void RunNet();
+    // Population secretion ring, each buffrate epoch is reduced from per run slot partial sums when every neuron
+    // has filled it, and freed by the plasma stage as it is consumed. Memory is fixed by secring, not runtime.
+    int secring;                     // ring depth in buffer epochs
+    std::vector<double> secbuff;     // reduced population secretion, buffrate entries per ring epoch, plasma_hstep sums
+    std::vector<double> secpart;     // partial sums, secring epochs per run slot
+    std::vector<MagSecSum> secsum;   // fixed point partial sums, used with secexact
+    std::atomic<int> *epochcount;    // neurons flushed per ring epoch
+    std::vector<bool> epochdone;     // ring epochs reduced ahead of epochfront
+    int numepochs;
+    int epochfront;                  // first epoch not yet reduced
+
+    // Event mode decay powers, shared by neurons with the same decay factors, cleared each run
+    std::map<std::vector<double>, std::vector<double>> eventdecay;
+    wxMutex eventmute;
+    const double *EventDecay(const std::vector<double> &factors, int recint);
+
+    // Windowed network input, InputGen() connects the input cells, MagInputMod fills a ring of input cell PSP event
+    // lists during the run and each neuron merges its cells' events with InputFill(). Memory scales with input events
+    // and connections, not neurons x steps.
+    int inputwin;                    // window length in steps, a multiple of 1000
+    int inputring;                   // ring depth in windows
+    int inputwindows;                // windows in the run
+    int inputcells;                  // input cells connected by InputGen()
+    int inputthreads;                // input stage threads
+    std::vector<int> Einputstart;    // CSR EPSP connections, neuron n's input cells are Einputcells[Einputstart[n] to Einputstart[n + 1] - 1]
+    std::vector<int> Einputcells;
+    std::vector<int> Iinputstart;    // CSR IPSP connections
+    std::vector<int> Iinputcells;
+    std::vector<std::vector<int>> Einputevents;     // [ring window * inputcells + input cell] = EPSP steps in order, one entry per PSP
+    std::vector<std::vector<int>> Iinputevents;     // IPSP steps
+    MagInputCache *inputcache;       // whole run event lists, replaces the ring when mapped
+    bool inputcachemode;
+    std::atomic<int> *inputcount;    // neurons released per ring window
+    MagNetFrontier *inputfront;      // input generated, neuron stage waits before each recording block
+    MagNetFrontier *inputfree;       // input released by every neuron, input stage waits for a free ring window
+
+    // Probes, added after Initialise() and sized and attached to neuron tasks by RunNet()
+    std::deque<MagProbe> probes;
+
+    MagProbe *AddProbe(int neuron, int var, int start, int stop, int decimate, datdouble *rec = NULL);
+    void ClearProbes();
+
+    void InputReset();
+    void InputRelease(int window, int count);
+    void InputFill(int neuron, int tstart, int tstop, unsigned char *countE, unsigned char *countI);
+    void InputCacheOpen();
+    void SecReset();
+    bool SecPark(MagNetTask *task, int step);
+    void SecFlush(MagNetWorker *worker, double *secXbuffer, int size, int step, int plasma_hstep, int count);
+    void SecReduce(int epoch, int plasma_hstep);
+    void EngineCheck(int numcheck);
+    void StepCheck(int numcheck);
+    void ModeBench();
+    void ScaleBench();
+    void RandBench();
+    void RandTest(wxString name, double stat, double limit);
+    void RandMoments(std::vector<double> &draws, double &mean, double &var);
     void Export2file(int, wxString, datdouble);
     int InputGen();
     void SecretionAnalysis();
+    void NeuronDone(int neurodex);
+    void PopAnalysis();
+    void HeteroHist();
+    void NetStatsSubmit();
+    void NetStats();
     void RunRange();
 
     MagNetModel(MagNetMod *mod);
@@ -280,7 +835,8 @@ public:
 
     ParamBox *dispbox;
 
-    std::vector<MagNeuron> modneurons;
+    std::deque<MagNeuron> modneurons;    // deque, resize keeps existing neurons in place
+    MagNeuroPool *neuropool;    // NeuroDat analysis storage lent to modneurons
     SpikeDat *currmodneuron; 
     SpikeDat *netdat;
     SpikeDat *netneuron;
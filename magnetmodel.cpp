@@ -11,6 +11,13 @@
 
 
 #include "magnetmod.h"
+#include <string.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 //wxDECLARE_EVENT(wxEVT_COMMAND_MODTHREAD_COMPLETED, wxThreadEvent);
 
@@ -29,6 +36,10 @@ MagNetModel::MagNetModel(MagNetMod *magnetmod)
 	//neurons = mod->neurons;
 	neurodata = mod->neurodata;
 	initflag = false;
+	pool = NULL;
+	epochcount = NULL;
+	inputcount = NULL;
+	inputcache = NULL;
 
 	//Protocol Parameters
 	rampstart = new int[mod->celltypes];
@@ -43,17 +54,26 @@ MagNetModel::MagNetModel(MagNetMod *magnetmod)
 
 void *MagNetModel::Entry()
 {
-	int i;
 	wxString text;
 
 	diagmute = new wxMutex;
 	secmute = new wxMutex;
 	osmomute = new wxMutex;
+	secfront = new MagNetFrontier;
+	secfree = new MagNetFrontier;
+	osmofront = new MagNetFrontier;
+	inputfront = new MagNetFrontier;
+	inputfree = new MagNetFrontier;
+	inputcache = new MagInputCache;
     
     //wxCommandEvent endrunevent(wxEVT_COMMAND_TEXT_UPDATED, ID_EndRun);
 
 	Initialise();        // Read in parameters
 
+	// Worker pool, persists across RunRange() iterations
+	pool = new MagNetPool(numworkers);
+	mod->DiagWrite(text.Format("Worker pool %d threads\n", pool->numworkers));
+
 	// Generate non-independent PSP counts
 	if((*netflags)["inputgen"]) {
 		mod->netbox->SetStatus("InputGen...\n");
@@ -66,52 +86,25 @@ void *MagNetModel::Entry()
 	if(prototype == range) RunRange();
 	else RunNet();            // Generate and run network and cell threads
 	
-	//magpop->PopSum();
-	SecretionAnalysis();
-	//mod->diagbox->Write(text.Format("Pop Sec  Mean %.4f  IoD 1s bin = %.4f\n\n", magpop->secmean, magpop->secIoD));
-	//mod->diagbox->Write(text.Format("Pop Sec  Mean %.4f  IoD 4s bin = %.4f\n\n", magpop->secmean_4s, magpop->secIoD_4s));
-
-
-	// Hetero Pop Analysis    22/2/13
-
-	double synvar, neurate;
-	int syndist[1000];
-	int ratedist[1000];
-
-	for(i=0; i<1000; i++) {
-		syndist[i] = 0;
-		ratedist[i] = 0;
-	}
-
-	for(i=0; i<numneurons; i++) {
-		synvar = (*(neurons[i].spikeparams))["synvar"];
-		//mainwin->diagbox->Write(text.Format("MagNetMod neuron %d synvar %.4f\n", i, synvar));
-		syndist[(int)(synvar*200)/10]++;
-		//neurate = neurons[i].ratemean[0];
-		neurate = neurons[i].spikecount2 / runtime;
-		//ratedist[(int)(neurate*50)/5]++;
-		ratedist[(int)(neurate*50)/10]++;   // 0.2 spikes/s bins
-	} 
-
-	for(i=0; i<1000; i++) {
-		mod->datahistx[0][i] = i * 0.05;
-		mod->datahist[0][i] = syndist[i];
-		//mod->datahist[0][i] = 100;
-		mod->datahistx[1][i] = i * 0.2;
-		mod->datahist[1][i] = ratedist[i];
-	}
+	// Population analysis, secretion analysis, and hetero histograms are run by RunNet(), see PopAnalysis()
 
 	// Clean Up
+	delete pool;
+	pool = NULL;
 	delete diagmute;
 	delete secmute;
 	delete osmomute;
-
-	 if((*netflags)["inputgen"]) {
-		for(int i=0; i<numneurons; i++) {
-			delete[] neurons[i].dendinputE;
-			delete[] neurons[i].dendinputI;
-		}
-	}
+	delete secfront;
+	delete secfree;
+	delete osmofront;
+	delete [] epochcount;
+	epochcount = NULL;
+	delete inputfront;
+	delete inputfree;
+	delete [] inputcount;
+	inputcount = NULL;
+	delete inputcache;
+	inputcache = NULL;
 
 	delete[] rampstart;
 	delete[] rampstop;
@@ -201,7 +194,7 @@ void MagNetModel::RunRange()
 void MagNetModel::Initialise()
 {
 	int i;
-	int maxtime = 10000;
+	int probestart, probestop;
 	wxString text, tag[10];
 
 	netparams = mod->netbox->GetParams();
@@ -214,7 +207,17 @@ void MagNetModel::Initialise()
 	osmorate = int((*netparams)["osmorate"]);
 	osmo_hstep = int((*netparams)["osmo_hstep"]);
 	buffrate = int((*netparams)["buffrate"]);
-	//modseed = (*netparams)["modseed"];
+	secring = int((*netparams)["secring"]);
+	if(secring < 2) secring = 2;
+	inputwin = int((*netparams)["inputwin"]) * 1000;     // parameter in s
+	if(inputwin < 1000) inputwin = 1000;
+	inputring = int((*netparams)["inputring"]);
+	if(inputring < 2) inputring = 2;
+	inputcachemode = (*netflags)["inputcache"];
+	inputthreads = int((*netparams)["inputthreads"]);
+	if(inputthreads < 1) inputthreads = 1;
+	numworkers = int((*netparams)["numworkers"]);
+	modseed = (*netparams)["modseed"];
 	mod->popscale = (*netparams)["popscale"];
 
 	mod->neurodatabox->neurocount = numneurons;
@@ -223,6 +226,23 @@ void MagNetModel::Initialise()
 	secmode = (*netflags)["secmode"];   // run secretion and plasma models if secmode = 1
 	//secfix = (*netflags)["secfix"];
 	plasmamode = (*netflags)["plasmamode"];   
+	eventmode = (*netflags)["eventmode"];     // event driven neuron integration, see magneuroevent.cpp
+	secexact = (*netflags)["secexact"];       // fixed point secretion reduction, see SecFlush()
+	neurorec = (*netflags)["neurorec"];       // off for runs that only need probes and population records
+	stawin = 0;
+	if((*netflags)["staflag"]) stawin = int((*netparams)["stawin"]);
+	if(stawin < 0) stawin = 0;
+	spikestats = (*netflags)["netanalysis"] || (*netflags)["neurocache"];     // per neuron bins, also used by NeuroData(), off by default for large networks
+
+	// Panel probe, recorded to neurodata->probe for display, window in s with 0 stop for the run end
+	ClearProbes();
+	if((*netflags)["probe"]) {
+		probestart = int((*netparams)["probestart"]);
+		probestop = int((*netparams)["probestop"]);
+		if(probestop <= 0) probestop = runtime;
+		AddProbe(int((*netparams)["probeneuron"]), int((*netparams)["probevar"]), probestart * 1000 + 1, probestop * 1000,
+			int((*netparams)["probedec"]), &neurodata->probe);
+	}
 
 	ParamStore *neuroflags = mod->spikebox->modflags;
 	if((*neuroflags)["ipInfusionflag"] || (*neuroflags)["ivInfusionflag"]) osmomode = 1;
@@ -237,14 +257,18 @@ void MagNetModel::Initialise()
 	init_mrand(modseed);
 	*/
 
-	// Initialise osmomod osmotic pressure buffer
-	OsmoStore.setsize(maxtime * 1000);
-	osmotime = 0;
+	// Initialise osmomod osmotic pressure buffer, only read with osmotic sync
+	if(osmomode) OsmoStore.setsize(runtime * 1000 / osmo_hstep + 1);
 
 	// Initialise Population
     magpop->numneurons = numneurons;
 	magpop->runtime = runtime;
 	magpop->neurons = &neurons;
+
+	// Size run records to the run
+	magpop->RunSize(runtime);
+	neurodata->RunSize(runtime, mod->datsample);
+	for(i=0; i<numneurons; i++) neurons[i].RunSize(runtime, mod->datsample);
 	//mod->magpop->StoreClear();
 
 	//NeuroGen();     // Copy and generate individual neuron parameters sets
@@ -363,231 +387,92 @@ void MagNetModel::NeuroGen()
 */
 
 
+// Append 'numsyn' distinct input cells from 'numcells' to 'cells' in ascending order, Floyd's sampling without replacement
+// Each draw takes one random number, 'inputcheck' marks chosen cells and is left cleared
+static void InputSample(HypoRand &rng, int numcells, int numsyn, std::vector<int> &cells, std::vector<int> &inputcheck)
+{
+	int j, cell;
+	size_t first = cells.size();
+
+	if(numsyn > numcells) numsyn = numcells;
+
+	for(j=numcells-numsyn; j<numcells; j++) {
+		cell = floor(rng.uniform01() * (j + 1));
+		if(inputcheck[cell]) cell = j;
+		inputcheck[cell] = 1;
+		cells.push_back(cell);
+	}
+	for(j=first; j<(int)cells.size(); j++) inputcheck[cells[j]] = 0;
+	std::sort(cells.begin() + first, cells.end());
+}
+
+
+// Connect input cells to neurons as CSR lists, PSP events are generated during the run by MagInputMod
 int MagNetModel::InputGen()
 {
-	int i, n, c, t, inpcell;
-	int msteps = 1000;    // number of neuron model steps per s
-	double gen;
-	double inpfreq;
-	int cell;
-	int inputcells;
+	int i, n, c, numsyn;
 	double neurosyn, synvar;
-	double netinput, netIratio;
-	double hstep = 1;
 	ParamStore *neuroparams;
 	wxString text;
-
-	double epspt, ipspt;
-	double erate, irate;
-	int nepsp, nipsp;
-	int numsteps;
-	int celltype;
-
-	int maxinputcells = 500;
-	int maxconnect = 1000;
     
-    HypoRand rng(time(NULL));
+    // Connection stream from modseed, reproducible with the run
+    rng.seed(static_cast<uint64_t>(modseed), MAGSTREAM_CONNECT);
 
 	FILE *ofp = NULL, *tofp = NULL;
-	wxCommandEvent progevent(wxEVT_COMMAND_TEXT_UPDATED, ID_Progress);
-
-	// std::vector<std::vector<int>> aVector(row_size, std::vector<int>(col_size));
-
-	std::vector<std::vector<short>> Ecellconnect(maxinputcells, std::vector<short>(maxconnect));
-	std::vector<std::vector<short>> Icellconnect(maxinputcells, std::vector<short>(maxconnect));
-	//short *Icellconnect[500];
-
-	//for(i=0; i<maxinputcells; i++) Ecellconnect[i] = new short[maxconnect];
-	//for(i=0; i<maxinputcells; i++) Icellconnect[i] = new short[maxconnect];
-
-	//short Ecellconnect[500][1000];  // Stores the EPSP connection matrix    ([input cell, connection index] = neuron index)  
-	//short Icellconnect[500][1000];  // Stores the IPSP connection matrix    max 500 input cells, max 100 neuron connections per input cell
-	short Econnect[500];			  // Connection counts for each EPSP input cell 
-	short Iconnect[500];			  // Connection counts for each IPSP input cell 
-	short inputcheck[500];
-
-	unsigned char *dendinputE[1000];
-	unsigned char *dendinputI[1000];
 
 	if(diag) tofp = fopen("inputgen-diag.txt", "w");
 
 	inputcells = (*netparams)["inputcells"];   // Number of input (presynaptic) cells 
 	neurosyn = (*netparams)["neurosyn"];       // Number of input (presynaptic) cells connected each neuron in network/population
-	netinput = (*netparams)["netinput"];       // EPSP input rate
-	netIratio = (*netparams)["netIratio"];     // Input Iratio - IPSP/EPSP ratio
 
 	// inputcells must be greater than or equal to neurosyn
 	if(inputcells < neurosyn) {
 		mod->diagbox->Write("\nInputGen : Error, inputcells too low for neurosyn\n");
+		if(tofp) fclose(tofp);
 		return 0;
 	}
 
+	// CSR connection lists, neuron n's cells follow neuron n - 1's
+	Einputstart.assign(numneurons + 1, 0);
+	Iinputstart.assign(numneurons + 1, 0);
+	Einputcells.clear();
+	Iinputcells.clear();
+	Einputcells.reserve((size_t)(numneurons * neurosyn));
+	Iinputcells.reserve((size_t)(numneurons * neurosyn));
+	std::vector<int> inputcheck(inputcells, 0);
+
 	// Ratio of inputcells to neurosyn determine degree of independence between neurons inputs, 1 gives every neuron the same PSPs 
 	// Currently Iratio determines relative IPSP rate rather than number of connected IPSP cells
-	// Input rate (netinput) currently fixed but could easily be varied, just have to do rate and Iratio conversion at each step
-
 
 	// Ramp Protocol
 	prototype = (*mod->modeflags)["prototype"];
-	double rampstep1ms[2]; 
-	rampstep1ms[0] = (double)rampstep[0] / 1000;
-	rampstep1ms[1] = (double)rampstep[1] / 1000;
-	celltype = 0;
-
-	inpfreq = netinput / neurosyn;
-	//inpfreq = 3;
-	erate = inpfreq / 1000;
-	irate = erate * netIratio;
-
-	//// Set up connections
-	//for(i=0; i<inputcells; i++) {
-	numsteps = msteps * runtime;
 
 	if(diag) {
 		fprintf(tofp, "InputGen %d input cells, %d neurons\n", inputcells, numneurons);
-		fprintf(tofp, "Runtime %d  Numsteps %d  Neuron Inputs %.2f\n\n", runtime, numsteps, neurosyn);
+		fprintf(tofp, "Input window %d steps, ring %d windows  Neuron Inputs %.2f\n\n", inputwin, inputring, neurosyn);
 		fflush(tofp);
 	}
 
-	for(inpcell=0; inpcell<inputcells; inpcell++) {
-		Econnect[inpcell] = 0;
-		Iconnect[inpcell] = 0;
-	}
-
 
 	// Loop generates random subset of input cells for each neuron, repeated for EPSPs and IPSPs 
 
 	for(n=0; n<numneurons; n++) {
-		// Progress
-		//if(n%(numneurons/10) == 0) mod->oxynetbox->SetStatus(text.Format("InputGen...%d\%\n", 100*n/numneurons));
-		// Input Storage
-		neurons[n].dendinputE = new unsigned char[numsteps];
-		neurons[n].dendinputI = new unsigned char[numsteps];
-		//mod->diagbox->Write(text.Format("neuron %d allocated %d\n"));
-		for(t=0; t<numsteps; t++) {
-			neurons[n].dendinputE[t] = 0;
-			neurons[n].dendinputI[t] = 0;
-		}
-
 		// Heterogeneity
 		neuroparams = neurons[n].spikeparams;
 		synvar = (*neuroparams)["synvar"];
-
-		//fprintf(tofp, "neuron %d storage ok\n", n);
-		//fflush(tofp);
+		numsyn = (int)(neurosyn * synvar);
 
 		// Connection generation
-
-		for(inpcell=0; inpcell<inputcells; inpcell++) inputcheck[inpcell] = 0;    
-
-		//fprintf(tofp, "neuron %d connections cleared\n", n);
-		//fflush(tofp);
-
-		for(c=0; c<(int)(neurosyn * synvar); c++) {
-            gen = rng.uniform01();
-			cell = floor(gen * inputcells);
-			while(inputcheck[cell] > 0) {
-                gen = rng.uniform01();
-				cell = floor(gen * inputcells);
-			}
-			inputcheck[cell]++;
-			//neurons[n].inputconnect[c] = cell;
-			Ecellconnect[cell][Econnect[cell]] = n;
-			Econnect[cell]++;
-		}
-
-		for(inpcell=0; inpcell<inputcells; inpcell++) inputcheck[inpcell] = 0;
-
-		//fprintf(tofp, "neuron %d connections cleared\n", n);
-		//fflush(tofp);
-
-		for(c=0; c<(int)(neurosyn * synvar); c++) {
-            gen = rng.uniform01();
-			cell = floor(gen * inputcells);
-			while(inputcheck[cell] > 0) {
-                gen = rng.uniform01();
-				cell = floor(gen * inputcells);
-			}
-			inputcheck[cell]++;
-			//neurons[n].inputconnect[c] = cell;
-			Icellconnect[cell][Iconnect[cell]] = n;
-			Iconnect[cell]++;
-		}
-
-		//fprintf(tofp, "neuron %d connections generated\n", n);
-		//fflush(tofp);
+		InputSample(rng, inputcells, numsyn, Einputcells, inputcheck);
+		Einputstart[n + 1] = Einputcells.size();
+		InputSample(rng, inputcells, numsyn, Iinputcells, inputcheck);
+		Iinputstart[n + 1] = Iinputcells.size();
 	}
 
 	if(diag) fprintf(tofp, "\n");
 
 	mod->netbox->SetStatus("InputGen...connect OK...\n");
 
-	// Input generation
-
-	// Loop generates random epsps for each input cell
-	// - could reverse loop order to put cell loop inside time step loop for more efficient variable erate
-	// - but current order better for potential multi-threading
-
-	for(inpcell=0; inpcell<inputcells; inpcell++) {
-		epspt = -log(1 - rng.uniform_open01()) / erate;   // initial epspt value, could just be 0
-		ipspt = -log(1 - rng.uniform_open01()) / irate;
-
-		mod->netbox->SetStatus(text.Format("InputGen...connect OK...cell %d\n", inpcell));
-
-		// input array pointer copies for fast access
-		for(c=0; c<Econnect[inpcell]; c++) dendinputE[c] = neurons[Ecellconnect[inpcell][c]].dendinputE;
-		for(c=0; c<Iconnect[inpcell]; c++) dendinputI[c] = neurons[Icellconnect[inpcell][c]].dendinputI;
-
-		for(t=0; t<numsteps; t++) {
-
-			// Variable Input Signal
-			if(prototype == ramp) {
-				//mod->diagbox->Write("set ramp\n"); 
-				if(t < rampstart[celltype]*1000) rampinput[celltype] = rampbase[celltype];
-				if(t >= rampstart[celltype]*1000 && t < rampstop[celltype]*1000) 
-					rampinput[celltype] = rampinit[celltype] + (t - rampstart[celltype]*1000) * rampstep1ms[celltype] * hstep;
-				//if(t >= rampstop[celltype]*1000) rampinput[celltype] = rampbase[celltype];
-				if(t >= rampstop[celltype]*1000) rampinput[celltype] = rampafter[celltype];
-				netinput = rampinput[celltype];
-				if(netinput < 0) netinput = 0;
-
-				inpfreq = netinput / neurosyn;
-				erate = inpfreq / 1000;
-				irate = erate * netIratio;
-			}
-
-			if(!inpcell && t%1000 == 0) magpop->netsignal[t/1000] = netinput;   // Record net signal at 1s resolution
-
-			nepsp = 0;
-			while(epspt < hstep) {
-				nepsp++;
-				epspt = -log(1 - rng.uniform_open01()) / erate + epspt;
-			}
-			epspt = epspt - hstep;
-
-			// At each step add EPSPs to EPSP counts for all connected neurons
-			if(nepsp > 0) {
-				// add input
-				for(c=0; c<Econnect[inpcell]; c++) 
-					//neurons[Ecellconnect[inpcell][c]].dendinputE[t] += nepsp;	
-					dendinputE[c][t] += nepsp;
-			}
-
-			nipsp = 0;
-			while(ipspt < hstep) {
-				nipsp++;
-				ipspt = -log(1 - rng.uniform_open01()) / irate + ipspt;
-			}
-			ipspt = ipspt - hstep;
-			if(nipsp > 0) {
-				// add input
-				for(c=0; c<Iconnect[inpcell]; c++)
-					//neurons[Icellconnect[inpcell][c]].dendinputI[t] += nipsp;
-					dendinputI[c][t] += nipsp;
-			}
-		}
-	}
-
 
 	// Diagnostic Output
 
@@ -597,24 +482,14 @@ int MagNetModel::InputGen()
 		fprintf(ofp, "Input Network\n\n");
 		fprintf(ofp, "%d input cells\n", inputcells);
 
-		for(i=0; i<10; i++) {
-			fprintf(ofp, "input cell %d  connections %d\n", i, Econnect[i]);
-			fprintf(ofp, "neuron ");
-			for(c = 0; c<Econnect[i]; c++) fprintf(ofp, "%d ", Ecellconnect[i][c]);
+		for(i=0; i<10 && i<numneurons; i++) {
+			fprintf(ofp, "neuron %d  connections %d\n", i, Einputstart[i + 1] - Einputstart[i]);
+			fprintf(ofp, "input cell ");
+			for(c = Einputstart[i]; c<Einputstart[i + 1]; c++) fprintf(ofp, "%d ", Einputcells[c]);
 			fprintf(ofp, "\n");
 		}
 		fprintf(ofp, "\n"); 
 
-		int epspsum = 0, ipspsum = 0;
-
-		for(t=0; t<1000; t++) {
-			if(neurons[0].dendinputE[t] > 0 || neurons[0].dendinputI[t] > 0) 
-				fprintf(ofp, "neuron0  time %dms  epsp %d  ipsp %d\n", t, neurons[0].dendinputE[t], neurons[0].dendinputI[t]);
-			epspsum += neurons[0].dendinputE[t];
-			ipspsum += neurons[0].dendinputI[t];
-		}
-		fprintf(ofp, "epsp total %d  ipsp total %d\n", epspsum, ipspsum);
-
 		fclose(ofp);
 	}
 	if(diag) fclose(tofp);
@@ -626,137 +501,1091 @@ int MagNetModel::InputGen()
 void MagNetModel::RunNet()
 {
 	int i;
-	int step;
 	wxString text;
-	int maxtime = magpop->maxtime;
+	int numcheck;
+	bool blockmode, coarse, inputgen;
 	clock_t timestart, timerun;
 
 	mod->DiagWrite(text.Format("\nRunNet %d neurons\n\n", numneurons));
+	inputgen = (*netflags)["inputgen"];
+
+	// Time specialised neuromod() variants against the generic loop
+	if((*netflags)["modebench"]) ModeBench();
+
+	// Time and memory per neuron at increasing network sizes
+	if((*netflags)["scalebench"]) ScaleBench();
+
+	// Random number generator throughput and statistics
+	if((*netflags)["randbench"]) RandBench();
 
 	netsecX = 0;
 	tPlasma = 0;
 	tEVF = 0;
 
-	// Initialise buffered secretion summation store
-	for(i=0; i<maxtime*1000; i++) mod->magpop->secX[i] = 0;
-	for(i=0; i<maxtime; i++) mod->magpop->secXcount[i] = 0;
-	mod->magpop->secXtime = -1;
-
-	// Generate and run neuron threads
-	// Every thread is an instance of the class MagNeuroMod that runs the single neuron code 
-	// Every thread needs to be created, run, and deleted after it has finished
-
-	// Create Threads
+	// Stage frontiers and secretion ring, neuron tasks advance secretion, the osmotic stage advances osmotic pressure,
+	// and the input stage advances network input
+	SecReset();
+	osmofront->Reset(0);
+	if(inputgen) InputReset();
+	eventdecay.clear();
+
+	// Every run rewrites the spike records, including each RunRange() point, so drop pooled analysis storage
+	mod->neuropool->Reset();
+
+	// Generate and run neuron tasks
+	// Every neuron is an instance of the class MagNeuroMod that runs the single neuron code 
+	// Tasks are queued on the persistent worker pool, sized to the hardware rather than the network
+	// In block mode neurons are grouped MAGBLOCK per MagNeuroBlock task and run in SIMD lanes
+
+	blockmode = (*netflags)["blockmode"] && !osmomode && !eventmode;   // block engine has no osmotic sync
+	if((*netflags)["blockmode"] && !blockmode) mod->DiagWrite("Block engine does not support osmotic sync or event mode, using scalar engine\n");
+	if(eventmode && secmode && !secfix) mod->DiagWrite("Event mode steps secretion and stores each ms, only spiking and synthesis are event driven\n");
+
+	// Create Tasks
+	hetsynbin.assign(numneurons, 0);
+	hetratebin.assign(numneurons, 0);
+	neurotasks.resize(numneurons);
 	for(i=0; i<numneurons; i++) {
 		//mod->diagbox->Write(text.Format("Init cell %d\n", i));
-		neurothread[i] = new MagNeuroMod(i, &neurons[i], this); 
-		neurothread[i]->Create();
+		neurotasks[i] = new MagNeuroMod(i, &neurons[i], this); 
+	}
+	coarse = numneurons && neurotasks[0]->hstep != 1;
+	if(blockmode && coarse) {
+		blockmode = false;
+		mod->DiagWrite("Block engine runs 1 ms steps, using scalar engine for hstep above 1\n");
+	}
+
+	// Size probe records and attach probes to their neurons, probed neurons run the scalar engine
+	for(i=0; i<(int)probes.size(); i++) {
+		if(probes[i].neuron < 0 || probes[i].neuron >= numneurons) {
+			mod->DiagWrite(text.Format("Probe %d neuron %d not in network\n", i, probes[i].neuron));
+			continue;
+		}
+		probes[i].RunSize(runtime * 1000);
+		neurotasks[probes[i].neuron]->probes.push_back(&probes[i]);
+		mod->DiagWrite(text.Format("Probe %d neuron %d %s steps %d to %d every %d\n", i, probes[i].neuron,
+			MagProbe::VarName(probes[i].var), probes[i].start, probes[i].stop, probes[i].decimate));
+	}
+	if(coarse && probes.size()) mod->DiagWrite("Probes record 1 ms steps, not recorded with hstep above 1\n");
+	if(coarse && stawin) mod->DiagWrite("Spike triggered averages need 1 ms steps, not recorded with hstep above 1\n");
+
+	if(blockmode) {
+		for(i=0; i<numneurons; i++) {
+			if(neurotasks[i]->probes.size()) continue;
+			if(blocktasks.empty() || blocktasks.back()->numlanes == MAGBLOCK) blocktasks.push_back(new MagNeuroBlock(this));
+			blocktasks.back()->AddLane(neurotasks[i]);
+		}
+		mod->DiagWrite(text.Format("Block engine %d blocks  %d SIMD lanes\n", (int)blocktasks.size(), MAGSIMD));
 	}
 	//if(osmomode) osmothread = new OxyOsmoMod(this);
 	if(plasmamode) plasmathread = new MagPlasmaMod(this);
+	if(inputgen) inputthread = new MagInputMod(this);
 
 	timestart = clock();
+	pool->ResetStats();
 
-	// Run Threads
-	for(i=0; i<numneurons; i++) neurothread[i]->Run(); 
+	// Run Tasks
+	if(blockmode) for(i=0; i<(int)blocktasks.size(); i++) pool->Submit(blocktasks[i]);
+	for(i=0; i<numneurons; i++) if(!blockmode || neurotasks[i]->probes.size()) pool->Submit(neurotasks[i]); 
 	//if(osmomode) osmothread->Run();
 	if(plasmamode) plasmathread->Run();
+	if(inputgen) inputthread->Run();
 
-	// Wait for Thread Completion
-	for(i=0; i<numneurons; i++) {
-		neurothread[i]->Wait(); 
-		//mod->diagbox->Write(text.Format("Cell %d OK\n", i));
-	}
+	// Wait for Task Completion
+	pool->Wait();
+	secfront->Advance(runtime * 1000);     // release the plasma stage from any part filled final buffer
 	//if(osmomode) osmothread->Wait();
 	if(plasmamode) plasmathread->Wait();
+	if(inputgen) inputthread->Wait();
+	if(inputgen) inputcache->Close();
 
 	timerun = clock() - timestart;
 	if(mainwin->diagbox) mod->DiagWrite(text.Format("runtime %d clicks (%f seconds)\n", timerun,((double)timerun)/CLOCKS_PER_SEC));
+	mod->DiagWrite(pool->Stats(numneurons));
+	if(plasmamode) mod->DiagWrite(secfront->Stats("Plasma", "secretion"));
+	if(plasmamode) mod->DiagWrite(secfree->Stats("Neuron", "secretion ring"));
+	if(osmomode) mod->DiagWrite(osmofront->Stats("Neuron", "osmotic pressure"));
+	if(inputgen) mod->DiagWrite(inputfront->Stats("Neuron", "network input"));
+	if(inputgen) mod->DiagWrite(inputfree->Stats("Input", "input ring"));
+
+	// Compare block engine spike trains against the scalar reference
+	if(blockmode && (*netflags)["enginecheck"]) {
+		numcheck = numneurons;
+		if(numcheck > MAGBLOCK) numcheck = MAGBLOCK;
+		EngineCheck(numcheck);
+	}
+
+	// Compare coarse step firing and secretion against 1 ms steps
+	if(coarse && neurotasks[0]->hstep != 1 && (*netflags)["stepcheck"]) {     // unsupported hstep runs 1 ms
+		numcheck = numneurons;
+		if(numcheck > MAGBLOCK) numcheck = MAGBLOCK;
+		StepCheck(numcheck);
+	}
 
-	// Clean up threads
-	for(i=0; i<numneurons; i++) delete neurothread[i]; 
+	// Clean up tasks
+	for(i=0; i<(int)blocktasks.size(); i++) delete blocktasks[i]; 
+	blocktasks.clear();
+	for(i=0; i<numneurons; i++) delete neurotasks[i]; 
+	neurotasks.clear();
 	//if(osmomode) delete osmothread;
 	if(plasmamode) delete plasmathread;
+	if(inputgen) delete inputthread;
 
 	mod->DiagWrite(text.Format("\nRunNet OK\n\n"));
 
-	mod->neurodatabox->NeuroData();
-
-
 	//
 	// Population Analysis
 	//
 
-	//double popfreq = 0;  // Global FR
+	PopAnalysis();
 
-	magpop->PopSum();
+	mod->DiagWrite(text.Format("\n%d neurons   pop freq %.4f\n", numneurons, magpop->popfreq));
+}
 
-	/*for(i=0; i<numneurons; i++) {
-		neurons[i].ratecalc();
-		popfreq += neurons[i].freq;
-	}*/
 
-	//popfreq = popfreq / numneurons;
+// Post-run analysis as pool tasks, started once every neuron task is done, per neuron analysis has already been
+// run by NeuronDone() as each neuron completed. Population sums are reduced in tiles, each over every neuron in order,
+// so results match the serial PopSum(). The selected neuron is analysed for display on this thread meanwhile.
+void MagNetModel::PopAnalysis()
+{
+	int i, numtiles;
+	int steps = runtime, mins = runtime / 60;
+	std::vector<MagPopTask*> tasks;
 
-	
+	if(steps > magpop->maxtime) steps = magpop->maxtime;
 
-	if((*netflags)["netanalysis"]) {
+	magpop->PopReset();
 
-		// 'netspikes' is a SpikeDat used to store population summed/mean neuron analysis 
-		// 'netneuron' is a SpikeDat used for temporary individual neuron analysis
-	
-		// Population spike rate, histogram, and hazard in different binwidths 
-
-		// Reset population counts
-		for(i=0; i<magpop->maxtime; i++) mod->netdat->srate1s[i] = 0;
-		for(i=0; i<magpop->maxtime/10; i++) mod->netdat->srate10s[i] = 0;
-		for(i=0; i<magpop->maxtime/30; i++) mod->netdat->srate30s[i] = 0;
-		for(i=0; i<magpop->maxtime/300; i++) mod->netdat->srate300s[i] = 0;
-		for(i=0; i<magpop->maxtime/600; i++) mod->netdat->srate600s[i] = 0;
-
-		for(i=0; i<1000000; i++) mod->netdat->srate1[i] = 0;   // 1ms bins for individual spikes
-
-		for(i=0; i<10000; i++) {
-			mod->netdat->hist1[i] = 0;
-			mod->netdat->hist5[i] = 0;
-			mod->netdat->haz1[i] = 0;
-			mod->netdat->haz5[i] = 0;
+	// Tiles of at most POPTILE, enough to share the store sums across the pool
+	numtiles = (steps + POPTILE - 1) / POPTILE;
+	if(numtiles < pool->numworkers) numtiles = pool->numworkers;
+	if(numtiles > steps) numtiles = steps;
+	for(i=0; i<numtiles; i++) tasks.push_back(new MagPopTask(this, POPTASK_STORE, (int)((long long)steps * i / numtiles), (int)((long long)steps * (i + 1) / numtiles)));
+	numtiles = (mins + POPTILE - 1) / POPTILE;
+	for(i=0; i<numtiles; i++) tasks.push_back(new MagPopTask(this, POPTASK_STORELONG, (int)((long long)mins * i / numtiles), (int)((long long)mins * (i + 1) / numtiles)));
+	tasks.push_back(new MagPopTask(this, POPTASK_STA));
+	tasks.push_back(new MagPopTask(this, POPTASK_SECRETION));
+
+	for(i=0; i<(int)tasks.size(); i++) pool->Submit(tasks[i]);
+	if((*netflags)["netanalysis"]) NetStatsSubmit();
+
+	mod->neurodatabox->NeuroData();
+
+	pool->Wait();
+	for(i=0; i<(int)tasks.size(); i++) delete tasks[i];
+	if((*netflags)["netanalysis"]) NetStats();
+
+	magpop->PopFreq();
+	HeteroHist();
+}
+
+
+// Per neuron post-run analysis, run by the neuron's task as it completes, while other neurons are still running
+void MagNetModel::NeuronDone(int neurodex)
+{
+	double synvar, neurate;
+	MagNeuron &neuron = neurons[neurodex];
+
+	neuron.sta.Average();
+	if(neuron.stats.active) neuron.stats.Summary(runtime, neuron.spikecount2);
+
+	// Hetero Pop Analysis    22/2/13
+	synvar = (*(neuron.spikeparams))["synvar"];
+	hetsynbin[neurodex] = (int)(synvar*200)/10;
+	if(hetsynbin[neurodex] < 0) hetsynbin[neurodex] = 0;
+	//neurate = neurons[i].ratemean[0];
+	neurate = neuron.spikecount2 / runtime;
+	//ratedist[(int)(neurate*50)/5]++;
+	hetratebin[neurodex] = (int)(neurate*50)/10;   // 0.2 spikes/s bins
+}
+
+
+// Hetero population synvar and rate histograms from the bins set by NeuronDone()
+void MagNetModel::HeteroHist()
+{
+	int i, numbins;
+	std::vector<int> syndist, ratedist;     // sized to the largest bin, grows with the network's spread
+
+	for(i=0; i<numneurons; i++) {
+		if(hetsynbin[i] >= (int)syndist.size()) syndist.resize(hetsynbin[i] + 1);
+		syndist[hetsynbin[i]]++;
+		if(hetratebin[i] >= (int)ratedist.size()) ratedist.resize(hetratebin[i] + 1);
+		ratedist[hetratebin[i]]++;
+	} 
+
+	numbins = syndist.size();
+	if(numbins < (int)ratedist.size()) numbins = ratedist.size();
+	if(numbins < 1000) numbins = 1000;
+	syndist.resize(numbins);
+	ratedist.resize(numbins);
+	for(i=0; i<2; i++) {
+		mod->datahist[i].setsize(numbins, true);
+		mod->datahistx[i].setsize(numbins, true);
+	}
+
+	for(i=0; i<numbins; i++) {
+		mod->datahistx[0][i] = i * 0.05;
+		mod->datahist[0][i] = syndist[i];
+		//mod->datahist[0][i] = 100;
+		mod->datahistx[1][i] = i * 0.2;
+		mod->datahist[1][i] = ratedist[i];
+	}
+}
+
+
+MagPopTask::MagPopTask(MagNetModel *model, int taskstage, int taskstart, int taskstop)
+{
+	netmod = model;
+	stage = taskstage;
+	start = taskstart;
+	stop = taskstop;
+}
+
+
+void MagPopTask::RunTask()
+{
+	MagPop *magpop = netmod->magpop;
+
+	switch(stage) {
+		case POPTASK_STORE: magpop->PopSumSteps(start, stop); break;
+		case POPTASK_STORELONG: magpop->PopSumMins(start, stop); break;
+		case POPTASK_STA: magpop->STASum(); break;
+		case POPTASK_SECRETION: netmod->SecretionAnalysis(); break;
+	}
+}
+
+
+// Submit the netanalysis parts, see NetStats()
+void MagNetModel::NetStatsSubmit()
+{
+	int p, numparts;
+
+	numparts = pool->numworkers;
+	if(numparts > numneurons) numparts = numneurons;
+	if(numparts < 1) numparts = 1;
+	statsparts.clear();
+	for(p=0; p<numparts; p++) {
+		statsparts.push_back(new MagNetStats(this, p, numparts));
+		pool->Submit(statsparts[p]);
+	}
+}
+
+
+// Population spike rate, histogram, and hazard in different binwidths, into 'netdat'
+// Sums the neurons' MagSpikeStats bins, filled during the run, in place of neurocalc() on each neuron, parts run
+// on the pool from NetStatsSubmit() and are merged here once complete.
+// Rates are population means, histograms and hazards are sums over neurons. Pop freq stays as set by PopFreq().
+void MagNetModel::NetStats()
+{
+	int i, p, step, bin;
+	int numparts = statsparts.size();
+	int maxtime = magpop->maxtime;
+	std::vector<MagNetStats*> &parts = statsparts;
+	SpikeDat *netdat = mod->netdat;
+
+	for(i=0; i<maxtime; i++) netdat->srate1s[i] = 0;
+	for(i=0; i<maxtime/10; i++) netdat->srate10s[i] = 0;
+	for(i=0; i<maxtime/30; i++) netdat->srate30s[i] = 0;
+	for(i=0; i<maxtime/300; i++) netdat->srate300s[i] = 0;
+	for(i=0; i<maxtime/600; i++) netdat->srate600s[i] = 0;
+	for(i=0; i<ISIBINS; i++) {
+		netdat->hist1[i] = 0;
+		netdat->hist5[i] = 0;
+		netdat->haz1[i] = 0;
+		netdat->haz5[i] = 0;
+	}
+
+	// Merge in part order, so sums do not depend on which worker ran a part
+	for(p=0; p<numparts; p++) {
+		for(i=0; i<ISIBINS; i++) {
+			netdat->hist1[i] += parts[p]->hist1[i];
+			netdat->hist5[i] += parts[p]->hist5[i];
+			netdat->haz1[i] += parts[p]->haz1[i];
+			netdat->haz5[i] += parts[p]->haz5[i];
 		}
+		for(step=0; step<maxtime && step<(int)parts[p]->rate1s.size(); step++) netdat->srate1s[step] += parts[p]->rate1s[step];
+		delete parts[p];
+	}
+	parts.clear();
+
+	// Wider bins from the 1s sums, then convert sums to means
+	for(step=0; step<maxtime; step++) {
+		bin = step / 10;
+		if(bin < maxtime/10) netdat->srate10s[bin] += netdat->srate1s[step];
+		bin = step / 30;
+		if(bin < maxtime/30) netdat->srate30s[bin] += netdat->srate1s[step];
+		bin = step / 300;
+		if(bin < maxtime/300) netdat->srate300s[bin] += netdat->srate1s[step];
+		bin = step / 600;
+		if(bin < maxtime/600) netdat->srate600s[bin] += netdat->srate1s[step];
+	}
+	for(step=0; step<maxtime; step++) netdat->srate1s[step] = netdat->srate1s[step] / numneurons;  // 1s bins
+	for(step=0; step<maxtime/10; step++) netdat->srate10s[step] = netdat->srate10s[step] / numneurons;  // 10s bins
+	for(step=0; step<maxtime/30; step++) netdat->srate30s[step] = netdat->srate30s[step] / numneurons;  // 30s bins
+	for(step=0; step<maxtime/300; step++) netdat->srate300s[step] = netdat->srate300s[step] / numneurons;  // 300s bins
+	for(step=0; step<maxtime/600; step++) netdat->srate600s[step] = netdat->srate600s[step] / numneurons;  // 600s bins
+}
 
-		magpop->popfreq = 0;
 
-		// Analyse and sum each neuron
-		for(i=0; i<numneurons; i++) {
-			mod->netneuron->neurocalc(&(neurons[i]));
-			magpop->popfreq += mod->netneuron->freq;
-
-			for(step=0; step<magpop->maxtime; step++) mod->netdat->srate1s[step] += mod->netneuron->srate1s[step];  // 1s bins
-			for(step=0; step<magpop->maxtime/10; step++) mod->netdat->srate10s[step] += mod->netneuron->srate10s[step];  // 10s bins
-			for(step=0; step<magpop->maxtime/30; step++) mod->netdat->srate30s[step] += mod->netneuron->srate30s[step];  // 30s bins
-			for(step=0; step<magpop->maxtime/300; step++) mod->netdat->srate300s[step] += mod->netneuron->srate300s[step];  // 300s bins
-			for(step=0; step<magpop->maxtime/600; step++) mod->netdat->srate600s[step] += mod->netneuron->srate600s[step];  // 600s bins
-
-			for(step=0; step<1000000; step++) mod->netdat->srate1[step] += mod->netneuron->srate1[step];  // 1 ms bins
-
-			for(step=0; step<10000; step++) {
-				mod->netdat->hist1[step] += mod->netneuron->hist1[step];
-				mod->netdat->hist5[step] += mod->netneuron->hist5[step];
-				mod->netdat->haz1[step] += mod->netneuron->haz1[step];
-				mod->netdat->haz5[step] += mod->netneuron->haz5[step];
-			}
+MagNetStats::MagNetStats(MagNetModel *model, int p, int n)
+{
+	netmod = model;
+	part = p;
+	numparts = n;
+}
+
+
+// Sum the part's neurons, hazard per neuron as in neurocalc(), bin count over ISIs not yet ended
+// The part's range of 1 ms rate bins is filled from recorded spike times, O(spikes) not O(neurons x bins)
+void MagNetStats::RunTask()
+{
+	int i, b, remain;
+	int numneurons = netmod->numneurons;
+	int nstart = (int)((long long)numneurons * part / numparts);
+	int nstop = (int)((long long)numneurons * (part + 1) / numparts);
+	int tstart = (int)(1000000LL * part / numparts);
+	int tstop = (int)(1000000LL * (part + 1) / numparts);
+	std::vector<int> nhist5;
+	std::vector<double>::iterator spike, last;
+	datdouble &srate1 = netmod->mod->netdat->srate1;
+
+	hist1.assign(ISIBINS, 0);
+	hist5.assign(ISIBINS, 0);
+	haz1.assign(ISIBINS, 0);
+	haz5.assign(ISIBINS, 0);
+	rate1s.assign(netmod->runtime + 1, 0);
+
+	for(i=nstart; i<nstop; i++) {
+		MagSpikeStats &stats = netmod->neurons[i].stats;
+		for(b=0; b<(int)stats.rate1s.size() && b<(int)rate1s.size(); b++) rate1s[b] += stats.rate1s[b];
+
+		for(b=0; b<(int)stats.hist1.size(); b++) hist1[b] += stats.hist1[b];
+		remain = stats.isicount;
+		for(b=0; b<(int)stats.hist1.size() && remain > 0; b++) {
+			haz1[b] += (double)stats.hist1[b] / remain;
+			remain -= stats.hist1[b];
 		}
 
-		// Convert sums to means
-		for(step=0; step<magpop->maxtime; step++) mod->netdat->srate1s[step] = mod->netdat->srate1s[step] / numneurons;  // 1s bins
-		for(step=0; step<magpop->maxtime/10; step++) mod->netdat->srate10s[step] = mod->netdat->srate10s[step] / numneurons;  // 10s bins
-		for(step=0; step<magpop->maxtime/30; step++) mod->netdat->srate30s[step] = mod->netdat->srate30s[step] / numneurons;  // 30s bins
-		for(step=0; step<magpop->maxtime/300; step++) mod->netdat->srate300s[step] = mod->netdat->srate300s[step] / numneurons;  // 300s bins
-		for(step=0; step<magpop->maxtime/600; step++) mod->netdat->srate600s[step] = mod->netdat->srate600s[step] / numneurons;  // 600s bins
+		stats.Hist5(nhist5);
+		for(b=0; b<ISIBINS; b++) hist5[b] += nhist5[b];
+		remain = stats.isicount;
+		for(b=0; b<ISIBINS && remain > 0; b++) {
+			haz5[b] += (double)nhist5[b] / remain;
+			remain -= nhist5[b];
+		}
+	}
 
-		magpop->popfreq = magpop->popfreq / numneurons;
+	// 1 ms bins for individual spikes
+	for(i=tstart; i<tstop; i++) srate1[i] = 0;
+	for(i=0; i<numneurons; i++) {
+		MagNeuron &neuron = netmod->neurons[i];
+		last = neuron.times.begin() + neuron.spikecount;
+		spike = std::lower_bound(neuron.times.begin(), last, (double)tstart);
+		for(; spike != last && *spike < tstop; spike++) srate1[(int)*spike]++;
 	}
+}
 
-	mod->DiagWrite(text.Format("\n%d neurons   pop freq %.4f\n", numneurons, magpop->popfreq));
+
+// Record 'var' of 'neuron' every 'decimate' steps from step 'start' to 'stop', to 'rec' or the probe's own data
+// Probes are cleared by Initialise(), and are sized and run by each following RunNet()
+MagProbe *MagNetModel::AddProbe(int neuron, int var, int start, int stop, int decimate, datdouble *rec)
+{
+	probes.emplace_back(neuron, var, start, stop, decimate, rec);
+	return &probes.back();
+}
+
+
+void MagNetModel::ClearProbes()
+{
+	probes.clear();
+}
+
+
+// Reset the input ring for the run, the input stage fills inputwindows windows covering steps 1 to runtime * 1000
+void MagNetModel::InputReset()
+{
+	int i;
+
+	inputwindows = (runtime * 1000 + inputwin - 1) / inputwin;
+
+	delete [] inputcount;
+	inputcount = new std::atomic<int>[inputring];
+	for(i=0; i<inputring; i++) inputcount[i] = 0;
+
+	// Event list ring, lists keep their capacity across runs
+	Einputevents.resize(inputring * inputcells);
+	Iinputevents.resize(inputring * inputcells);
+
+	if(inputcachemode) InputCacheOpen();
+
+	inputfront->Reset(0);
+	inputfree->Reset(0);
+}
+
+
+// Count 'count' neurons finished with input 'window', the last to finish frees its ring window for the input stage
+// Each neuron releases windows in order, so windows complete in order
+void MagNetModel::InputRelease(int window, int count)
+{
+	int ring = window % inputring;
+
+	if(inputcount[ring].fetch_add(count) + count == numneurons) {
+		inputcount[ring] = 0;
+		inputfree->Advance((window + 1) * inputwin);     // wakes the input stage
+	}
+}
+
+
+// Merge the PSP events of 'neuron's input cells into per step counts for steps tstart to tstop, within one second
+// Each cell's events are in step order, so each list is searched once for tstart and read to tstop
+// Events come from the ring, or in place from the mapped input cache
+void MagNetModel::InputFill(int neuron, int tstart, int tstop, unsigned char *countE, unsigned char *countI)
+{
+	int c;
+	int ringcell = ((tstart - 1) / inputwin % inputring) * inputcells;
+	bool cached = inputcache->mapped;
+	const int *first, *last, *e;
+
+	memset(countE, 0, tstop - tstart + 1);
+	memset(countI, 0, tstop - tstart + 1);
+
+	for(c=Einputstart[neuron]; c<Einputstart[neuron + 1]; c++) {
+		if(cached) inputcache->Events(tstart, 0, Einputcells[c], first, last);
+		else {
+			first = Einputevents[ringcell + Einputcells[c]].data();
+			last = first + Einputevents[ringcell + Einputcells[c]].size();
+		}
+		for(e=std::lower_bound(first, last, tstart); e != last && *e <= tstop; e++) countE[*e - tstart]++;
+	}
+	for(c=Iinputstart[neuron]; c<Iinputstart[neuron + 1]; c++) {
+		if(cached) inputcache->Events(tstart, 1, Iinputcells[c], first, last);
+		else {
+			first = Iinputevents[ringcell + Iinputcells[c]].data();
+			last = first + Iinputevents[ringcell + Iinputcells[c]].size();
+		}
+		for(e=std::lower_bound(first, last, tstart); e != last && *e <= tstop; e++) countI[*e - tstart]++;
+	}
+}
+
+
+// Map cached input for this run's generation parameters and seed, or start writing it
+// Input does not depend on inputwin or inputthreads, so these are left out of the key
+void MagNetModel::InputCacheOpen()
+{
+	wxString key, text;
+
+	key = text.Format("inputcells %d neurosyn %.17g netinput %.17g netIratio %.17g runtime %d modseed %lu", inputcells, 
+		(*netparams)["neurosyn"], (*netparams)["netinput"], (*netparams)["netIratio"], runtime, (unsigned long)(*netparams)["modseed"]);
+	if(prototype == ramp) key += text.Format(" ramp %d %d %.17g %.17g %.17g %.17g", rampstart[0], rampstop[0], 
+		rampbase[0], rampinit[0], rampstep[0], rampafter[0]);
+
+	inputcache->SetKey(key, mod->GetPath() + "/InputCache", (*netparams)["inputcachemb"] * 1e6);
+	if(inputcache->Open(inputcells)) mod->DiagWrite("Input cache hit, " + inputcache->FileName() + "\n");
+	else if(inputcache->Begin(inputcells, inputwin, inputwindows)) mod->DiagWrite("Input cache miss, writing " + inputcache->FileName() + "\n");
+}
+
+
+// Size the secretion ring and partial sums for the run, secring epochs of buffrate entries per run slot
+void MagNetModel::SecReset()
+{
+	int i, size;
+
+	numepochs = 0;
+	if(buffrate) numepochs = runtime * 1000 / buffrate;
+
+	delete [] epochcount;
+	epochcount = new std::atomic<int>[secring];
+	for(i=0; i<secring; i++) epochcount[i] = 0;
+	epochdone.assign(secring, false);
+	epochfront = 0;
+
+	size = secring * buffrate;
+	secbuff.assign(size, 0);
+	if(secexact) {
+		secsum.assign(pool->numworkers * size, MagSecSum());
+		secpart.clear();
+	}
+	else {
+		secpart.assign(pool->numworkers * size, 0);
+		secsum.clear();
+	}
+	secfront->Reset(0);
+	secfree->Reset(0);
+}
+
+
+// Backpressure, park 'task' at 'step', the start of a block, if it starts an epoch whose ring epoch the plasma
+// stage has not yet consumed, the epoch secring back. Outside the pool population secretion is not collected.
+bool MagNetModel::SecPark(MagNetTask *task, int step)
+{
+	int epoch;
+
+	if(!task->worker || !buffrate || (step - 1) % buffrate) return false;
+	epoch = (step - 1) / buffrate;
+	if(epoch < secring || epoch >= numepochs) return false;
+	return task->Park(secfree, (epoch - secring + 1) * buffrate);
+}
+
+
+// Add a secretion buffer of 'size' steps, ending at 'step', to the population sum
+// In the pool each running task sums into its run slot's block for the epoch, 'count' is the number of neurons
+// in the buffer that complete the epoch, and the flush that completes the epoch reduces it. A task parking within
+// an epoch flushes its part filled buffer with count 0. The buffer epoch must be a multiple of plasma_hstep.
+// With secexact the blocks are fixed point, so the reduced sum is the same whichever worker ran each part.
+void MagNetModel::SecFlush(MagNetWorker *worker, double *secXbuffer, int size, int step, int plasma_hstep, int count)
+{
+	int i, epoch, ring, offset;
+
+	// Outside the pool, engine checks and benchmarks, population secretion is not collected
+	if(!worker || !buffrate || size <= 0) return;
+
+	epoch = (step - 1) / buffrate;
+	if(epoch >= numepochs) return;     // part epoch at the run end, not consumed
+	ring = epoch % secring;
+
+	offset = (worker->slot * secring + ring) * buffrate;
+	step = (step - size) % buffrate;     // buffer start within the epoch
+	if(secexact) for(i=0; i<size; i++) secsum[offset + (step + i) / plasma_hstep] += secXbuffer[i];
+	else for(i=0; i<size; i++) secpart[offset + (step + i) / plasma_hstep] += secXbuffer[i];
+
+	if(count && epochcount[ring].fetch_add(count) + count == numneurons) SecReduce(epoch, plasma_hstep);
+}
+
+
+// Decay powers 0 to 'recint' of each factor, built once per run for each set of factors
+const double *MagNetModel::EventDecay(const std::vector<double> &factors, int recint)
+{
+	int i, n;
+	std::vector<double> key = factors;
+	std::vector<double> *decay;
+
+	key.push_back(recint);
+
+	eventmute.Lock();
+	decay = &eventdecay[key];
+	if(decay->empty()) {
+		decay->resize(factors.size() * (recint + 1));
+		for(i=0; i<(int)factors.size(); i++) {
+			(*decay)[i * (recint + 1)] = 1;
+			if(recint) (*decay)[i * (recint + 1) + 1] = factors[i];
+			for(n=2; n<=recint; n++) (*decay)[i * (recint + 1) + n] = pow(factors[i], n);
+		}
+	}
+	eventmute.Unlock();
+	return decay->data();
+}
+
+
+// Pairwise tree sum of 'numblocks' blocks, 'stride' apart, into the first block
+template <class T> static void SecTree(T *part, int numblocks, int stride, int size)
+{
+	int i, w, span;
+
+	for(span=1; span<numblocks; span*=2)
+		for(w=0; w+span<numblocks; w+=2*span)
+			for(i=0; i<size; i++) part[w*stride + i] += part[(w+span)*stride + i];
+}
+
+
+// Combine the run slot blocks for a completed epoch into the ring and clear them for reuse, then move the
+// plasma frontier over any run of reduced epochs, epochs can complete out of order across threads
+void MagNetModel::SecReduce(int epoch, int plasma_hstep)
+{
+	int i, w, size, ring, stride;
+	int numslots = pool->numworkers;
+
+	size = buffrate / plasma_hstep;
+	ring = epoch % secring;
+	stride = secring * buffrate;
+
+	if(secexact) {
+		MagSecSum *part = &secsum[ring * buffrate];
+		SecTree(part, numslots, stride, size);
+		for(i=0; i<size; i++) secbuff[ring * buffrate + i] = part[i].Value();
+		for(w=0; w<numslots; w++)
+			for(i=0; i<size; i++) part[w*stride + i] = MagSecSum();
+	}
+	else {
+		double *part = &secpart[ring * buffrate];
+		SecTree(part, numslots, stride, size);
+		for(i=0; i<size; i++) secbuff[ring * buffrate + i] = part[i];
+		for(w=0; w<numslots; w++)
+			for(i=0; i<size; i++) part[w*stride + i] = 0;
+	}
+	epochcount[ring] = 0;
+
+	secmute->Lock();
+	epochdone[ring] = true;
+	while(epochfront < numepochs && epochdone[epochfront % secring]) {
+		epochdone[epochfront % secring] = false;
+		epochfront++;
+	}
+	secfront->Advance(epochfront * buffrate);     // wakes the plasma stage
+	secmute->Unlock();
+}
+
+
+// Rerun the first 'numcheck' neurons with the scalar engine and compare against the block engine spike trains
+// Reference tasks are constructed from the same parameters as the block run, so the random streams match
+// Population secretion has already been consumed by the plasma model, the rerun only overwrites neuron records
+void MagNetModel::EngineCheck(int numcheck)
+{
+	int i, s;
+	int blockcount, scalarcount, matched;
+	wxString text;
+	std::vector<double> blocktimes;
+	MagNeuroMod *reftask;
+
+	// Network input is only held in windows during the run, a rerun would have no input to read
+	if((*netflags)["inputgen"]) {
+		mod->DiagWrite("Engine check not run with input gen, network input windows are released during the run\n");
+		return;
+	}
+
+	mod->DiagWrite(text.Format("Engine check, block vs scalar, %d neurons\n", numcheck));
+
+	for(i=0; i<numcheck; i++) {
+		blockcount = neurons[i].spikecount;
+		blocktimes.resize(blockcount);
+		for(s=0; s<blockcount; s++) blocktimes[s] = neurons[i].times[s];
+
+		// restore initial stores, overwritten at the end of the block run
+		reftask = new MagNeuroMod(i, &neurons[i], this);
+		reftask->mRNAinit = neurotasks[i]->mRNAinit;
+		reftask->Rinit = neurotasks[i]->Rinit;
+		reftask->neuromod();
+		delete reftask;
+
+		scalarcount = neurons[i].spikecount;
+		for(matched=0; matched<blockcount && matched<scalarcount; matched++)
+			if(blocktimes[matched] != neurons[i].times[matched]) break;
+
+		if(matched == blockcount && matched == scalarcount) 
+			mod->DiagWrite(text.Format("Neuron %d  %d spikes identical\n", i, blockcount));
+		else {
+			s = matched;
+			mod->DiagWrite(text.Format("Neuron %d  block %d spikes  scalar %d spikes  diverge at spike %d  time %.0f ms\n", 
+				i, blockcount, scalarcount, s, s < scalarcount ? neurons[i].times[s] : blocktimes[s]));
+		}
+	}
+}
+
+
+// Accuracy of coarse 'hstep' integration, rerun the first 'numcheck' neurons with 1 ms steps and compare
+// firing rate, ISI histogram (5 ms bins to 1 s, total variation distance), and secretion output
+// The coarse run is repeated after each reference so neuron records and population secretion are left as run
+void MagNetModel::StepCheck(int numcheck)
+{
+	int i, s, bin;
+	int coarsecount, refcount, numbins;
+	double hstep, rate, refrate, isidiff, sec, refsec;
+	double meanrate, meanisi, meansec;
+	double mRNAinit, Rinit;
+	wxString text;
+	std::vector<double> coarsehist, refhist;
+	MagNeuroMod *reftask;
+
+	hstep = neurotasks[0]->hstep;
+	numbins = 200;
+	coarsehist.resize(numbins);
+	refhist.resize(numbins);
+
+	mod->DiagWrite(text.Format("Step check, hstep %.0f ms vs 1 ms, %d neurons\n", hstep, numcheck));
+
+	meanrate = 0;
+	meanisi = 0;
+	meansec = 0;
+
+	for(i=0; i<numcheck; i++) {
+		coarsecount = neurons[i].spikecount;
+		for(bin=0; bin<numbins; bin++) coarsehist[bin] = 0;
+		for(s=1; s<coarsecount; s++) {
+			bin = (int)((neurons[i].times[s] - neurons[i].times[s-1]) / 5);
+			if(bin < numbins) coarsehist[bin]++;
+		}
+		rate = (double)neurons[i].spikecount2 / runtime;
+		sec = 0;
+		for(s=0; s<runtime; s++) sec += neurons[i].Secretion[s];
+
+		// restore initial stores, overwritten at the end of the coarse run
+		mRNAinit = neurotasks[i]->mRNAinit;
+		Rinit = neurotasks[i]->Rinit;
+		reftask = new MagNeuroMod(i, &neurons[i], this);
+		reftask->mRNAinit = mRNAinit;
+		reftask->Rinit = Rinit;
+		reftask->hstep = 1;
+		reftask->shstep = reftask->hstep / 1000;
+		reftask->syn_hstep = reftask->shstep / 3600;
+		reftask->neuromod();
+		delete reftask;
+
+		refcount = neurons[i].spikecount;
+		for(bin=0; bin<numbins; bin++) refhist[bin] = 0;
+		for(s=1; s<refcount; s++) {
+			bin = (int)((neurons[i].times[s] - neurons[i].times[s-1]) / 5);
+			if(bin < numbins) refhist[bin]++;
+		}
+		refrate = (double)neurons[i].spikecount2 / runtime;
+		refsec = 0;
+		for(s=0; s<runtime; s++) refsec += neurons[i].Secretion[s];
+
+		isidiff = 0;
+		if(coarsecount > 1 && refcount > 1)
+			for(bin=0; bin<numbins; bin++) isidiff += fabs(coarsehist[bin] / (coarsecount - 1) - refhist[bin] / (refcount - 1));
+		isidiff = isidiff / 2;
+
+		mod->DiagWrite(text.Format("Neuron %d  rate %.3f / %.3f Hz  ISI hist diff %.4f  secretion %.4g / %.4g\n", 
+			i, rate, refrate, isidiff, sec, refsec));
+
+		if(refrate > 0) meanrate += fabs(rate - refrate) / refrate;
+		meanisi += isidiff;
+		if(refsec > 0) meansec += fabs(sec - refsec) / refsec;
+
+		// rerun coarse to restore records
+		reftask = new MagNeuroMod(i, &neurons[i], this);
+		reftask->mRNAinit = mRNAinit;
+		reftask->Rinit = Rinit;
+		reftask->coarsemod();
+		delete reftask;
+	}
+
+	mod->DiagWrite(text.Format("Step check mean error, rate %.2f%%  ISI hist diff %.4f  secretion %.2f%%\n", 
+		100 * meanrate / numcheck, meanisi / numcheck, 100 * meansec / numcheck));
+}
+
+
+// Microbenchmark, steps/sec for neuron 0 in each specialised neuromod() variant against the generic loop
+// running the same configuration. Pre-generated input variants only run if input has been generated.
+// Neuron 0 records are overwritten by the network run that follows.
+void MagNetModel::ModeBench()
+{
+	int mode;
+	int benchsteps = 1000000;
+	int genspikes, specspikes;
+	double gentime, spectime;
+	double mRNAinit, Rinit, neuroinit, storeinit;
+	clock_t timestart;
+	wxString text, modetext;
+	MagNeuroMod *benchtask;
+
+	if(benchsteps > runtime * 1000) benchsteps = runtime * 1000;
+
+	// store initial values, written back at the end of each run
+	mRNAinit = (*neurons[0].synthparams)["mRNAinit"];
+	Rinit = (*neurons[0].secparams)["Rinit"];
+	neuroinit = neurons[0].mRNAinit;
+	storeinit = neurons[0].storeinit;
+
+	benchtask = new MagNeuroMod(0, &neurons[0], this);
+	benchtask->modsteps = benchsteps;
+
+	mod->DiagWrite(text.Format("Mode bench, neuron 0, %d steps, current mode %d\n", benchsteps, benchtask->NeuroMode()));
+
+	for(mode=0; mode<MAGMODE_GENERIC; mode++) {
+		if(mode & MAGMODE_PLASMA && !(mode & MAGMODE_SEC)) continue;
+		if(mode & (MAGMODE_KL | MAGMODE_INPUTGEN | MAGMODE_RAMP | MAGMODE_RAMPCURVE) && !(mode & MAGMODE_SPIKE)) continue;
+		if(mode & MAGMODE_INPUTGEN) continue;     // network input only exists in windows during the run
+		if(mode & MAGMODE_PROBE) continue;        // probes are attached to neuron tasks by RunNet()
+		if(mode & MAGMODE_RAMP && mode & MAGMODE_RAMPCURVE) continue;
+
+		timestart = clock();
+		benchtask->neuromod(mode | MAGMODE_GENERIC);
+		gentime = (double)(clock() - timestart) / CLOCKS_PER_SEC;
+		genspikes = neurons[0].spikecount2;
+
+		timestart = clock();
+		benchtask->neuromod(mode);
+		spectime = (double)(clock() - timestart) / CLOCKS_PER_SEC;
+		specspikes = neurons[0].spikecount2;
+
+		modetext = "";
+		if(mode & MAGMODE_SPIKE) modetext += " spike";
+		if(mode & MAGMODE_SEC) modetext += " sec";
+		if(mode & MAGMODE_PLASMA) modetext += " plasma";
+		if(mode & MAGMODE_KL) modetext += " KL";
+		if(mode & MAGMODE_INPUTGEN) modetext += " inputgen";
+		if(mode & MAGMODE_RAMP) modetext += " ramp";
+		if(mode & MAGMODE_RAMPCURVE) modetext += " rampcurve";
+		if(!mode) modetext = " synth only";
+
+		mod->DiagWrite(text.Format("mode %2d%s  generic %.0f steps/s  specialised %.0f steps/s  x%.2f%s\n", mode, modetext, 
+			benchsteps / gentime, benchsteps / spectime, gentime / spectime, genspikes == specspikes ? "" : "  SPIKE COUNT DIFFERS"));
+	}
+
+	delete benchtask;
+
+	(*neurons[0].synthparams)["mRNAinit"] = mRNAinit;
+	(*neurons[0].secparams)["Rinit"] = Rinit;
+	neurons[0].mRNAinit = neuroinit;
+	neurons[0].storeinit = storeinit;
+}
+
+
+// Peak resident memory of the process in bytes, for ScaleBench()
+static double PeakMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return (double)counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF, &usage)) return 0;
+#ifdef __APPLE__
+	return (double)usage.ru_maxrss;
+#else
+	return (double)usage.ru_maxrss * 1024;     // KB on Linux
+#endif
+#endif
+}
+
+
+// Run time and record memory per neuron for 100, 1000, 10000 ... neurons up to numneurons
+// Each size runs a short run through the pool with the run's plasma and input stages, peak memory is for the process
+void MagNetModel::ScaleBench()
+{
+	int i, size, netsize, nettime, threads;
+	int benchsteps = 1000;
+	bool inputgen, cachemode;
+	double benchtime, recbytes, inputbytes;
+	wxStopWatch benchwatch;
+	wxString text;
+	std::vector<MagNeuroMod*> benchtasks;
+	std::vector<double> mRNAinit, Rinit, neuroinit, storeinit;
+
+	if(osmomode) {
+		mod->DiagWrite("Scale bench not run, neurons wait on the osmotic stage with osmotic sync\n");
+		return;
+	}
+	if(benchsteps > runtime * 1000) benchsteps = runtime * 1000;
+	inputgen = (*netflags)["inputgen"];
+
+	// store initial values, written back at the end of each run
+	mRNAinit.resize(numneurons);
+	Rinit.resize(numneurons);
+	neuroinit.resize(numneurons);
+	storeinit.resize(numneurons);
+	for(i=0; i<numneurons; i++) {
+		mRNAinit[i] = (*neurons[i].synthparams)["mRNAinit"];
+		Rinit[i] = (*neurons[i].secparams)["Rinit"];
+		neuroinit[i] = neurons[i].mRNAinit;
+		storeinit[i] = neurons[i].storeinit;
+	}
+
+	inputbytes = 0;
+	if(inputgen && numneurons) inputbytes = (double)(Einputcells.size() + Iinputcells.size()) * sizeof(int) / numneurons;     // CSR connections, event lists are shared
+
+	// Bench runs are short runs of the first 'size' neurons through the pool and the plasma and input stages,
+	// the input cache is left for the full run
+	netsize = numneurons;
+	nettime = runtime;
+	cachemode = inputcachemode;
+	runtime = benchsteps / 1000;
+	inputcachemode = false;
+	hetsynbin.assign(netsize, 0);
+	hetratebin.assign(netsize, 0);
+
+	threads = pool->numworkers;
+	if(plasmamode) threads++;
+	if(inputgen) threads += inputthreads;
+	mod->DiagWrite(text.Format("Scale bench, %d steps per neuron, %d threads (%d pool workers), neuron object %d bytes\n", 
+		runtime * 1000, threads, pool->numworkers, (int)sizeof(MagNeuron)));
+
+	for(size=100; ; size*=10) {
+		if(size > netsize) size = netsize;
+		numneurons = size;
+
+		SecReset();
+		osmofront->Reset(0);
+		if(inputgen) InputReset();
+		eventdecay.clear();
+
+		benchtasks.resize(size);
+		for(i=0; i<size; i++) benchtasks[i] = new MagNeuroMod(i, &neurons[i], this);
+		if(plasmamode) plasmathread = new MagPlasmaMod(this);
+		if(inputgen) inputthread = new MagInputMod(this);
+
+		benchwatch.Start();
+		for(i=0; i<size; i++) pool->Submit(benchtasks[i]);
+		if(plasmamode) plasmathread->Run();
+		if(inputgen) inputthread->Run();
+		pool->Wait();
+		secfront->Advance(runtime * 1000);
+		if(plasmamode) plasmathread->Wait();
+		if(inputgen) inputthread->Wait();
+		benchtime = benchwatch.Time() / 1000.0;
+
+		for(i=0; i<size; i++) delete benchtasks[i];
+		if(plasmamode) delete plasmathread;
+		if(inputgen) delete inputthread;
+
+		recbytes = 0;
+		for(i=0; i<size; i++) recbytes += neurons[i].RecBytes();
+
+		mod->DiagWrite(text.Format("%d neurons  %.2f s  %.1f us per neuron s  records %.1f KB per neuron  input %.1f KB per neuron  peak memory %.1f MB\n", size, benchtime, 
+			benchtime * 1e6 / size / runtime, recbytes / size / 1024, inputbytes / 1024, PeakMemory() / (1024 * 1024)));
+
+		if(size == netsize) break;
+	}
+
+	numneurons = netsize;
+	runtime = nettime;
+	inputcachemode = cachemode;
+
+	for(i=0; i<numneurons; i++) {
+		(*neurons[i].synthparams)["mRNAinit"] = mRNAinit[i];
+		(*neurons[i].secparams)["Rinit"] = Rinit[i];
+		neurons[i].mRNAinit = neuroinit[i];
+		neurons[i].storeinit = storeinit[i];
+	}
+}
+
+
+// Throughput of MagRand against HypoRand, and statistical checks of MagRand streams
+// Statistics are reported as z scores, or sqrt(n) D for Kolmogorov-Smirnov, failing above 5 or 1.95
+void MagNetModel::RandBench()
+{
+	int i, k;
+	int numdraws = 10000000;
+	int numtest = 1000000;
+	int buffsize = 1000;
+	double sum, mean, var, stat, x, y, sumxy;
+	double benchtime[7];
+	clock_t timestart;
+	wxString text;
+	bool pass;
+	HypoRand hrng(modseed);
+	MagRand mrng, mrng2;
+	std::vector<double> draws(numtest), draws2(numtest), buff(buffsize);
+	std::vector<int> bins(100);
+
+	mod->DiagWrite(text.Format("Rand bench, %d draws\n", numdraws));
+
+	// Philox4x32-10 known answers, Random123 test vectors for zero and all ones counter and key
+	mrng.seed(0, 0);
+	mrng.Refill();
+	pass = mrng.raw[0] == 0xe169c58d6627e8d5ULL && mrng.raw[1] == 0x9b00dbd8bc57ac4cULL;
+	mrng.seed(0xffffffffffffffffULL, 0xffffffffffffffffULL);
+	mrng.block = 0xfffffffffffffffULL;
+	mrng.Refill();
+	pass = pass && mrng.raw[MAGRANDBLOCK - 2] == 0x41c83b0e408f276dULL && mrng.raw[MAGRANDBLOCK - 1] == 0x6d5451fda20bc7c6ULL;
+	mod->DiagWrite(text.Format("Philox known answers %s\n", pass ? "PASS" : "FAIL"));
+
+	// Throughput, ns per draw
+	mrng.seed(modseed, 0);
+	sum = 0;
+	timestart = clock();
+	for(i=0; i<numdraws; i++) sum += hrng.uniform_open01();
+	benchtime[0] = clock() - timestart;
+	timestart = clock();
+	for(i=0; i<numdraws; i++) sum += -log(1 - hrng.uniform_open01());
+	benchtime[1] = clock() - timestart;
+	timestart = clock();
+	for(i=0; i<numdraws; i++) sum += hrng.normal();
+	benchtime[2] = clock() - timestart;
+	timestart = clock();
+	for(i=0; i<numdraws; i++) sum += mrng.uniform_open01();
+	benchtime[3] = clock() - timestart;
+	timestart = clock();
+	for(i=0; i<numdraws; i++) sum += mrng.exponential();
+	benchtime[4] = clock() - timestart;
+	timestart = clock();
+	for(i=0; i<numdraws; i++) sum += mrng.normal();
+	benchtime[5] = clock() - timestart;
+	timestart = clock();
+	for(i=0; i<numdraws; i+=buffsize) {
+		mrng.Uniform(buff.data(), buffsize);
+		sum += buff[0];
+	}
+	benchtime[6] = clock() - timestart;
+	for(i=0; i<7; i++) benchtime[i] = benchtime[i] / CLOCKS_PER_SEC * 1e9 / numdraws;
+
+	mod->DiagWrite(text.Format("HypoRand  uniform %.2f ns  exponential (log) %.2f ns  normal %.2f ns\n", benchtime[0], benchtime[1], benchtime[2]));
+	mod->DiagWrite(text.Format("MagRand   uniform %.2f ns  exponential %.2f ns  normal %.2f ns  block uniform %.2f ns  (sum %.1f)\n", 
+		benchtime[3], benchtime[4], benchtime[5], benchtime[6], sum));
+
+	// Uniform mean and 100 bin chi-square
+	mrng.seed(modseed, 0);
+	mrng.Uniform(draws.data(), numtest);
+	mean = 0;
+	for(i=0; i<numtest; i++) {
+		mean += draws[i];
+		bins[(int)(draws[i] * 100)]++;
+	}
+	mean /= numtest;
+	stat = 0;
+	for(k=0; k<100; k++) stat += (bins[k] - numtest / 100.0) * (bins[k] - numtest / 100.0) / (numtest / 100.0);
+	RandTest("uniform mean", (mean - 0.5) / sqrt(1.0 / 12 / numtest), 5);
+	RandTest("uniform chi-square 100 bins", (stat - 99) / sqrt(2.0 * 99), 5);
+
+	// Uniform correlation between neighbouring streams
+	mrng2.seed(modseed, 1);
+	mrng2.Uniform(draws2.data(), numtest);
+	sumxy = 0;
+	for(i=0; i<numtest; i++) sumxy += (draws[i] - 0.5) * (draws2[i] - 0.5);
+	RandTest("stream correlation", sumxy / numtest * 12 * sqrt((double)numtest), 5);
+
+	// Exponential mean, variance and Kolmogorov-Smirnov
+	mrng.Exponential(draws.data(), numtest);
+	RandMoments(draws, mean, var);
+	RandTest("exponential mean", (mean - 1) / sqrt(1.0 / numtest), 5);
+	RandTest("exponential variance", (var - 1) / sqrt(8.0 / numtest), 5);
+	std::sort(draws.begin(), draws.end());
+	stat = 0;
+	for(i=0; i<numtest; i++) {
+		x = 1 - exp(-draws[i]);
+		y = fabs(x - (double)i / numtest);
+		if(fabs(x - (double)(i + 1) / numtest) > y) y = fabs(x - (double)(i + 1) / numtest);
+		if(y > stat) stat = y;
+	}
+	RandTest("exponential KS", stat * sqrt((double)numtest), 1.95);
+
+	// Normal mean, variance and Kolmogorov-Smirnov
+	mrng.Normal(draws.data(), numtest);
+	RandMoments(draws, mean, var);
+	RandTest("normal mean", mean / sqrt(1.0 / numtest), 5);
+	RandTest("normal variance", (var - 1) / sqrt(2.0 / numtest), 5);
+	std::sort(draws.begin(), draws.end());
+	stat = 0;
+	for(i=0; i<numtest; i++) {
+		x = 0.5 * erfc(-draws[i] / sqrt(2.0));
+		y = fabs(x - (double)i / numtest);
+		if(fabs(x - (double)(i + 1) / numtest) > y) y = fabs(x - (double)(i + 1) / numtest);
+		if(y > stat) stat = y;
+	}
+	RandTest("normal KS", stat * sqrt((double)numtest), 1.95);
+
+	// Checkpoint, a stream restarted at a saved position continues with the same draws
+	mrng.seed(modseed, 2);
+	for(i=0; i<777; i++) mrng.normal();
+	mrng2.seed(modseed, 2);
+	mrng2.SetPosition(mrng.Position());
+	pass = true;
+	for(i=0; i<1000; i++) if(mrng.normal() != mrng2.normal()) pass = false;
+	mod->DiagWrite(text.Format("skip to position %s\n", pass ? "PASS" : "FAIL"));
+}
+
+
+void MagNetModel::RandTest(wxString name, double stat, double limit)
+{
+	wxString text;
+
+	mod->DiagWrite(name + text.Format("  %.3f  %s\n", stat, fabs(stat) < limit ? "PASS" : "FAIL"));
+}
+
+
+void MagNetModel::RandMoments(std::vector<double> &draws, double &mean, double &var)
+{
+	size_t i;
+
+	mean = 0;
+	for(i=0; i<draws.size(); i++) mean += draws[i];
+	mean /= draws.size();
+	var = 0;
+	for(i=0; i<draws.size(); i++) var += (draws[i] - mean) * (draws[i] - mean);
+	var /= draws.size() - 1;
 }
 
 
@@ -30,6 +30,20 @@ MagNetBox::MagNetBox(MagNetMod *magnetmod, MainFrame *main, const wxString& titl
 	SetModFlag(ID_inputgen, "inputgen", "Input Gen", 0); 
 	SetModFlag(ID_realtime, "realtime", "Real Time", 0); 
 	SetModFlag(ID_analysis, "netanalysis", "Net Analysis", 0); 
+	SetModFlag(ID_blockmode, "blockmode", "SIMD Block Engine", 0); 
+	SetModFlag(ID_enginecheck, "enginecheck", "Engine Check", 0); 
+	SetModFlag(ID_eventmode, "eventmode", "Event Driven", 0);   // jumps quiet spans of the spiking and synthesis models, secretion is still stepped each ms
+	SetModFlag(ID_expinput, "expinput", "Exp Interval PSP", 0); 
+	SetModFlag(ID_modebench, "modebench", "Mode Bench", 0); 
+	SetModFlag(ID_scalebench, "scalebench", "Scale Bench", 0); 
+	SetModFlag(ID_randbench, "randbench", "Rand Bench", 0); 
+	SetModFlag(ID_stepcheck, "stepcheck", "Step Check", 0); 
+	SetModFlag(ID_secexact, "secexact", "Exact Secretion Sum", 1); 
+	SetModFlag(ID_inputcache, "inputcache", "Input Cache", 0); 
+	SetModFlag(ID_probe, "probe", "Probe", 0); 
+	SetModFlag(ID_neurorec, "neurorec", "Neuron 0 Rec", 1); 
+	SetModFlag(ID_staflag, "staflag", "Spike Trig Avg", 0); 
+	SetModFlag(ID_neurocache, "neurocache", "Neuron Cache", 0);   // per neuron ISI and rate bins without Net Analysis, memory grows with run time
 
 
 	// Parameter controls
@@ -44,11 +58,23 @@ MagNetBox::MagNetBox(MagNetMod *magnetmod, MainFrame *main, const wxString& titl
 	paramset.AddCon("osmorate", "Osmo Rate", 100, 1, 0); 
 	paramset.AddCon("osmo_hstep", "Osmo hStep", 1, 1, 0); 
 	paramset.AddCon("buffrate", "Buff Rate", 1000, 1, 0); 
+	paramset.AddCon("secring", "Sec Ring", 4, 1, 0);   // population secretion ring depth in buffers
+	paramset.AddCon("numworkers", "Workers", 0, 1, 0);   // worker pool threads, 0 sets to hardware thread count
 	paramset.AddCon("synvarsd", "SynVar SD", 0, 0.05, 2);
 	paramset.AddCon("inputcells", "inputcells", 200, 1, 0); 
 	paramset.AddCon("neurosyn", "neurosyn", 100, 1, 0);
 	paramset.AddCon("netinput", "Net Input", 100, 10, 2);
 	paramset.AddCon("netIratio", "Net Iratio", 0.5, 0.1, 2);
+	paramset.AddCon("inputwin", "Input Win", 10, 1, 0);   // network input window in s, generated during the run
+	paramset.AddCon("inputring", "Input Ring", 3, 1, 0);   // network input windows held per neuron
+	paramset.AddCon("inputthreads", "Input Threads", 2, 1, 0);   // network input stage threads, input does not depend on the count
+	paramset.AddCon("inputcachemb", "Cache MB", 2000, 100, 0);   // network input cache size limit, least recently used files are evicted
+	paramset.AddCon("probeneuron", "Probe Neuron", 0, 1, 0);
+	paramset.AddCon("probevar", "Probe Var", 0, 1, 0);   // MAGPROBE variable, 0 V, 1 pspsig, 4 Ca, 12 reserve store, see magnetdat.h
+	paramset.AddCon("probestart", "Probe Start", 0, 1, 0);   // probe window in s, stop 0 for the run end
+	paramset.AddCon("probestop", "Probe Stop", 0, 1, 0);
+	paramset.AddCon("probedec", "Probe Dec", 1, 1, 0);   // probe sample interval in ms steps
+	paramset.AddCon("stawin", "STA Win", 100, 10, 0);   // spike triggered average window in ms either side of the spike
 	paramset.AddCon("popscale", "Pop Scale", 1000, 10, 2);
 	paramset.AddCon("disprate", "Disp Rate", 1000, 10, 0);
 	paramset.AddCon("storeinit", "Store Init", 2000000, 100000, 0);
@@ -278,6 +304,7 @@ MagSynthBox::MagSynthBox(MagNetMod *mod, const wxString& title, const wxPoint& p
 	SetModFlag(ID_scalemode, "scalemode", "Synth Scale", 1); 
 	SetModFlag(ID_polymode, "polymode", "Poly(A) mRNA", 1); 
 	SetModFlag(ID_decaymode, "decaymode", "mRNA decay", 0); 
+	SetModFlag(ID_synthmulti, "synthmulti", "Multi-rate Synth", 0); 
 
 	if(panelmode == 1) {
 		paramset.AddCon("mRNAinit", "m_init", 20, 1, 2, labelwidth); 
@@ -292,6 +319,7 @@ MagSynthBox::MagSynthBox(MagNetMod *mod, const wxString& title, const wxPoint& p
 		paramset.AddCon("basalTL", "TL_basal", 1, 0.01, 4, labelwidth); 
 		paramset.AddCon("rateSR", "s_r", 0.01, 0.001, 4, labelwidth); 
 		paramset.AddCon("synscale", "s_scale", 0.0001, 0.00, 7, labelwidth);
+		paramset.AddCon("synthstep", "synth step", 1000, 100, 0, labelwidth);
 
 		paramset.SetMinMax("halflifeVS", 0, 500000);
 	}
@@ -309,6 +337,7 @@ MagSynthBox::MagSynthBox(MagNetMod *mod, const wxString& title, const wxPoint& p
 		paramset.AddCon("basalTL", "basalTL", 1, 0.01, 4, labelwidth); 
 		paramset.AddCon("rateSR", "rateSR", 0.01, 0.001, 4, labelwidth); 
 		paramset.AddCon("synscale", "synscale", 0.0001, 0.00, 7, labelwidth);
+		paramset.AddCon("synthstep", "synthstep", 1000, 100, 0, labelwidth);
 
 		paramset.SetMinMax("halflifeVS", 0, 500000);
 	}
@@ -646,49 +675,73 @@ MagNeuroDataBox::MagNeuroDataBox(MagNetMod *magnetmod, const wxString& title, co
 // Jorge comment - returns calculations for each neuron of the network when we want to see their graphs
 void MagNeuroDataBox::NeuroData()
 {
+	MagNeuron *neuron = &(mod->modneurons[neurodex]);
+	NeuroDat *data;
+	MagSpikeStats &stats = neuron->stats;
 
 	// To show results, numerical and graphically, we need to:
-	//		- send the spiketimes and number of spikes of the neuron we want the spyke statitistic to neurocalc
-	//		- send the secretion and plasma data to single vectors to the graph class (it does not work with arrays of vectors)
-	mod->currmodneuron->neurocalc(&(mod->modneurons[neurodex]));
-	mod->currmodneuron->id = neurodex;
-	//mod->neurons->index = neurodex;    // what is this doing?   25/11/20
+	//		- send the spiketimes and number of spikes of the neuron we want the spyke statitistic to neurocalc,
+	//		  or fill the spike statistics from the neuron's bins, summarised once after the run, kept with "netanalysis" or "neurocache"
+	//		- bind the neuron's record graphs to the neuron's own records, no copies
+	if(mod->neurobox->IsShown()) mod->neuropool->View(neuron);     // NeuroBox mod spike panel
+	if(stats.active) {
+		stats.Fill(mod->currmodneuron, neuron->times, neuron->spikecount, mod->magpop->runtime, mod->magpop->maxtime);
+		mod->currmodneuron->id = neurodex;
+		label->SetLabel(mod->neuropool->view[0].name);
+		PanelLabels(false, neuron->spikecount, stats.freq, stats.meanisi, stats.isisd);
+	}
+	else {
+		data = mod->neuropool->Get(neuron);
+		mod->currmodneuron->neurocalc(data);
+		mod->currmodneuron->id = neurodex;
+		//mod->neurons->index = neurodex;    // what is this doing?   25/11/20
+		PanelData(data);
+	}
 
-	if(mod->burstbox) mod->burstbox->ModDataScan();
+	// Burst analysis only for a shown burst box, and once per neuron and run
+	if(mod->burstbox && mod->burstbox->IsShown() && mod->neuropool->burstneuron != neuron) {
+		mod->burstbox->ModDataScan();
+		mod->neuropool->burstneuron = neuron;
+	}
 
 	// Assigning to the graphbase vector with name "OxSecretion" the data from the position neurodex of the variable OxSecretion of the class array neurons
-	(*mod->graphbase)["Secretion"]->gdatadv = &(mod->modneurons[neurodex].Secretion);  // gdatadv: graph data double vector. 
+	(*mod->graphbase)["Secretion"]->gdatadv = &(neuron->Secretion);  // gdatadv: graph data double vector. 
+	(*mod->graphbase)["stapsp"]->gdatadv = &(neuron->sta.psp);
+	(*mod->graphbase)["staca"]->gdatadv = &(neuron->sta.ca);
+	(*mod->graphbase)["stasec"]->gdatadv = &(neuron->sta.sec);
+	(*mod->graphbase)["storelong"]->gdatadv = &(neuron->storeLong);
+	(*mod->graphbase)["synthstorelong"]->gdatadv = &(neuron->synthstoreLong);
+	(*mod->graphbase)["synthratelong"]->gdatadv = &(neuron->synthrateLong);
+	(*mod->graphbase)["seclong"]->gdatadv = &(neuron->secLong);
+	(*mod->graphbase)["sechour"]->gdatadv = &(neuron->secHour);
+	(*mod->graphbase)["translong"]->gdatadv = &(neuron->transLong);
 	//(*mod->graphbase)["OxyPlasma"]->gdatadv = &(mod->neurons[neurodex].OxyPlasma); 
 
-	mod->magpop->storeLong = mod->modneurons[neurodex].storeLong;
-	mod->magpop->synthstoreLong = mod->modneurons[neurodex].synthstoreLong;
-	mod->magpop->synthrateLong = mod->modneurons[neurodex].synthrateLong;
-	mod->magpop->secLong = mod->modneurons[neurodex].secLong;
-	mod->magpop->secHour = mod->modneurons[neurodex].secHour;
-	mod->magpop->transLong = mod->modneurons[neurodex].transLong;
+	mod->spikebox->CopyParams(neuron->spikeparams);
+	mod->secbox->CopyParams(neuron->secparams);
+	mod->synthbox->CopyParams(neuron->synthparams);
+}
 
-	PanelData(&(mod->modneurons[neurodex]));	
 
-	mod->spikebox->CopyParams(mod->modneurons[neurodex].spikeparams);
-	mod->secbox->CopyParams(mod->modneurons[neurodex].secparams);
-	mod->synthbox->CopyParams(mod->modneurons[neurodex].synthparams);
+void MagNeuroDataBox::PanelData(NeuroDat *data)
+{
+	label->SetLabel(data->name);
+	PanelLabels(data->netflag, data->spikecount, data->freq, data->meanisi, data->isivar);
 }
 
 
-void MagNeuroDataBox::PanelData(NeuroDat *data)
+void MagNeuroDataBox::PanelLabels(bool netflag, int spikecount, double freqval, double meanval, double sdval)
 {
 	wxString snum;
 
-	if(data->netflag) snum = "sum";
+	if(netflag) snum = "sum";
 	else snum = numstring(neurodex, 0);
 	datneuron->SetLabel(snum);
 
-	label->SetLabel(data->name);
-	spikes->SetLabel(snum.Format("%d", data->spikecount));
-	freq->SetLabel(snum.Format("%.2f", data->freq));
-	mean->SetLabel(snum.Format("%.1f", data->meanisi));
-	sd->SetLabel(snum.Format("%.2f", data->isivar));
-
+	spikes->SetLabel(snum.Format("%d", spikecount));
+	freq->SetLabel(snum.Format("%.2f", freqval));
+	mean->SetLabel(snum.Format("%.1f", meanval));
+	sd->SetLabel(snum.Format("%.2f", sdval));
 }
 
 
@@ -136,6 +136,7 @@ public:
 
 	void NeuroData();
 	void PanelData(NeuroDat *data);
+	void PanelLabels(bool netflag, int spikecount, double freqval, double meanval, double sdval);
 	void OnNext(wxSpinEvent& event);
 	void OnPrev(wxSpinEvent& event);
 	void OnEnter(wxCommandEvent& event);
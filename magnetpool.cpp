@@ -0,0 +1,376 @@
+/*
+*  magnetpool.cpp
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*  Persistent worker pool for running neuron tasks, replacing one thread per neuron
+*  Time frontier for synchronising the neuron, plasma, and osmotic stages
+*
+*/
+
+
+#include "magnetmod.h"
+
+
+MagNetWorker::MagNetWorker(MagNetPool *magnetpool, int workerdex)
+	: wxThread(wxTHREAD_JOINABLE)
+{
+	pool = magnetpool;
+	index = workerdex;
+	busytime = 0;
+	taskcount = 0;
+	stealcount = 0;
+	slot = -1;
+}
+
+
+void *MagNetWorker::Entry()
+{
+	MagNetTask *task;
+	wxStopWatch taskwatch;
+
+	// Run tasks until the pool is closed
+	while(true) {
+		task = pool->GetTask(this);
+		if(!task) break;
+
+		taskwatch.Start();
+		task->worker = this;
+		task->RunTask();
+		task->worker = NULL;
+		busytime += taskwatch.Time();
+		taskcount++;
+
+		pool->TaskDone(this, task);
+	}
+	return NULL;
+}
+
+
+MagNetTask *MagNetWorker::Pop()
+{
+	MagNetTask *task = NULL;
+
+	queuemute.Lock();
+	if(!queue.empty()) {
+		task = queue.front();
+		queue.pop_front();
+	}
+	queuemute.Unlock();
+	return task;
+}
+
+
+MagNetTask *MagNetWorker::Steal()
+{
+	MagNetTask *task = NULL;
+
+	queuemute.Lock();
+	if(!queue.empty()) {
+		task = queue.back();
+		queue.pop_back();
+	}
+	queuemute.Unlock();
+	return task;
+}
+
+
+MagNetPool::MagNetPool(int poolsize)
+{
+	int i;
+
+	// Size to hardware if not set
+	numworkers = poolsize;
+	if(numworkers <= 0) numworkers = wxThread::GetCPUCount();
+	if(numworkers <= 0) numworkers = 1;
+
+	workcond = new wxCondition(poolmute);
+	donecond = new wxCondition(poolmute);
+	queued = 0;
+	pending = 0;
+	nextworker = 0;
+	closing = false;
+
+	freeslots.resize(numworkers);
+	for(i=0; i<numworkers; i++) freeslots[i] = numworkers - 1 - i;
+
+	workers.resize(numworkers);
+	for(i=0; i<numworkers; i++) {
+		workers[i] = new MagNetWorker(this, i);
+		workers[i]->Create();
+	}
+	for(i=0; i<numworkers; i++) workers[i]->Run();
+
+	ResetStats();
+}
+
+
+MagNetPool::~MagNetPool()
+{
+	int i;
+
+	poolmute.Lock();
+	closing = true;
+	workcond->Broadcast();
+	poolmute.Unlock();
+
+	for(i=0; i<numworkers; i++) {
+		workers[i]->Wait();
+		delete workers[i];
+	}
+
+	delete workcond;
+	delete donecond;
+}
+
+
+// Queue task round robin across workers, idle workers balance the load by stealing
+void MagNetPool::Submit(MagNetTask *task)
+{
+	MagNetWorker *worker;
+
+	poolmute.Lock();
+	worker = workers[nextworker];
+	nextworker = (nextworker + 1) % numworkers;
+	pending++;
+	queued++;
+
+	worker->queuemute.Lock();
+	worker->queue.push_back(task);
+	worker->queuemute.Unlock();
+
+	workcond->Broadcast();
+	poolmute.Unlock();
+}
+
+
+// Requeue a parked task ahead of queued tasks, it is still counted in pending
+void MagNetPool::Resume(MagNetTask *task)
+{
+	MagNetWorker *worker;
+
+	poolmute.Lock();
+	worker = workers[nextworker];
+	nextworker = (nextworker + 1) % numworkers;
+	queued++;
+
+	worker->queuemute.Lock();
+	worker->queue.push_front(task);
+	worker->queuemute.Unlock();
+
+	workcond->Broadcast();
+	poolmute.Unlock();
+}
+
+
+// Block until every submitted task has completed
+void MagNetPool::Wait()
+{
+	poolmute.Lock();
+	while(pending > 0) donecond->Wait();
+	poolmute.Unlock();
+}
+
+
+// Returns next task for worker, own queue first then steal, NULL when pool is closing
+// A task is claimed with a run slot before it is taken, so running tasks never exceed numworkers
+MagNetTask *MagNetPool::GetTask(MagNetWorker *worker)
+{
+	int i;
+	MagNetTask *task;
+	bool stolen;
+
+	poolmute.Lock();
+	while(!closing && !(queued && freeslots.size())) workcond->Wait();
+	if(closing) {
+		poolmute.Unlock();
+		return NULL;
+	}
+	queued--;
+	worker->slot = freeslots.back();
+	freeslots.pop_back();
+	poolmute.Unlock();
+
+	// the claimed task is in some queue, other claims can move it but never below the count
+	while(true) {
+		stolen = false;
+		task = NULL;
+		task = worker->Pop();
+		for(i=1; !task && i<=numworkers; i++) {
+			task = workers[(worker->index + i) % numworkers]->Steal();
+			stolen = true;
+		}
+		if(task) break;
+	}
+	if(stolen) worker->stealcount++;
+	return task;
+}
+
+
+// Free the worker's run slot, a parked task stays pending and is handed to its frontier
+void MagNetPool::TaskDone(MagNetWorker *worker, MagNetTask *task)
+{
+	MagNetFrontier *front = task->parkfront;
+
+	poolmute.Lock();
+	freeslots.push_back(worker->slot);
+	worker->slot = -1;
+	if(!front) pending--;
+	if(!pending) donecond->Broadcast();
+	workcond->Broadcast();
+	poolmute.Unlock();
+
+	if(front) {
+		task->parkfront = NULL;
+		front->Park(task, task->parktime, this);
+	}
+}
+
+
+void MagNetPool::ResetStats()
+{
+	int i;
+
+	poolmute.Lock();
+	for(i=0; i<numworkers; i++) {
+		workers[i]->busytime = 0;
+		workers[i]->taskcount = 0;
+		workers[i]->stealcount = 0;
+	}
+	poolmute.Unlock();
+	runwatch.Start();
+}
+
+
+// Throughput and per-worker utilisation since ResetStats()
+wxString MagNetPool::Stats(int numtasks)
+{
+	int i;
+	wxString text, stats;
+	double walltime = runwatch.Time();
+
+	if(walltime <= 0) walltime = 1;
+
+	stats = text.Format("Pool %d workers  %d neurons in %.2f s  %.2f neurons/s\n", numworkers, numtasks, walltime / 1000, numtasks * 1000 / walltime);
+	for(i=0; i<numworkers; i++)
+		stats += text.Format("Worker %d  tasks %d  stolen %d  busy %.2f s  utilisation %.1f%%\n",
+			i, workers[i]->taskcount, workers[i]->stealcount, workers[i]->busytime / 1000, 100 * workers[i]->busytime / walltime);
+
+	return stats;
+}
+
+
+MagNetFrontier::MagNetFrontier()
+{
+	frontcond = new wxCondition(frontmute);
+	pool = NULL;
+	Reset(0);
+}
+
+
+MagNetFrontier::~MagNetFrontier()
+{
+	delete frontcond;
+}
+
+
+void MagNetFrontier::Reset(int newtime)
+{
+	frontmute.Lock();
+	time = newtime;
+	waittime = 0;
+	waitcount = 0;
+	parkcount = 0;
+	frontmute.Unlock();
+}
+
+
+// Move the frontier forward, wake waiting stages and requeue parked tasks it has passed, never moves back
+void MagNetFrontier::Advance(int newtime)
+{
+	int i;
+	std::vector<MagNetTask*> ready;
+
+	frontmute.Lock();
+	if(newtime > time) {
+		time = newtime;
+		frontcond->Broadcast();
+		while(!parked.empty() && parked.begin()->first <= time) {
+			ready.push_back(parked.begin()->second);
+			parked.erase(parked.begin());
+		}
+	}
+	frontmute.Unlock();
+
+	for(i=0; i<(int)ready.size(); i++) pool->Resume(ready[i]);
+}
+
+
+bool MagNetFrontier::Passed(int target)
+{
+	bool passed;
+
+	frontmute.Lock();
+	passed = time >= target;
+	frontmute.Unlock();
+	return passed;
+}
+
+
+// Hold a task returned from RunTask() until the frontier reaches 'target', requeued at once if already passed
+void MagNetFrontier::Park(MagNetTask *task, int target, MagNetPool *taskpool)
+{
+	frontmute.Lock();
+	pool = taskpool;
+	if(time < target) {
+		parked.insert(std::make_pair(target, task));
+		parkcount++;
+		frontmute.Unlock();
+		return;
+	}
+	frontmute.Unlock();
+	taskpool->Resume(task);
+}
+
+
+// Block until the frontier reaches 'target', pool tasks park instead, see MagNetTask::Park()
+void MagNetFrontier::WaitFor(int target)
+{
+	wxStopWatch waitwatch;
+
+	frontmute.Lock();
+	if(time < target) {
+		waitwatch.Start();
+		while(time < target) frontcond->Wait();
+		waittime += waitwatch.Time();
+		waitcount++;
+	}
+	frontmute.Unlock();
+}
+
+
+wxString MagNetFrontier::Stats(wxString stage, wxString frontier)
+{
+	wxString text;
+
+	if(parkcount) return text.Format("%s stage waited %.3f s in %d waits, %d tasks parked, on %s\n", stage, waittime / 1000, waitcount, parkcount, frontier);
+	return text.Format("%s stage waited %.3f s in %d waits on %s\n", stage, waittime / 1000, waitcount, frontier);
+}
+
+
+// Park the task until 'front' reaches 'time', returns true if RunTask() should save its state and return
+// Outside the pool the task waits in place and continues
+bool MagNetTask::Park(MagNetFrontier *front, int time)
+{
+	if(!worker) {
+		front->WaitFor(time);
+		return false;
+	}
+	if(front->Passed(time)) return false;
+	parkfront = front;
+	parktime = time;
+	return true;
+}
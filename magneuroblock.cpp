@@ -0,0 +1,697 @@
+/*
+*  magneuroblock.cpp
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*  Batched neuron engine, runs the neuromod() model for a block of neurons in SIMD lanes
+*
+*  The model state is held structure-of-arrays, one array element per neuron (lane), and the spiking,
+*  secretion, synthesis and store updates advance MAGSIMD lanes per instruction, with spike increments
+*  applied under a lane mask. Input generation, recording and spike time storage stay scalar per lane,
+*  using each lane's MagNeuroMod parameters and random number stream, so the random draws match the
+*  scalar engine exactly.
+*
+*  Tolerance: the vector arithmetic keeps the scalar operation order, so with floating point contraction
+*  disabled (-ffp-contract=off, MSVC /fp:precise) spike trains are identical to MagNeuroMod::neuromod().
+*  If the compiler fuses multiply-adds in one engine and not the other, values differ by rounding (~1e-16
+*  relative) and a threshold crossing can occasionally shift by a step, after which that neuron's spike
+*  train diverges while remaining statistically equivalent. MagNetModel::EngineCheck() reports this.
+*
+*  Osmotic sync (NaCl infusion) is not supported, RunNet() falls back to the scalar engine.
+*
+*/
+
+
+#include "magnetmod.h"
+#include <math.h>
+
+
+MagNeuroBlock::MagNeuroBlock(MagNetModel *magnetmodel)
+{
+	netmod = magnetmodel;
+	mod = netmod->mod;
+	magpop = mod->magpop;
+	numlanes = 0;
+	inputE = NULL;
+	inputdone = 0;
+	inputI = NULL;
+	nextstep = 0;
+	ttime = 0;
+}
+
+
+// Add a neuron to the block, copying its constants into lane arrays
+// Unused lanes are filled with copies of lane 0 so that vector updates stay finite, their results are ignored
+void MagNeuroBlock::AddLane(MagNeuroMod *neuromod)
+{
+	int j;
+	double log2 = log((double)2);
+
+	for(j=numlanes; j<MAGBLOCK; j++) {
+		lane[j] = neuromod;
+
+		Vrest[j] = neuromod->Vrest;
+		Vthresh[j] = neuromod->Vthresh;
+		hstep[j] = neuromod->hstep;
+		shstep[j] = neuromod->shstep;
+
+		// Time Constants - conversion from half-life, as neuromod()
+		tauMem[j] = log2 / neuromod->halflifeMem;
+		tauHAP[j] = log2 / neuromod->halflifeHAP;
+		tauDAP[j] = log2 / neuromod->halflifeDAP;
+		tauAHP[j] = log2 / neuromod->halflifeAHP;
+		tauAHP2[j] = log2 / neuromod->halflifeAHP2;
+		tauCa[j] = log2 / neuromod->halflifeCa;
+		tauDyno[j] = log2 / neuromod->halflifeDyno;
+		taudendCa[j] = log2 / neuromod->halflifedendCa;
+		tauPSP2[j] = log2 / neuromod->halflifePSP2;
+		tauB[j] = log2 / neuromod->halflifeB;
+		tauC[j] = log2 / neuromod->halflifeC;
+		tauE[j] = log2 / neuromod->halflifeE;
+		tauTS[j] = log2 / neuromod->halflifeTS;
+		tauTL[j] = log2 / neuromod->halflifeTL;
+		mRNAtau[j] = log2 / neuromod->mRNAhalflife;
+
+		// Spiking
+		epspmag2[j] = neuromod->pspmag2;
+		kHAP[j] = neuromod->kHAP;
+		kDAP[j] = neuromod->kDAP;
+		kAHP[j] = neuromod->kAHP;
+		kAHP2[j] = neuromod->kAHP2;
+		aAHP2[j] = neuromod->aAHP2;
+		kCa[j] = neuromod->kCa;
+		Ca_rest[j] = neuromod->Ca_rest;
+		kDyno[j] = neuromod->kDyno;
+		spikeDyno[j] = neuromod->spikeDyno;
+		kstoreDyno[j] = neuromod->kstoreDyno;
+		gKL[j] = neuromod->gKL;
+		ka[j] = neuromod->ka;
+		gOsmo[j] = neuromod->gOsmo;
+
+		// Secretion
+		kB[j] = neuromod->kB;
+		Bbase[j] = neuromod->Bbase;
+		kE[j] = neuromod->kE;
+		kC[j] = neuromod->kC;
+		Ethpow[j] = neuromod->Ethresh * neuromod->Ethresh * neuromod->Ethresh * neuromod->Ethresh * neuromod->Ethresh;
+		Cthpow[j] = neuromod->Cthresh * neuromod->Cthresh * neuromod->Cthresh;
+		alpha[j] = neuromod->alpha;
+		beta[j] = neuromod->beta;
+		secExp[j] = neuromod->secExp;
+		secXfix[j] = neuromod->secXfix;
+		Rmax[j] = neuromod->Rmax;
+		Pmax[j] = neuromod->Pmax;
+
+		// Synthesis
+		kTS[j] = neuromod->kTS;
+		kTL[j] = neuromod->kTL;
+		basalTL[j] = neuromod->basalTL;
+		synscale[j] = neuromod->synscale;
+		rateSR[j] = neuromod->rateSR;
+		mRNAmax[j] = neuromod->mRNAmax;
+	}
+	numlanes++;
+}
+
+
+void MagNeuroBlock::RunTask()
+{
+	int j;
+
+	neuroblock();
+	if(parkfront) return;     // continues when requeued
+	for(j=0; j<numlanes; j++) netmod->NeuronDone(lane[j]->neurodex);     // lanes complete together
+}
+
+
+// Scalar per-lane PSP input generation, same random draw sequence as neuromod()
+void MagNeuroBlock::LaneInput(int j, int step)
+{
+	MagNeuroMod *neuro = lane[j];
+	int nepsp, nipsp, nepsp1, nipsp1, nepsp2count;
+	double epsprate1, ipsprate1;
+	double totalepsprate, totalipsprate;
+	double rampinput;
+	double step_hstep = hstep[j];
+
+	// Signal Input
+	if(neuro->noiamp) noisig[j] = noisig[j] + (neuro->noimean - noisig[j]) / neuro->noitau + neuro->noiamp * sqrt(step_hstep) * neuro->rng.normal();
+	if(neuro->signalmode) {
+		synsig[j] = noisig[j];
+		epsprate1 = synsig[j] / 1000;
+		ipsprate1 = epsprate1 * neuro->sigIratio;
+	}
+	else {
+		synsig[j] = neuro->psprate;
+		epsprate1 = 0;
+		ipsprate1 = 0;
+	}
+
+	if(!netmod->spikemode) return;
+
+	nepsp = 0;
+	nipsp = 0;
+	nepsp1 = 0;
+	nipsp1 = 0;
+	nepsp2count = 0;
+
+	if(inputgen) {
+		nepsp = inputE[j * 1000 + inputdex];
+		nipsp = inputI[j * 1000 + inputdex];
+	}
+	else {
+		if(neuro->prototype == ramp || neuro->prototype == rampcurve) {
+			if(step < neuro->rampstart) rampinput = neuro->rampbase;
+			if(step >= neuro->rampstart && step < neuro->rampstop) {
+				if(neuro->prototype == ramp) rampinput = neuro->rampinit + (step - neuro->rampstart) * neuro->rampstep;
+				else rampinput = neuro->rampinit + neuro->rampmax - neuro->rampmax * exp(-neuro->rampgrad * (step - neuro->rampstart));
+			}
+			if(step >= neuro->rampstop) rampinput = neuro->rampafter;
+			if(rampinput < 0) rampinput = 0;
+			epsprate[j] = rampinput / 1000;
+			synsig[j] = rampinput;
+		}
+
+		totalepsprate = epsprate[j] * neuro->synvar;
+		totalipsprate = epsprate[j] * neuro->iratio * neuro->synvar;
+
+		if(neuro->expinput) {
+			if(totalepsprate > 0) {
+				while(epspt[j] < step_hstep) {
+					nepsp++;
+					epspt[j] = neuro->rng.exponential() / totalepsprate + epspt[j];
+				}
+				epspt[j] = epspt[j] - step_hstep;
+			}
+
+			if(totalipsprate > 0) {
+				while(ipspt[j] < step_hstep) {
+					nipsp++;
+					ipspt[j] = neuro->rng.exponential() / totalipsprate + ipspt[j];
+				}
+				ipspt[j] = ipspt[j] - step_hstep;
+			}
+
+			if(epsprate1 > 0) {
+				while(epspt1[j] < step_hstep) {
+					nepsp1++;
+					epspt1[j] = neuro->rng.exponential() / epsprate1 + epspt1[j];
+				}
+				epspt1[j] = epspt1[j] - step_hstep;
+			}
+
+			if(ipsprate1 > 0) {
+				while(ipspt1[j] < step_hstep) {
+					nipsp1++;
+					ipspt1[j] = neuro->rng.exponential() / ipsprate1 + ipspt1[j];
+				}
+				ipspt1[j] = ipspt1[j] - step_hstep;
+			}
+
+			if(epsprate2[j] > 0) {
+				while(epspt2[j] < step_hstep) {
+					nepsp2count++;
+					epspt2[j] = neuro->rng.exponential() / epsprate2[j] + epspt2[j];
+				}
+				epspt2[j] = epspt2[j] - step_hstep;
+			}
+		}
+		else {
+			nepsp = neuro->epspgen.Count(totalepsprate * step_hstep, neuro->rng);
+			nipsp = neuro->ipspgen.Count(totalipsprate * step_hstep, neuro->rng);
+			nepsp1 = neuro->epspgen1.Count(epsprate1 * step_hstep, neuro->rng);
+			nipsp1 = neuro->ipspgen1.Count(ipsprate1 * step_hstep, neuro->rng);
+			nepsp2count = neuro->epspgen2.Count(epsprate2[j] * step_hstep, neuro->rng);
+		}
+	}
+
+	inputPSP[j] = nepsp * neuro->pspmag - nipsp * neuro->pspmag;
+	inputPSP1[j] = nepsp1 * neuro->pspmag - nipsp1 * neuro->pspmag;
+
+	if(neuro->epspsynchflag) nepsp2count = nepsp;   // synchronous AMPA and NMDA EPSPs
+	nepsp2[j] = nepsp2count;
+}
+
+
+void MagNeuroBlock::neuroblock()
+{
+	int i, j, v, step;
+	int runtime100, modsteps;
+	int buffdex, synthdex;
+	int spikebits;
+	wxString text;
+
+	MagNeuroMod *neuro;
+	MagNeuron *neuron;
+
+	int synthrecrate = 1000 * 60;
+	int datsample = mod->datsample;
+	int buffrate = netmod->buffrate;
+	int plasma_hstep = lane[0]->plasma_hstep;
+	int maxtimeLong = lane[0]->maxtimeLong;
+	int decaymode = lane[0]->decaymode;
+	int AHP2mode = lane[0]->AHP2mode;
+	bool dynostoreflag = lane[0]->dynostoreflag;
+	bool monitor = lane[0]->neurodex == 0;     // neuron 0 records monitor data and reports progress
+	bool record = monitor && netmod->neurorec;
+	bool synthdel = false;
+	double absref = 2;
+	bool plasmaflag = netmod->secmode && netmod->plasmamode;
+	bool secflag = netmod->secmode && !netmod->secfix;
+
+	double *secXbuffer = new double[buffrate];
+
+	MagNeuroDat *neurorecord = mod->neurodata;
+	wxCommandEvent progevent(wxEVT_COMMAND_TEXT_UPDATED, ID_Progress);
+	wxCommandEvent plotevent(wxEVT_COMMAND_TEXT_UPDATED, ID_Display);
+
+	modsteps = lane[0]->modsteps;
+	inputgen = (*netmod->netflags)["inputgen"];
+	runtime100 = netmod->runtime * 1000 / 100;
+	for(j=0; j<numlanes; j++) if(lane[j]->synthdel) synthdel = true;
+	buffdex = 0;
+
+	// Initialise on the first run, a parked task continues from its lane state
+	if(!nextstep) {
+		if(inputgen) {
+			inputE = new unsigned char[2 * MAGBLOCK * 1000];
+			inputI = inputE + MAGBLOCK * 1000;
+			inputdone = 0;
+		}
+
+		// Initialise lanes
+		for(j=0; j<numlanes; j++) {
+			neuro = lane[j];
+			neuron = neuro->neuron;
+			neuro->rng.seed(static_cast<uint64_t>(neuro->modseed), static_cast<uint64_t>(neuro->neurodex));
+
+			if(neuro->osmomode) epsprate[j] = 0;
+			else epsprate[j] = neuro->psprate / 1000;
+			epsprate2[j] = neuro->psprate2 / 1000;
+
+			neuro->synthrec.assign((modsteps / synthrecrate < 100000 ? modsteps / synthrecrate : 100000) + 1, 0);
+
+			neuron->spikecount = 0;
+			neuron->spikecount2 = 0;
+			neuron->sta.RunSize(netmod->stawin);
+			neuron->stats.RunSize(netmod->runtime, netmod->spikestats);
+			for(i=0; i<modsteps/1000; i++) neuron->Secretion[i] = 0;
+
+			// Record Initial Values
+			neuron->storeLong[0] = neuro->Rinit;
+			neuron->transLong[0] = 0;
+			neuron->synthstoreLong[0] = neuro->mRNAinit;
+			neuron->synthrateLong[0] = neuro->rateSR * neuro->basalTL * neuro->synscale * neuro->mRNAinit * 3600;
+		}
+
+		for(j=0; j<MAGBLOCK; j++) {
+			neuro = lane[j];
+			epspt[j] = 0;
+			ipspt[j] = 0;
+			epspt1[j] = 0;
+			ipspt1[j] = 0;
+			epspt2[j] = 0;
+			noisig[j] = neuro->noimean;
+			synsig[j] = neuro->psprate;
+
+			pspsig[j] = 0;
+			V[j] = neuro->Vrest;
+			tHAP[j] = 0;
+			tDAP[j] = 0;
+			tAHP[j] = 0;
+			tAHP2[j] = 0;
+			tCa[j] = neuro->Ca_rest;
+			tdendCa[j] = 0;
+			tDyno[j] = 0;
+			storeDyno[j] = 0.6;
+			inputPSP[j] = 0;
+			inputPSP1[j] = 0;
+			inputPSP2[j] = 0;
+			nepsp2[j] = 0;
+
+			tR[j] = neuro->Rinit;
+			tP[j] = neuro->Pmax;
+			tB[j] = 0;
+			tE[j] = 0;
+			tC[j] = 0.03;
+			CaEnt[j] = 0;
+			secX[j] = 0;
+			fillR[j] = 0;
+
+			stimTS[j] = 0;
+			stimTL[j] = 0;
+			mRNAstore[j] = neuro->mRNAinit;
+			synthrate[j] = 0;
+
+			secRate1s[j] = 0;
+			secRate60s[j] = 0;
+			secRate600s[j] = 0;
+		}
+
+		netmod->OsmoPress = lane[0]->BasalNaConc * 2;
+
+		if(monitor) {
+			neuro = lane[0];
+			neurorecord->stimTL[0] = 0;
+			neurorecord->stimTS[0] = 0;
+			neurorecord->mRNAstore[0] = neuro->mRNAinit;
+			neurorecord->Ca[0] = neuro->Ca_rest;
+			magpop->inputsignal[0] = neuro->psprate;
+			if(neuro->prototype == ramp || neuro->prototype == rampcurve) magpop->inputLong[0] = neuro->rampbase;
+			else magpop->inputLong[0] = neuro->psprate;
+		}
+
+		ttime = 0;
+		nextstep = 1;
+	}
+
+
+	// Model Loop
+	for(step=nextstep; step<=modsteps; step++) {
+
+		// Secretion ring epoch free, a task that has to wait parks and continues at this step
+		if(plasmaflag && netmod->SecPark(this, step)) break;
+
+		// Network input, at each window start release the previous window and park until the input stage fills it
+		if(inputgen && (step - 1) % netmod->inputwin == 0) {
+			while((inputdone + 1) * netmod->inputwin < step) netmod->InputRelease(inputdone++, numlanes);
+			if(Park(netmod->inputfront, step)) break;
+		}
+
+		ttime++;
+
+		if(monitor && step % runtime100 == 0) {
+			progevent.SetInt(floor(ttime)/modsteps*100);
+			netmod->netbox->GetEventHandler()->AddPendingEvent(progevent);
+		}
+
+		if(step % 1000 == 0) {
+			for(j=0; j<numlanes; j++) if(lane[j]->neuron->spikecount > 0) break;
+			if(j < numlanes) {
+				plotevent.SetInt(floor(ttime)/modsteps*100);
+				netmod->netbox->GetEventHandler()->AddPendingEvent(plotevent);
+				if((*netmod->netflags)["realtime"]) wxThread::Sleep(lane[0]->disprate);
+			}
+		}
+
+		// Network input, every 1000 steps merge each lane's input cell events
+		if(inputgen) {
+			inputdex = (step - 1) % 1000;
+			if(!inputdex) for(j=0; j<numlanes; j++)
+				netmod->InputFill(lane[j]->neurodex, step, step + 999 < modsteps ? step + 999 : modsteps, inputE + j * 1000, inputI + j * 1000);
+		}
+
+		for(j=0; j<numlanes; j++) LaneInput(j, step);
+
+		// Spiking model
+		if(netmod->spikemode) {
+			for(v=0; v<MAGBLOCK; v+=MAGSIMD) {
+				vdouble vpspsig = vload(pspsig + v);
+				vdouble vinputPSP2 = vload(inputPSP2 + v);
+				vdouble vtauPSP2 = vload(tauPSP2 + v);
+				vdouble vepspmag2 = vload(epspmag2 + v);
+				vdouble vtHAP = vload(tHAP + v);
+				vdouble vtDAP = vload(tDAP + v);
+				vdouble vtAHP = vload(tAHP + v);
+				vdouble vtAHP2 = vload(tAHP2 + v);
+				vdouble vtCa = vload(tCa + v);
+				vdouble vCa_rest = vload(Ca_rest + v);
+				vdouble vtDyno = vload(tDyno + v);
+				vdouble vtdendCa = vload(tdendCa + v);
+				vdouble vstoreDyno = vload(storeDyno + v);
+				vdouble vgKL = vload(gKL + v);
+
+				// NMDA input, only for lanes with non-zero magnitude
+				vinputPSP2 = vselect(vepspmag2 != vset(0), vinputPSP2 - (vinputPSP2 * vtauPSP2) * vload(hstep + v) + vload(nepsp2 + v) * vepspmag2, vinputPSP2);
+
+				vpspsig = vpspsig + (vinputPSP2 * vtauPSP2 - vpspsig * vload(tauMem + v)) + vload(inputPSP + v) + vload(inputPSP1 + v);
+
+				vtHAP = vtHAP - (vtHAP * vload(tauHAP + v));
+				vtDAP = vtDAP - (vtDAP * vload(tauDAP + v));
+				vtAHP = vtAHP - (vtAHP * vload(tauAHP + v));
+				vtAHP2 = vtAHP2 - (vtAHP2 * vload(tauAHP2 + v));
+
+				vtCa = vtCa - (vtCa - vCa_rest) * vload(tauCa + v);
+				vtDyno = vtDyno - vtDyno * vload(tauDyno + v);
+
+				vtdendCa = vtdendCa - vtdendCa * vload(taudendCa + v);
+				vstoreDyno = vstoreDyno + vload(kstoreDyno + v) * vtdendCa;
+				vstoreDyno = vselect(vstoreDyno > vset(10), vset(10), vstoreDyno);
+
+				vdouble vKLact = vox_tanh((vtCa - vCa_rest - vtDyno) / vload(ka + v));
+				vdouble vIKL = vselect(vgKL != vset(0), vgKL - vgKL * vKLact, vset(0));   // zero without leak conductance, as neuromod()
+
+				vstore(V + v, vload(Vrest + v) + vpspsig + vload(gOsmo + v) - vtHAP - vtAHP - vtAHP2 + vtDAP - vIKL);
+
+				vstore(pspsig + v, vpspsig);
+				vstore(inputPSP2 + v, vinputPSP2);
+				vstore(tHAP + v, vtHAP);
+				vstore(tDAP + v, vtDAP);
+				vstore(tAHP + v, vtAHP);
+				vstore(tAHP2 + v, vtAHP2);
+				vstore(tCa + v, vtCa);
+				vstore(tDyno + v, vtDyno);
+				vstore(tdendCa + v, vtdendCa);
+				vstore(storeDyno + v, vstoreDyno);
+			}
+		}
+
+		// Secretion model
+		if(secflag) {
+			for(v=0; v<MAGBLOCK; v+=MAGSIMD) {
+				vdouble vtB = vload(tB + v);
+				vdouble vtE = vload(tE + v);
+				vdouble vtC = vload(tC + v);
+				vdouble vsecExp = vload(secExp + v);
+				vdouble valpha = vload(alpha + v);
+				vdouble vtP = vload(tP + v);
+				vdouble vsecX = vload(secX + v);
+
+				vtB = vtB - (vtB * vload(tauB + v));
+				vtE = vtE - (vtE * vload(tauE + v));
+				vtC = vtC - (vtC * vload(tauC + v));
+
+				vdouble vEKpow = vtE * vtE * vtE * vtE * vtE;
+				vdouble vEinh = vset(1) - vEKpow / (vEKpow + vload(Ethpow + v));
+				vdouble vCKpow = vtC * vtC * vtC;
+				vdouble vCinh = vset(1) - vCKpow / (vCKpow + vload(Cthpow + v));
+
+				vstore(CaEnt + v, vEinh * vCinh * (vtB + vload(Bbase + v)));
+
+				vsecX = vselect(vsecExp == vset(3), vtE * vtE * vtE * valpha * vtP, vsecX);
+				vsecX = vselect(vsecExp == vset(2), vtE * vtE * valpha * vtP, vsecX);
+
+				vstore(tB + v, vtB);
+				vstore(tE + v, vtE);
+				vstore(tC + v, vtC);
+				vstore(secX + v, vsecX);
+			}
+		}
+
+		if(netmod->secfix) for(j=0; j<MAGBLOCK; j++) secX[j] = secXfix[j];
+
+
+		// Plasma model, block summed buffer, one population update per block
+		if(plasmaflag) {
+			secXbuffer[buffdex] = 0;
+			for(j=0; j<numlanes; j++) secXbuffer[buffdex] += secX[j] / netmod->numneurons;
+			buffdex++;
+
+			if(buffrate && step >= buffrate && step % buffrate == 0) {
+				netmod->SecFlush(worker, secXbuffer, buffdex, step, plasma_hstep, numlanes);
+				buffdex = 0;
+				if(monitor && step < 2000) mod->DiagWrite(text.Format("Neuron 0 buffer fill step %d secfront %d secXpop %d buffer %d\n", step, netmod->secfront->time, (step - buffrate)/plasma_hstep, buffrate));
+			}
+
+			// bin recording of secretion rate
+			for(j=0; j<MAGBLOCK; j++) {
+				secRate1s[j] += secX[j];
+				secRate60s[j] += secX[j];
+				secRate600s[j] += secX[j];
+			}
+
+			if(step % 1000 == 0) for(j=0; j<numlanes; j++) {
+				lane[j]->neuron->Secretion[step/1000] = secRate1s[j];
+				secRate1s[j] = 0;
+			}
+
+			if(step % 60000 == 0) for(j=0; j<numlanes; j++) {
+				lane[j]->neuron->secLong[step/60000] = secRate60s[j] * 60 / 1000;  // convert pg/min to ng/h
+				secRate60s[j] = 0;
+			}
+
+			if(step % 600000 == 0) for(j=0; j<numlanes; j++) {
+				lane[j]->neuron->secHour[step/600000] = secRate600s[j] * 6 / 1000;
+				secRate600s[j] = 0;
+			}
+		}
+
+
+		// Synthesis model and stores
+		for(v=0; v<MAGBLOCK; v+=MAGSIMD) {
+			vdouble vtCa_rest = vload(tCa + v) - vload(Ca_rest + v);
+			vdouble vshstep = vload(shstep + v);
+			vdouble vstimTS = vload(stimTS + v);
+			vdouble vstimTL = vload(stimTL + v);
+			vdouble vmRNAstore = vload(mRNAstore + v);
+			vdouble vmRNAmax = vload(mRNAmax + v);
+			vdouble vsynscale = vload(synscale + v);
+			vdouble vsynthrate;
+
+			vstimTS = vstimTS + (vload(kTS + v) * vset(0.001) * vtCa_rest - vstimTS * vload(tauTS + v)) * vshstep;
+			vstimTL = vstimTL + (vload(kTL + v) * vset(0.001) * vtCa_rest - vstimTL * vload(tauTL + v)) * vshstep;
+			vsynthrate = (vstimTL + vload(basalTL + v)) * vmRNAstore;
+
+			if(decaymode) vmRNAstore = vmRNAstore + (vsynscale * vstimTS - vmRNAstore * vload(mRNAtau + v)) * vshstep;
+			else vmRNAstore = vmRNAstore + vsynscale * (vstimTS - vsynthrate) * vshstep;
+			vmRNAstore = vselect((vmRNAmax != vset(0)) & (vmRNAstore > vmRNAmax), vmRNAmax, vmRNAstore);
+
+			vstore(stimTS + v, vstimTS);
+			vstore(stimTL + v, vstimTL);
+			vstore(synthrate + v, vsynthrate);
+			vstore(mRNAstore + v, vmRNAstore);
+			vstore(fillR + v, vload(rateSR + v) * vsynthrate * vset(0.001) * vset(0.03));
+		}
+
+		if(synthdel) for(j=0; j<numlanes; j++) {
+			int del = lane[j]->synthdel;
+			if(!del) continue;
+			if(step/synthrecrate >= del) fillR[j] = rateSR[j] * lane[j]->synthrec[step/synthrecrate - del] * 0.001 * 0.03;
+			else fillR[j] = rateSR[j] * lane[j]->synthrec[0] * 0.001 * 0.03;
+		}
+
+		// Reserve Store (tR) and Releasable Pool (tP)
+		for(v=0; v<MAGBLOCK; v+=MAGSIMD) {
+			vdouble vtR = vload(tR + v);
+			vdouble vtP = vload(tP + v);
+			vdouble vfillP = vselect(vtP < vload(Pmax + v), vload(beta + v) * vtR / vload(Rmax + v), vset(0));
+
+			vstore(tP + v, vtP - vload(secX + v) + vfillP);
+			vstore(tR + v, vtR + vload(fillR + v) - vfillP);
+		}
+
+
+		// Recording
+		if(step%1000 == 0 && step/1000 < magpop->maxtime)
+			for(j=0; j<numlanes; j++) lane[j]->neuron->store[step/datsample] = tR[j];
+
+		if(record) {
+			if(step%100 == 0 && step<1000000) magpop->inputsignal[step/100] = synsig[0];
+			if(step < 1000000) netmod->neurodata->pspsig[step] = pspsig[0];
+			if(step % datsample == 0 && step < 1000000 * datsample) {
+				neurorecord->stimTS[step/datsample] = stimTS[0];
+				neurorecord->stimTL[step/datsample] = stimTL[0];
+				neurorecord->mRNAstore[step/datsample] = mRNAstore[0];
+				neurorecord->Ca[step/datsample] = tCa[0];
+			}
+		}
+
+		if(netmod->stawin) for(j=0; j<numlanes; j++) lane[j]->neuron->sta.Step(step, pspsig[j], tCa[j], secX[j]);
+
+		if(step < 60000 * maxtimeLong && step % 60000 == 0) {
+			for(j=0; j<numlanes; j++) {
+				neuron = lane[j]->neuron;
+				neuron->storeLong[step/60000] = tR[j];
+				neuron->transLong[step/60000] = stimTS[j];
+				neuron->synthstoreLong[step/60000] = mRNAstore[j];
+				neuron->synthrateLong[step/60000] = fillR[j] * 3600;   // convert from pg/ms to ng/h
+			}
+			if(monitor) magpop->inputLong[step/60000] = synsig[0];
+		}
+
+		if(step%synthrecrate == 0) {
+			synthdex = step/synthrecrate;
+			if(synthdex > 100000) synthdex = synthdex % 100000;
+			for(j=0; j<numlanes; j++) lane[j]->synthrec[synthdex] = synthrate[j];
+		}
+
+
+		// Spiking, masked increments for lanes over threshold
+		if(ttime < absref) continue;
+
+		for(v=0; v<MAGBLOCK; v+=MAGSIMD) {
+			vmask spike = vload(V + v) > vload(Vthresh + v);
+			spikebits = vbits(spike);
+			if(!spikebits) continue;
+
+			vdouble vtCa = vload(tCa + v);
+			vdouble vtAHP2 = vload(tAHP2 + v);
+			vdouble vtDyno = vload(tDyno + v);
+			vdouble vkAHP2 = vload(kAHP2 + v);
+			vdouble vkDyno = vload(kDyno + v);
+
+			vtCa = vselect(spike, vtCa + vload(kCa + v), vtCa);
+			vstore(tAHP + v, vselect(spike, vload(tAHP + v) + vload(kAHP + v), vload(tAHP + v)));
+			vstore(tHAP + v, vselect(spike, vload(tHAP + v) + vload(kHAP + v), vload(tHAP + v)));
+			vstore(tDAP + v, vselect(spike, vload(tDAP + v) + vload(kDAP + v), vload(tDAP + v)));
+
+			if(AHP2mode) {
+				vdouble vaAHP2 = vload(aAHP2 + v);
+				vtAHP2 = vselect(spike & (vtCa >= vaAHP2), vtAHP2 + vkAHP2 * (vtCa - vaAHP2), vtAHP2);
+			}
+			else vtAHP2 = vselect(spike, vtAHP2 + vkAHP2, vtAHP2);
+
+			if(netmod->secmode) {
+				vdouble vCaEnt = vload(CaEnt + v);
+				vstore(tB + v, vselect(spike, vload(tB + v) + vload(kB + v), vload(tB + v)));
+				vstore(tE + v, vselect(spike, vload(tE + v) + vload(kE + v) * vCaEnt, vload(tE + v)));
+				vstore(tC + v, vselect(spike, vload(tC + v) + vload(kC + v) * vCaEnt, vload(tC + v)));
+			}
+
+			if(dynostoreflag) {
+				vdouble vstoreDyno = vload(storeDyno + v);
+				vdouble vspikeDyno = vload(spikeDyno + v);
+				vmask dyno = spike & (vstoreDyno > vspikeDyno);
+				vtDyno = vselect(dyno, vtDyno + vkDyno, vtDyno);
+				vstore(storeDyno + v, vselect(dyno, vstoreDyno - vspikeDyno, vstoreDyno));
+			}
+			else vtDyno = vselect(spike, vtDyno + vkDyno, vtDyno);
+
+			vstore(tCa + v, vtCa);
+			vstore(tAHP2 + v, vtAHP2);
+			vstore(tDyno + v, vtDyno);
+
+			// record spike times
+			for(j=v; j<v+MAGSIMD && j<numlanes; j++) {
+				if(!(spikebits & (1 << (j - v)))) continue;
+				neuron = lane[j]->neuron;
+				neuron->SpikeAdd(ttime);
+				if(netmod->stawin) neuron->sta.Spike(step);
+			}
+		}
+	}
+
+
+	// Parked, flush the part filled secretion buffer and continue from this step
+	if(step <= modsteps) {
+		if(plasmaflag) netmod->SecFlush(worker, secXbuffer, buffdex, step - 1, plasma_hstep, 0);
+		nextstep = step;
+		delete [] secXbuffer;
+		return;
+	}
+	nextstep = 0;
+
+	// Release the remaining input windows
+	if(inputgen) while(inputdone < netmod->inputwindows) netmod->InputRelease(inputdone++, numlanes);
+
+	// Store final mRNA store and reserve store value for sequential runs
+	for(j=0; j<numlanes; j++) {
+		neuron = lane[j]->neuron;
+		if(!neuron->netinit) {
+			neuron->mRNAinit = mRNAstore[j];
+			(*neuron->synthparams)["mRNAinit"] = mRNAstore[j];
+		}
+		if(!neuron->storereset) {
+			(*neuron->secparams)["Rinit"] = tR[j];
+			neuron->storeinit = tR[j];
+		}
+	}
+
+	delete [] secXbuffer;
+	delete [] inputE;
+	inputE = NULL;
+	inputI = NULL;
+}
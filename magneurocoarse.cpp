@@ -0,0 +1,448 @@
+/*
+*  magneurocoarse.cpp
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*  Coarse step integration of the neuromod() model, for spiking parameter 'hstep' above 1 ms
+*
+*  neuromod() is written for 1 ms steps, its decays are (1 - tau) per step. coarsemod() advances
+*  the same model by h = hstep ms per step with the exact decay over h of that update,
+*
+*      f^h = exp(-tau' h),  tau' = -log(1 - tau)
+*
+*  so hstep 1 reproduces the 1 ms decays. Linear terms driven by a decaying variable, the NMDA
+*  feed into pspsig, dendritic Ca into the dynorphin store, fast Ca into secretion, and Ca into
+*  synthesis, use the matching geometric sums. Noise is stepped as the exact composition of h
+*  1 ms noise steps.
+*
+*  PSP inputs are drawn as Poisson counts with mean rate * h and added at the step end, scaled so
+*  the mean and variance of pspsig match arrivals spread across the step. Spikes are tested once
+*  per step. These are the accuracy costs, threshold crossings within a step are missed, timing is
+*  resolved to h ms, and at most one spike fires per step. MagNetModel::StepCheck() reports firing rate, ISI histogram,
+*  and secretion against the 1 ms reference.
+*
+*  Recording indices stay in ms of simulated time, hstep must be a whole number of ms dividing
+*  every recording period. Ramp protocols, generated input, and osmotic sync fall back to 1 ms steps.
+*
+*/
+
+
+#include "magnetmod.h"
+#include <math.h>
+
+
+// sum of f^k for k = 1 to n
+static double geosum(double f, int n)
+{
+	if(fabs(1 - f) < 1e-12) return n;
+	return f * (1 - pow(f, n)) / (1 - f);
+}
+
+
+void MagNeuroMod::coarsemod()
+{
+	int i, k, h, step;
+	int recint, modsteps100;
+	int buffdex, synthdex;
+	bool countflag, monitor;
+	wxString text;
+
+	double epsprate, totalepsprate, totalipsprate;
+	double epsprate1, ipsprate1, epsprate2;
+	int nepsp, nipsp, nepsp1, nipsp1, nepsp2;
+	double inputPSP, inputPSP1;
+	double synsig, noisd;
+	double absref;
+
+	double tauMem, tauHAP, tauDAP, tauAHP, tauAHP2;
+	double tauCa, tauDyno, taudendCa, tauPSP2;
+	double tauB, tauE, tauC;
+	double fMem, fHAP, fDAP, fAHP, fAHP2, fCa, fDyno, fdendCa, fPSP2;
+	double fB, fE, fC, fNoise;
+	double meanMem, sdMem, sumPSP2, sumdendCa, sumCa, sumE;
+
+	double KLact, Cainput;
+	double Cinh, Einh, EKpow, CKpow, Ethpow, Cthpow;
+
+	// Run state, a local copy saved back to 'state' when the task parks
+	MagNeuroState vars = state;
+	double &inputPSP2 = vars.inputPSP2, &pspsig = vars.pspsig, &V = vars.V;
+	double &noisig = vars.noisig, &ttime = vars.ttime;
+	double &tCa = vars.tCa, &tdendCa = vars.tdendCa, &tHAP = vars.tHAP, &tDAP = vars.tDAP, &tAHP = vars.tAHP, &tAHP2 = vars.tAHP2;
+	double &tDyno = vars.tDyno, &storeDyno = vars.storeDyno, &IKL = vars.IKL;
+	double &tB = vars.tB, &tE = vars.tE, &tC = vars.tC, &tR = vars.tR, &tP = vars.tP, &CaEnt = vars.CaEnt, &secX = vars.secX;
+	double &secRate1s = vars.secRate1s, &secRate60s = vars.secRate60s, &secRate600s = vars.secRate600s;
+
+	int synthrecrate = 1000 * 60;
+	int datsample = netmod->mod->datsample;
+
+	// Step must be whole ms dividing the recording periods
+	h = (int)hstep;
+	recint = stepgcd(stepgcd(1000, datsample), 100);
+	if(netmod->secmode && netmod->plasmamode && buffrate) recint = stepgcd(recint, buffrate);
+
+	if(h != hstep || h < 1 || recint % h || osmomode || prototype == ramp || prototype == rampcurve || (*netmod->netflags)["inputgen"]) {
+		if(neurodex == 0) mod->DiagWrite(text.Format("hstep %.2f not supported, needs whole ms dividing %d and no ramp, generated input, or osmotic sync, using 1 ms steps\n", hstep, recint));
+		hstep = 1;
+		shstep = hstep / 1000;
+		syn_hstep = shstep / 3600;
+		if(netmod->eventmode && probes.empty()) eventmod();     // 1 ms engine as chosen by RunTask() when a parked task continues
+		else neuromod();
+		return;
+	}
+
+	tauMem = log((double)2) / halflifeMem;
+	tauHAP = log((double)2) / halflifeHAP;
+	tauDAP = log((double)2) / halflifeDAP;
+	tauAHP = log((double)2) / halflifeAHP;
+	tauAHP2 = log((double)2) / halflifeAHP2;
+	tauCa = log((double)2) / halflifeCa;
+	tauDyno = log((double)2) / halflifeDyno;
+	taudendCa = log((double)2) / halflifedendCa;
+	tauPSP2 = log((double)2) / halflifePSP2;
+	tauB = log((double)2) / halflifeB;
+	tauC = log((double)2) / halflifeC;
+	tauE = log((double)2) / halflifeE;
+	tauTS = log((double)2) / halflifeTS;
+	tauTL = log((double)2) / halflifeTL;
+	mRNAtau = log((double)2) / mRNAhalflife;
+
+	// Decay factors across one step
+	fMem = pow(1 - tauMem, h);
+	fHAP = pow(1 - tauHAP, h);
+	fDAP = pow(1 - tauDAP, h);
+	fAHP = pow(1 - tauAHP, h);
+	fAHP2 = pow(1 - tauAHP2, h);
+	fCa = pow(1 - tauCa, h);
+	fDyno = pow(1 - tauDyno, h);
+	fdendCa = pow(1 - taudendCa, h);
+	fPSP2 = pow(1 - tauPSP2, h);
+	fB = pow(1 - tauB, h);
+	fE = pow(1 - tauE, h);
+	fC = pow(1 - tauC, h);
+
+	// Driven terms, summed over the 1 ms steps within a step
+	// NMDA into pspsig, sum of (1 - tauMem)^(h-k) (1 - tauPSP2)^k
+	sumPSP2 = 0;
+	for(k=1; k<=h; k++) sumPSP2 += pow(1 - tauMem, h - k) * pow(1 - tauPSP2, k);
+	// PSP arriving in ms j of the step decays by (1 - tauMem)^(h-j), mean and rms across the step
+	meanMem = (1 + geosum(1 - tauMem, h - 1)) / h;
+	sdMem = sqrt((1 + geosum((1 - tauMem) * (1 - tauMem), h - 1)) / h);
+	sumdendCa = geosum(1 - taudendCa, h);
+	sumCa = geosum(1 - tauCa, h) / h;                  // mean Ca decay factor, synthesis input
+	sumE = geosum(pow(1 - tauE, secExp), h) / h;       // mean tE^secExp decay factor, secretion
+
+	// Noise, h steps of noisig += (noimean - noisig) / noitau + noiamp * N(0, 1)
+	fNoise = 1;
+	noisd = 0;
+	if(noiamp) {
+		fNoise = pow(1 - 1 / noitau, h);
+		if(fabs(1 - fNoise * fNoise) < 1e-12) noisd = noiamp * sqrt((double)h);
+		else noisd = noiamp * sqrt((1 - fNoise * fNoise) / (1 - pow(1 - 1 / noitau, 2)));
+	}
+
+	countflag = neurodex == 0;
+	monitor = countflag && netmod->neurorec;
+	modsteps100 = netmod->runtime * 1000 / 100;
+
+	wxCommandEvent progevent(wxEVT_COMMAND_TEXT_UPDATED, ID_Progress);
+	wxCommandEvent plotevent(wxEVT_COMMAND_TEXT_UPDATED, ID_Display);
+
+	double *secXbuffer = new double[buffrate];
+	buffdex = 0;
+
+	epsprate = psprate / 1000;
+	totalepsprate = epsprate * synvar;
+	totalipsprate = epsprate * iratio * synvar;
+	epsprate2 = psprate2 / 1000;
+	absref = 2;
+
+	Ethpow = Ethresh * Ethresh * Ethresh * Ethresh * Ethresh;
+	Cthpow = Cthresh * Cthresh * Cthresh;
+
+	// Initialise on the first run, a parked task continues from its saved state
+	if(!vars.step) {
+		rng.seed(static_cast<uint64_t>(modseed), static_cast<uint64_t>(neurodex));
+
+		inputPSP2 = 0;
+		pspsig = 0;
+		ttime = 0;
+		tHAP = 0;
+		tDAP = 0;
+		tAHP = 0;
+		tAHP2 = 0;
+		tCa = Ca_rest;
+		tdendCa = 0;
+		tDyno = 0;
+		storeDyno = 0.6;
+		V = Vrest;
+		noisig = noimean;
+		netmod->OsmoPress = BasalNaConc * 2;
+
+		tR = Rinit;
+		tP = Pmax;
+		tB = 0;
+		tE = 0;
+		tC = 0.03;
+		CaEnt = 0;
+
+		stimTS = 0;
+		stimTL = 0;
+		mRNAstore = mRNAinit;
+		synthrec.assign((modsteps / synthrecrate < 100000 ? modsteps / synthrecrate : 100000) + 1, 0);
+		synthrate = (stimTL + basalTL) * mRNAstore;
+
+		secRate1s = 0;
+		secRate60s = 0;
+		secRate600s = 0;
+		secX = 0;
+
+		neuron->spikecount = 0;
+		neuron->spikecount2 = 0;
+		neuron->sta.RunSize(0);     // spike triggered averages need 1 ms steps
+		neuron->stats.RunSize(netmod->runtime, netmod->spikestats);
+		for(i=0; i<modsteps/1000; i++) neuron->Secretion[i] = 0;
+
+		// Record Initial Values
+		neuron->storeLong[0] = tR;
+		neuron->transLong[0] = 0;
+		neuron->synthstoreLong[0] = mRNAstore;
+		neuron->synthrateLong[0] = rateSR * (stimTL + basalTL) * synscale * mRNAstore * 3600;
+		if(countflag) {
+			neurorecord->stimTL[0] = stimTL;
+			neurorecord->stimTS[0] = stimTS;
+			neurorecord->mRNAstore[0] = mRNAstore;
+			neurorecord->Ca[0] = Ca_rest;
+			magpop->inputsignal[0] = psprate;
+			magpop->inputLong[0] = psprate;
+		}
+		vars.step = h;
+	}
+
+
+	// Model Loop, 'step' is simulated time in ms
+	for(step=vars.step; step<=modsteps; step+=h) {
+
+		// Secretion ring epoch free, a task that has to wait parks and continues at this step
+		if(netmod->secmode && netmod->plasmamode && netmod->SecPark(this, step - h + 1)) break;
+
+		ttime += h;
+
+		// Signal Input
+		if(noiamp) noisig = noimean + (noisig - noimean) * fNoise + noisd * rng.normal();
+		if(signalmode) {
+			synsig = noisig;
+			epsprate1 = synsig / 1000;
+			ipsprate1 = epsprate1 * sigIratio;
+		}
+		else {
+			synsig = psprate;
+			epsprate1 = 0;
+			ipsprate1 = 0;
+		}
+
+		// Synthesis Ca input, mean of the decaying Ca across the step
+		Cainput = (tCa - Ca_rest) * sumCa;
+
+		if(netmod->spikemode) {
+			nepsp = epspgen.Count(totalepsprate * h, rng);
+			nipsp = ipspgen.Count(totalipsprate * h, rng);
+			nepsp1 = epspgen1.Count(epsprate1 * h, rng);
+			nipsp1 = ipspgen1.Count(ipsprate1 * h, rng);
+			nepsp2 = epspgen2.Count(epsprate2 * h, rng);
+
+			// Arrivals spread across the step, mean and variance of their decay to the step end
+			inputPSP = (meanMem * (totalepsprate - totalipsprate) * h + sdMem * (nepsp - totalepsprate * h - nipsp + totalipsprate * h)) * pspmag;
+			inputPSP1 = (meanMem * (epsprate1 - ipsprate1) * h + sdMem * (nepsp1 - epsprate1 * h - nipsp1 + ipsprate1 * h)) * pspmag;
+
+			// NMDA feed from the decaying input, new input arrives at the step end
+			if(pspmag2) {
+				if(epspsynchflag) nepsp2 = nepsp;
+				pspsig = pspsig * fMem + tauPSP2 * (inputPSP2 * sumPSP2 + nepsp2 * pspmag2) + inputPSP + inputPSP1;
+				inputPSP2 = inputPSP2 * fPSP2 + nepsp2 * pspmag2;
+			}
+			else pspsig = pspsig * fMem + inputPSP + inputPSP1;
+
+			tHAP = tHAP * fHAP;
+			tDAP = tDAP * fDAP;
+			tAHP = tAHP * fAHP;
+			tAHP2 = tAHP2 * fAHP2;
+
+			tCa = Ca_rest + (tCa - Ca_rest) * fCa;
+			tDyno = tDyno * fDyno;
+
+			// store increments are positive, clamping at the step end matches clamping each ms
+			storeDyno = storeDyno + kstoreDyno * tdendCa * sumdendCa;
+			if(storeDyno > 10) storeDyno = 10;
+			tdendCa = tdendCa * fdendCa;
+
+			if(gKL != 0) {
+				KLact = vox_tanh((tCa - Ca_rest - tDyno) / ka);
+				IKL = gKL - gKL * KLact;
+			}
+			else IKL = 0;
+
+			V = Vrest + pspsig + gOsmo - tHAP - tAHP - tAHP2 + tDAP - IKL;
+		}
+
+		// Secretion, secX is the mean per ms rate across the step
+		if(netmod->secmode && !netmod->secfix) {
+			if(secExp == 3) secX = tE * tE * tE * alpha * tP * sumE;
+			if(secExp == 2) secX = tE * tE * alpha * tP * sumE;
+
+			tB = tB * fB;
+			tE = tE * fE;
+			tC = tC * fC;
+
+			EKpow = tE * tE * tE * tE * tE;
+			Einh = 1 - EKpow / (EKpow + Ethpow);
+			CKpow = tC * tC * tC;
+			Cinh = 1 - CKpow / (CKpow + Cthpow);
+			CaEnt = Einh * Cinh * (tB + Bbase);
+		}
+		if(netmod->secfix) secX = secXfix;
+
+		if(netmod->secmode && netmod->plasmamode) {
+			for(k=0; k<h; k++) secXbuffer[buffdex++] = secX / netmod->numneurons;
+			secRate1s += secX * h;
+			secRate60s += secX * h;
+			secRate600s += secX * h;
+		}
+
+		// Synthesis, shstep is h ms in seconds
+		stimTS += (kTS * 0.001 * Cainput - stimTS * tauTS) * shstep;
+		stimTL += (kTL * 0.001 * Cainput - stimTL * tauTL) * shstep;
+		synthrate = (stimTL + basalTL) * mRNAstore;
+		if(decaymode) mRNAstore += (synscale * stimTS - mRNAstore * mRNAtau) * shstep;
+		else mRNAstore += synscale * (stimTS - synthrate) * shstep;
+		if(mRNAmax && mRNAstore > mRNAmax) mRNAstore = mRNAmax;
+
+		if(!synthdel) fillR = rateSR * synthrate * 0.001 * 0.03;
+		else {
+			if(step/synthrecrate >= synthdel) fillR = rateSR * synthrec[step/synthrecrate - synthdel] * 0.001 * 0.03;
+			else fillR = rateSR * synthrec[0] * 0.001 * 0.03;
+		}
+
+		// Stores, per ms fill rates across the step
+		if(tP < Pmax) fillP = beta * tR / Rmax;
+		else fillP = 0;
+		tP = tP - (secX - fillP) * h;
+		tR = tR + (fillR - fillP) * h;
+
+		if(monitor) for(k=step-h+1; k<=step && k<1000000; k++) netmod->neurodata->pspsig[k] = pspsig;
+
+
+		// Progress and display
+		if(countflag && step / modsteps100 != (step - h) / modsteps100) {
+			progevent.SetInt(floor(ttime)/modsteps*100);
+			netbox->GetEventHandler()->AddPendingEvent(progevent);
+		}
+		if(step % 1000 == 0 && neuron->spikecount > 0) {
+			plotevent.SetInt(floor(ttime)/modsteps*100);
+			netbox->GetEventHandler()->AddPendingEvent(plotevent);
+			if((*netmod->netflags)["realtime"]) wxThread::Sleep(disprate);
+		}
+
+		// Plasma buffer and secretion recording
+		if(netmod->secmode && netmod->plasmamode) {
+			if(buffrate && step >= buffrate && step % buffrate == 0) {
+				netmod->SecFlush(worker, secXbuffer, buffdex, step, plasma_hstep, 1);
+				buffdex = 0;
+			}
+			if((step % 1000) == 0) {
+				neuron->Secretion[step/1000] = secRate1s;
+				secRate1s = 0;
+			}
+			if((step % 60000) == 0) {
+				neuron->secLong[step/60000] = secRate60s * 60 / 1000;
+				secRate60s = 0;
+			}
+			if((step % 600000) == 0) {
+				neuron->secHour[step/600000] = secRate600s * 6 / 1000;
+				secRate600s = 0;
+			}
+		}
+
+		if(step%1000 == 0 && step/1000 < magpop->maxtime) neuron->store[step/datsample] = tR;
+
+		// Neuron Monitor
+		if(monitor) {
+			if(step%100 == 0 && step<1000000) magpop->inputsignal[step/100] = synsig;
+			if(step % datsample == 0 && step < 1000000 * datsample) {
+				neurorecord->stimTS[step/datsample] = stimTS;
+				neurorecord->stimTL[step/datsample] = stimTL;
+				neurorecord->mRNAstore[step/datsample] = mRNAstore;
+				neurorecord->Ca[step/datsample] = tCa;
+			}
+		}
+
+		if(step < 60000 * maxtimeLong && step % 60000 == 0) {
+			neuron->storeLong[step/60000] = tR;
+			neuron->transLong[step/60000] = stimTS;
+			neuron->synthstoreLong[step/60000] = mRNAstore;
+			neuron->synthrateLong[step/60000] = fillR * 3600;
+			if(countflag) magpop->inputLong[step/60000] = synsig;
+		}
+
+		if(step%synthrecrate == 0) {
+			synthdex = step/synthrecrate;
+			if(synthdex > 100000) synthdex = synthdex % 100000;
+			synthrec[synthdex] = synthrate;
+		}
+
+
+		// Spiking, at most one spike per step
+		if(V > Vthresh && ttime >= absref) {
+			neuron->SpikeAdd(ttime);
+
+			tCa = tCa + kCa;
+			tAHP = tAHP + kAHP;
+			tHAP = tHAP + kHAP;
+			tDAP = tDAP + kDAP;
+
+			if(AHP2mode) {
+				if(tCa >= aAHP2) tAHP2 = tAHP2 + kAHP2 * (tCa - aAHP2);
+			}
+			else tAHP2 = tAHP2 + kAHP2;
+
+			if(netmod->secmode) {
+				tB = tB + kB;
+				tE = tE + kE * CaEnt;
+				tC = tC + kC * CaEnt;
+			}
+
+			if(dynostoreflag) {
+				if(storeDyno > spikeDyno) {
+					tDyno = tDyno + kDyno;
+					storeDyno = storeDyno - spikeDyno;
+				}
+			}
+			else tDyno = tDyno + kDyno;
+		}
+	}
+
+	// Parked at an epoch start, the secretion buffer has been flushed
+	if(step <= modsteps) {
+		vars.step = step;
+		state = vars;
+		delete [] secXbuffer;
+		return;
+	}
+	state.step = 0;
+
+	// Store final mRNA store and reserve store value for sequential runs
+	if(!neuron->netinit) {
+		neuron->mRNAinit = mRNAstore;
+		(*neuron->synthparams)["mRNAinit"] = mRNAstore;
+	}
+
+	if(!neuron->storereset) {
+		(*neuron->secparams)["Rinit"] = tR;
+		neuron->storeinit = tR;
+	}
+
+	delete [] secXbuffer;
+}
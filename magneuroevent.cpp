@@ -0,0 +1,601 @@
+/*
+*  magneuroevent.cpp
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*  Event driven integration of the neuromod() model
+*
+*  Between PSP arrivals the spiking variables only decay, each by a constant factor per step, so
+*  eventmod() advances them in closed form over a quiet span up to the next scheduled PSP arrival.
+*  A span is only jumped when an upper bound on V over the span stays below threshold, otherwise
+*  it is halved until the bound holds, down to single exact steps near threshold. Arrival, spike,
+*  and near threshold steps use the same update as neuromod().
+*
+*  Synthesis takes a quiet span in one exact update with the span's closed form Ca sum, as multi-rate
+*  synthesis in neuromod(). Secretion has no closed form and is stepped across each span, along with
+*  the stores, so with secretion on the event engine only saves the spiking and synthesis share of the
+*  run. Without it, or with fixed secX, the stores also take the span in closed form. Spans stop at
+*  recording boundaries.
+*
+*  Random draws are the same as the stepped engine, but the closed form decays round differently, so
+*  spike trains match statistically rather than bitwise. Runs with noise input, ramp protocols,
+*  pre-generated input, or osmotic sync fall back to neuromod().
+*
+*  Arrivals are always scheduled from exponential intervals here, the per-step Poisson counts used by
+*  the stepped engines (magpoisson.cpp) give no arrival times to jump to.
+*
+*/
+
+
+#include "magnetmod.h"
+#include <math.h>
+
+
+void MagNeuroMod::eventmod()
+{
+	int i, n, step;
+	int modsteps100, span;
+	int nextbound, recint;
+	int buffdex, synthdex;
+	bool quiet, countflag, monitor;
+	wxString text;
+
+	double epsprate, totalepsprate, totalipsprate;
+	double epsprate1, ipsprate1, epsprate2;
+	int nepsp, nipsp, nepsp1, nipsp1, nepsp2;
+	double inputPSP, inputPSP1;
+	double synsig;
+	double absref;
+
+	double tauMem, tauHAP, tauDAP, tauAHP, tauAHP2;
+	double tauCa, tauDyno, taudendCa, tauPSP2;
+	double tauB, tauE, tauC;
+	double fMem, fHAP, fDAP, fAHP, fAHP2, fCa, fDyno, fdendCa, fPSP2;
+	double powMem, powHAP, powDAP, powAHP, powAHP2, powCa, powDyno, powdendCa, powPSP2;
+	const double *decay[9];     // decay factor powers by span length, indexed as 'f' list above
+
+	double KLact;
+	double Vmax, pmax, camax, dynomin;
+
+	double Cinh, Einh, EKpow, CKpow, Ethpow, Cthpow;
+	double Casum, kfill, Req, gR, tRend, tPend;
+	bool storestep;
+
+	// Run state, a local copy saved back to 'state' when the task parks
+	MagNeuroState vars = state;
+	int &nextin = vars.nextin;
+	double &epspt = vars.epspt, &ipspt = vars.ipspt, &epspt1 = vars.epspt1, &ipspt1 = vars.ipspt1, &epspt2 = vars.epspt2;
+	double &inputPSP2 = vars.inputPSP2, &pspsig = vars.pspsig, &V = vars.V, &ttime = vars.ttime;
+	double &tCa = vars.tCa, &tdendCa = vars.tdendCa, &tHAP = vars.tHAP, &tDAP = vars.tDAP, &tAHP = vars.tAHP, &tAHP2 = vars.tAHP2;
+	double &tDyno = vars.tDyno, &storeDyno = vars.storeDyno, &IKL = vars.IKL;
+	double &tB = vars.tB, &tE = vars.tE, &tC = vars.tC, &tR = vars.tR, &tP = vars.tP, &CaEnt = vars.CaEnt, &secX = vars.secX;
+	double &secRate1s = vars.secRate1s, &secRate60s = vars.secRate60s, &secRate600s = vars.secRate600s;
+
+	int synthrecrate = 1000 * 60;
+	int datsample = netmod->mod->datsample;
+	double evtol = 1e-9;     // threshold margin for closed form rounding
+
+	// Unsupported modes, per-step random or time varying input
+	if(osmomode || noiamp || prototype == ramp || prototype == rampcurve || (*netmod->netflags)["inputgen"] || netmod->stawin) {
+		if(neurodex == 0 && !state.step) mod->DiagWrite("Event mode does not support noise, ramp, generated input, osmotic sync, or spike triggered averages, using stepped engine\n");
+		neuromod();
+		return;
+	}
+
+	tauMem = log((double)2) / halflifeMem;
+	tauHAP = log((double)2) / halflifeHAP;
+	tauDAP = log((double)2) / halflifeDAP;
+	tauAHP = log((double)2) / halflifeAHP;
+	tauAHP2 = log((double)2) / halflifeAHP2;
+	tauCa = log((double)2) / halflifeCa;
+	tauDyno = log((double)2) / halflifeDyno;
+	taudendCa = log((double)2) / halflifedendCa;
+	tauPSP2 = log((double)2) / halflifePSP2;
+	tauB = log((double)2) / halflifeB;
+	tauC = log((double)2) / halflifeC;
+	tauE = log((double)2) / halflifeE;
+	tauTS = log((double)2) / halflifeTS;
+	tauTL = log((double)2) / halflifeTL;
+	mRNAtau = log((double)2) / mRNAhalflife;
+
+	// Per step decay factors, the V bound needs monotone decay
+	fMem = 1 - tauMem;
+	fHAP = 1 - tauHAP;
+	fDAP = 1 - tauDAP;
+	fAHP = 1 - tauAHP;
+	fAHP2 = 1 - tauAHP2;
+	fCa = 1 - tauCa;
+	fDyno = 1 - tauDyno;
+	fdendCa = 1 - taudendCa;
+	fPSP2 = 1 - tauPSP2 * hstep;
+
+	if(fMem < 0 || fHAP < 0 || fDAP < 0 || fAHP < 0 || fAHP2 < 0 || fCa < 0 || fDyno < 0 || fdendCa < 0
+		|| (pspmag2 && (fPSP2 < 0 || fPSP2 >= 1)) || gKL < 0 || (gKL && ka <= 0)) {
+		if(neurodex == 0 && !state.step) mod->DiagWrite("Event mode needs half-lives above 1 step, gKL >= 0 and ka > 0 with gKL, using stepped engine\n");
+		neuromod();
+		return;
+	}
+
+	countflag = neurodex == 0;
+	monitor = countflag && netmod->neurorec;
+	modsteps100 = netmod->runtime * 1000 / 100;
+
+	// Span boundaries, every recording and buffer flush step ends a span
+	recint = 1000;
+	if(netmod->secmode && netmod->plasmamode && buffrate) recint = stepgcd(recint, buffrate);
+	if(countflag) recint = stepgcd(stepgcd(recint, datsample), modsteps100);
+
+	// Span lengths are at most recint, decay powers are tabulated once per run and shared by neurons with the same factors
+	const double *decaytab = netmod->EventDecay({fMem, fHAP, fDAP, fAHP, fAHP2, fCa, fDyno, fdendCa, fPSP2}, recint);
+	for(i=0; i<9; i++) decay[i] = decaytab + i * (recint + 1);
+
+	wxCommandEvent progevent(wxEVT_COMMAND_TEXT_UPDATED, ID_Progress);
+	wxCommandEvent plotevent(wxEVT_COMMAND_TEXT_UPDATED, ID_Display);
+
+	double *secXbuffer = new double[buffrate];
+	buffdex = 0;
+
+	// Input rates, constant in event mode
+	epsprate = psprate / 1000;
+	totalepsprate = epsprate * synvar;
+	totalipsprate = epsprate * iratio * synvar;
+	epsprate2 = psprate2 / 1000;
+	if(signalmode) {
+		synsig = noimean;
+		epsprate1 = synsig / 1000;
+		ipsprate1 = epsprate1 * sigIratio;
+	}
+	else {
+		synsig = psprate;
+		epsprate1 = 0;
+		ipsprate1 = 0;
+	}
+	absref = 2;
+
+	Ethpow = Ethresh * Ethresh * Ethresh * Ethresh * Ethresh;
+	Cthpow = Cthresh * Cthresh * Cthresh;
+
+	// Initialise on the first run, a parked task continues from its saved state
+	if(!vars.step) {
+		rng.seed(static_cast<uint64_t>(modseed), static_cast<uint64_t>(neurodex));
+
+		epspt = 0;
+		ipspt = 0;
+		epspt1 = 0;
+		ipspt1 = 0;
+		epspt2 = 0;
+		inputPSP2 = 0;
+		pspsig = 0;
+		ttime = 0;
+		tHAP = 0;
+		tDAP = 0;
+		tAHP = 0;
+		tAHP2 = 0;
+		tCa = Ca_rest;
+		tdendCa = 0;
+		tDyno = 0;
+		storeDyno = 0.6;
+		V = Vrest;
+		netmod->OsmoPress = BasalNaConc * 2;
+
+		tR = Rinit;
+		tP = Pmax;
+		tB = 0;
+		tE = 0;
+		tC = 0.03;
+		CaEnt = 0;
+
+		stimTS = 0;
+		stimTL = 0;
+		mRNAstore = mRNAinit;
+		synthrec.assign((modsteps / synthrecrate < 100000 ? modsteps / synthrecrate : 100000) + 1, 0);
+
+		secRate1s = 0;
+		secRate60s = 0;
+		secRate600s = 0;
+		secX = 0;
+
+		neuron->spikecount = 0;
+		neuron->spikecount2 = 0;
+		neuron->stats.RunSize(netmod->runtime, netmod->spikestats);
+		for(i=0; i<modsteps/1000; i++) neuron->Secretion[i] = 0;
+
+		// Record Initial Values
+		neuron->storeLong[0] = tR;
+		neuron->transLong[0] = 0;
+		neuron->synthstoreLong[0] = mRNAstore;
+		neuron->synthrateLong[0] = rateSR * (stimTL + basalTL) * synscale * mRNAstore * 3600;
+		if(countflag) {
+			neurorecord->stimTL[0] = stimTL;
+			neurorecord->stimTS[0] = stimTS;
+			neurorecord->mRNAstore[0] = mRNAstore;
+			neurorecord->Ca[0] = Ca_rest;
+			magpop->inputsignal[0] = psprate;
+			magpop->inputLong[0] = psprate;
+		}
+
+		nextin = 1;     // first step runs exact to draw initial arrivals
+		vars.step = 1;
+	}
+
+
+	// Model Loop
+	step = vars.step;
+	while(step <= modsteps) {
+
+		// Secretion ring epoch free at the start of a span block, a task that has to wait parks and continues here
+		if(netmod->secmode && netmod->plasmamode && (step - 1) % recint == 0 && netmod->SecPark(this, step)) break;
+
+		// Quiet span, steps before the next PSP arrival, bounded by recording and run end
+		// Neuron 0 steps exactly while recording per-step pspsig
+		span = 0;
+		quiet = false;
+		if(netmod->spikemode && step < nextin && ttime >= absref && !(monitor && step < 1000000)) {
+			nextbound = ((step + recint - 1) / recint) * recint;
+			span = nextin - step;
+			if(span > nextbound - step + 1) span = nextbound - step + 1;
+			if(span > modsteps - step + 1) span = modsteps - step + 1;
+
+			// Shrink span until V upper bound is below threshold
+			// Each decaying term is bounded by its start and end values, pspsig also by the NMDA feed
+			while(span >= 2) {
+				powMem = decay[0][span];
+				powHAP = decay[1][span];
+				powDAP = decay[2][span];
+				powAHP = decay[3][span];
+				powAHP2 = decay[4][span];
+				powCa = decay[5][span];
+				powDyno = decay[6][span];
+
+				pmax = pspsig;
+				if(pspsig * powMem > pmax) pmax = pspsig * powMem;
+				if(pspmag2 && inputPSP2 > 0) pmax += inputPSP2 * fPSP2 / hstep;
+
+				camax = tCa - Ca_rest;
+				if((tCa - Ca_rest) * powCa > camax) camax = (tCa - Ca_rest) * powCa;
+				dynomin = tDyno;
+				if(tDyno * powDyno < dynomin) dynomin = tDyno * powDyno;
+
+				Vmax = Vrest + pmax + gOsmo
+					- (tHAP < tHAP * powHAP ? tHAP : tHAP * powHAP)
+					- (tAHP < tAHP * powAHP ? tAHP : tAHP * powAHP)
+					- (tAHP2 < tAHP2 * powAHP2 ? tAHP2 : tAHP2 * powAHP2)
+					+ (tDAP > tDAP * powDAP ? tDAP : tDAP * powDAP);
+				if(gKL) Vmax -= gKL - gKL * vox_tanh((camax - dynomin) / ka);
+
+				if(Vmax < Vthresh - evtol) break;
+				span = span / 2;
+			}
+			if(span >= 2) quiet = true;
+		}
+		if(!quiet) span = 1;
+
+		if(quiet) {
+			// Closed form spiking decays, the Ca sum over the span feeds the synthesis update below
+			Casum = (tCa - Ca_rest) * fCa * (1 - powCa) / (1 - fCa);
+			tCa = Ca_rest + (tCa - Ca_rest) * powCa;
+			if(pspmag2) {
+				powPSP2 = decay[8][span];
+				if(fabs(fMem - fPSP2) > 1e-12) pspsig = powMem * pspsig + tauPSP2 * inputPSP2 * fPSP2 * (powMem - powPSP2) / (fMem - fPSP2);
+				else pspsig = powMem * pspsig + tauPSP2 * inputPSP2 * span * powMem;
+				inputPSP2 = inputPSP2 * powPSP2;
+			}
+			else pspsig = pspsig * powMem;
+
+			tHAP = tHAP * powHAP;
+			tDAP = tDAP * powDAP;
+			tAHP = tAHP * powAHP;
+			tAHP2 = tAHP2 * powAHP2;
+			tDyno = tDyno * powDyno;
+
+			if(tdendCa) {
+				powdendCa = decay[7][span];
+				storeDyno = storeDyno + kstoreDyno * tdendCa * fdendCa * (1 - powdendCa) / (1 - fdendCa);
+				if(storeDyno > 10) storeDyno = 10;
+				tdendCa = tdendCa * powdendCa;
+			}
+
+			if(totalepsprate > 0) epspt -= span * hstep;
+			if(totalipsprate > 0) ipspt -= span * hstep;
+			if(epsprate1 > 0) epspt1 -= span * hstep;
+			if(ipsprate1 > 0) ipspt1 -= span * hstep;
+			if(epsprate2 > 0) epspt2 -= span * hstep;
+			ttime += span;
+		}
+		else {
+			// Exact step, as neuromod()
+			ttime++;
+
+			if(netmod->spikemode) {
+				nepsp = 0;
+				nipsp = 0;
+				nepsp1 = 0;
+				nipsp1 = 0;
+				nepsp2 = 0;
+
+				if(totalepsprate > 0) {
+					while(epspt < hstep) {
+						nepsp++;
+						epspt = rng.exponential() / totalepsprate + epspt;
+					}
+					epspt = epspt - hstep;
+				}
+				if(totalipsprate > 0) {
+					while(ipspt < hstep) {
+						nipsp++;
+						ipspt = rng.exponential() / totalipsprate + ipspt;
+					}
+					ipspt = ipspt - hstep;
+				}
+				if(epsprate1 > 0) {
+					while(epspt1 < hstep) {
+						nepsp1++;
+						epspt1 = rng.exponential() / epsprate1 + epspt1;
+					}
+					epspt1 = epspt1 - hstep;
+				}
+				if(ipsprate1 > 0) {
+					while(ipspt1 < hstep) {
+						nipsp1++;
+						ipspt1 = rng.exponential() / ipsprate1 + ipspt1;
+					}
+					ipspt1 = ipspt1 - hstep;
+				}
+				if(epsprate2 > 0) {
+					while(epspt2 < hstep) {
+						nepsp2++;
+						epspt2 = rng.exponential() / epsprate2 + epspt2;
+					}
+					epspt2 = epspt2 - hstep;
+				}
+
+				// Next arrival step over active input streams
+				nextin = modsteps + 1;
+				if(totalepsprate > 0 && step + 1 + (int)(epspt / hstep) < nextin) nextin = step + 1 + (int)(epspt / hstep);
+				if(totalipsprate > 0 && step + 1 + (int)(ipspt / hstep) < nextin) nextin = step + 1 + (int)(ipspt / hstep);
+				if(epsprate1 > 0 && step + 1 + (int)(epspt1 / hstep) < nextin) nextin = step + 1 + (int)(epspt1 / hstep);
+				if(ipsprate1 > 0 && step + 1 + (int)(ipspt1 / hstep) < nextin) nextin = step + 1 + (int)(ipspt1 / hstep);
+				if(epsprate2 > 0 && step + 1 + (int)(epspt2 / hstep) < nextin) nextin = step + 1 + (int)(epspt2 / hstep);
+
+				inputPSP = nepsp * pspmag - nipsp * pspmag;
+				inputPSP1 = nepsp1 * pspmag - nipsp1 * pspmag;
+
+				if(pspmag2) {
+					if(epspsynchflag) nepsp2 = nepsp;
+					inputPSP2 = inputPSP2 - (inputPSP2 * tauPSP2) * hstep + nepsp2 * pspmag2;
+				}
+
+				pspsig = pspsig + (inputPSP2 * tauPSP2 - pspsig * tauMem) + inputPSP + inputPSP1;
+
+				tHAP = tHAP - (tHAP * tauHAP);
+				tDAP = tDAP - (tDAP * tauDAP);
+				tAHP = tAHP - (tAHP * tauAHP);
+				tAHP2 = tAHP2 - (tAHP2 * tauAHP2);
+
+				tCa = tCa - (tCa - Ca_rest) * tauCa;
+				tDyno = tDyno - tDyno * tauDyno;
+
+				tdendCa = tdendCa - tdendCa * taudendCa;
+				storeDyno = storeDyno + kstoreDyno * tdendCa;
+				if(storeDyno > 10) storeDyno = 10;
+
+				// no IKL without gKL, as oxytocin cells
+				if(gKL) {
+					KLact = vox_tanh((tCa - Ca_rest - tDyno) / ka);
+					IKL = gKL - gKL * KLact;
+				}
+				else IKL = 0;
+
+				V = Vrest + pspsig + gOsmo - tHAP - tAHP - tAHP2 + tDAP - IKL;
+			}
+		}
+
+
+		// Synthesis, exact update with the span's mean Ca input, Euler step as neuromod() for exact steps
+		if(quiet) SynthUpdate(Casum / span, span);
+		else {
+			stimTS += (kTS * 0.001 * (tCa - Ca_rest) - stimTS * tauTS) * shstep;
+			stimTL += (kTL * 0.001 * (tCa - Ca_rest) - stimTL * tauTL) * shstep;
+			synthrate = (stimTL + basalTL) * mRNAstore;
+			if(decaymode) mRNAstore += (synscale * stimTS - mRNAstore * mRNAtau) * shstep;
+			else mRNAstore += synscale * (stimTS - synthrate) * shstep;
+			if(mRNAmax && mRNAstore > mRNAmax) mRNAstore = mRNAmax;
+		}
+
+		// One fill rate across the span, taken at its first step
+		if(!synthdel) fillR = rateSR * synthrate * 0.001 * 0.03;
+		else {
+			if(step/synthrecrate >= synthdel) fillR = rateSR * synthrec[step/synthrecrate - synthdel] * 0.001 * 0.03;
+			else fillR = rateSR * synthrec[0] * 0.001 * 0.03;
+		}
+
+		// Secretion and stores, stepped across the span while secX varies
+		if(netmod->secmode && !netmod->secfix) {
+			for(n=0; n<span; n++) {
+				tB = tB - (tB * tauB);
+				tE = tE - (tE * tauE);
+				tC = tC - (tC * tauC);
+
+				EKpow = tE * tE * tE * tE * tE;
+				Einh = 1 - EKpow / (EKpow + Ethpow);
+				CKpow = tC * tC * tC;
+				Cinh = 1 - CKpow / (CKpow + Cthpow);
+				CaEnt = Einh * Cinh * (tB + Bbase);
+
+				if(secExp == 3) secX = tE * tE * tE * alpha * tP;
+				if(secExp == 2) secX = tE * tE * alpha * tP;
+
+				if(netmod->plasmamode) {
+					secXbuffer[buffdex++] = secX / netmod->numneurons;
+					secRate1s += secX;
+					secRate60s += secX;
+					secRate600s += secX;
+				}
+
+				if(tP < Pmax) fillP = beta * tR / Rmax;
+				else fillP = 0;
+				tP = tP - secX + fillP;
+				tR = tR + fillR - fillP;
+			}
+		}
+		else {
+			if(netmod->secfix) secX = secXfix;
+
+			if(netmod->secmode && netmod->plasmamode) {
+				for(n=0; n<span; n++) secXbuffer[buffdex++] = secX / netmod->numneurons;
+				secRate1s += span * secX;
+				secRate60s += span * secX;
+				secRate600s += span * secX;
+			}
+
+			// Constant secX and fillR, stores in closed form while the P fill stays off, or on throughout the span
+			// With the fill on tR relaxes geometrically to fillR / kfill, so tP is monotone or convex and bounded by its end values
+			kfill = beta / Rmax;
+			storestep = false;
+			if(!kfill || (tP >= Pmax && secX <= 0)) {
+				fillP = 0;
+				tP = tP - span * secX;
+				tR = tR + span * fillR;
+			}
+			else if(tP < Pmax && span > 1) {
+				Req = fillR / kfill;
+				gR = pow(1 - kfill, span - 1);
+				tRend = Req + (tR - Req) * gR;     // tR and tP before the last step
+				tPend = tP + (span - 1) * (fillR - secX) + (tR - Req) * (1 - gR);
+				if(tPend < Pmax && !(kfill * tR > secX && kfill * tRend < secX)) {
+					fillP = kfill * tRend;
+					tP = tPend - secX + fillP;
+					tR = tRend + fillR - fillP;
+				}
+				else storestep = true;
+			}
+			else storestep = true;
+
+			if(storestep) for(n=0; n<span; n++) {
+				if(tP < Pmax) fillP = beta * tR / Rmax;
+				else fillP = 0;
+				tP = tP - secX + fillP;
+				tR = tR + fillR - fillP;
+			}
+		}
+
+		step += span - 1;     // last step of the span, recording as neuromod()
+
+
+		// Progress and display
+		if(countflag && step % modsteps100 == 0) {
+			progevent.SetInt(floor(ttime)/modsteps*100);
+			netbox->GetEventHandler()->AddPendingEvent(progevent);
+		}
+		if(step % 1000 == 0 && neuron->spikecount > 0) {
+			plotevent.SetInt(floor(ttime)/modsteps*100);
+			netbox->GetEventHandler()->AddPendingEvent(plotevent);
+			if((*netmod->netflags)["realtime"]) wxThread::Sleep(disprate);
+		}
+
+		// Plasma buffer and secretion recording
+		if(netmod->secmode && netmod->plasmamode) {
+			if(buffrate && step >= buffrate && step % buffrate == 0) {
+				netmod->SecFlush(worker, secXbuffer, buffdex, step, plasma_hstep, 1);
+				buffdex = 0;
+			}
+			if((step % 1000) == 0) {
+				neuron->Secretion[step/1000] = secRate1s;
+				secRate1s = 0;
+			}
+			if((step % 60000) == 0) {
+				neuron->secLong[step/60000] = secRate60s * 60 / 1000;
+				secRate60s = 0;
+			}
+			if((step % 600000) == 0) {
+				neuron->secHour[step/600000] = secRate600s * 6 / 1000;
+				secRate600s = 0;
+			}
+		}
+
+		if(step%1000 == 0 && step/1000 < magpop->maxtime) neuron->store[step/datsample] = tR;
+
+		// Neuron Monitor
+		if(monitor) {
+			if(step%100 == 0 && step<1000000) magpop->inputsignal[step/100] = synsig;
+			if(step < 1000000) netmod->neurodata->pspsig[step] = pspsig;
+			if(step % datsample == 0 && step < 1000000 * datsample) {
+				neurorecord->stimTS[step/datsample] = stimTS;
+				neurorecord->stimTL[step/datsample] = stimTL;
+				neurorecord->mRNAstore[step/datsample] = mRNAstore;
+				neurorecord->Ca[step/datsample] = tCa;
+			}
+		}
+
+		if(step < 60000 * maxtimeLong && step % 60000 == 0) {
+			neuron->storeLong[step/60000] = tR;
+			neuron->transLong[step/60000] = stimTS;
+			neuron->synthstoreLong[step/60000] = mRNAstore;
+			neuron->synthrateLong[step/60000] = fillR * 3600;
+			if(countflag) magpop->inputLong[step/60000] = synsig;
+		}
+
+		if(step%synthrecrate == 0) {
+			synthdex = step/synthrecrate;
+			if(synthdex > 100000) synthdex = synthdex % 100000;
+			synthrec[synthdex] = synthrate;
+		}
+
+
+		// Spiking, exact steps only, quiet spans are below threshold
+		if(!quiet && V > Vthresh && ttime >= absref) {
+			neuron->SpikeAdd(ttime);
+
+			tCa = tCa + kCa;
+			tAHP = tAHP + kAHP;
+			tHAP = tHAP + kHAP;
+			tDAP = tDAP + kDAP;
+
+			if(AHP2mode) {
+				if(tCa >= aAHP2) tAHP2 = tAHP2 + kAHP2 * (tCa - aAHP2);
+			}
+			else tAHP2 = tAHP2 + kAHP2;
+
+			if(netmod->secmode) {
+				tB = tB + kB;
+				tE = tE + kE * CaEnt;
+				tC = tC + kC * CaEnt;
+			}
+
+			if(dynostoreflag) {
+				if(storeDyno > spikeDyno) {
+					tDyno = tDyno + kDyno;
+					storeDyno = storeDyno - spikeDyno;
+				}
+			}
+			else tDyno = tDyno + kDyno;
+		}
+
+		step++;
+	}
+
+	// Parked at an epoch start, the secretion buffer has been flushed
+	if(step <= modsteps) {
+		vars.step = step;
+		state = vars;
+		delete [] secXbuffer;
+		return;
+	}
+	state.step = 0;
+
+	// Store final mRNA store and reserve store value for sequential runs
+	if(!neuron->netinit) {
+		neuron->mRNAinit = mRNAstore;
+		(*neuron->synthparams)["mRNAinit"] = mRNAstore;
+	}
+
+	if(!neuron->storereset) {
+		(*neuron->secparams)["Rinit"] = tR;
+		neuron->storeinit = tR;
+	}
+
+	delete [] secXbuffer;
+}
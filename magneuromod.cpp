@@ -17,20 +17,7 @@
 #include "hyporand.h"
 
 
-
-inline double vox_tanh( const double x )
-{
-	const double ax = fabs( x );
-	const double x2 = x * x;
-	const double z = x * ( 1.0 + ax +
-		( 1.05622909486427 + 0.215166815390934 * x2 * ax ) * x2 );
-
-	return( z / ( 1.02718982441289 + fabs( z )));
-}
-
-
 MagNeuroMod::MagNeuroMod(int index, MagNeuron *magneuron, MagNetModel *magnetmodel)
-	: wxThread(wxTHREAD_JOINABLE)
 {
 	wxString text;
 
@@ -170,6 +157,7 @@ MagNeuroMod::MagNeuroMod(int index, MagNeuron *magneuron, MagNetModel *magnetmod
 	plasma_hstep = (*secparams)["plasma_hstep"];
 	secXfix = (*secparams)["secXfix"];
 	secfix = (*secflags)["secfix"];
+	expinput = (*netmod->netflags)["expinput"];
 
 	// Synthesis
 	//vsynrate = (*synthparams)["vsynrate"];  
@@ -194,6 +182,8 @@ MagNeuroMod::MagNeuroMod(int index, MagNeuron *magneuron, MagNetModel *magnetmod
 	scalemode = (*synthflags)["scalemode"];
 	polymode = (*synthflags)["polymode"];
 	decaymode = (*synthflags)["decaymode"];
+	synthmulti = (*synthflags)["synthmulti"];
+	synthstep = (*synthparams)["synthstep"];
 
 	// Dynamic Dynorphin Parameters
 	kstoreDyno = (*dendparams)["kstoreDyno"];
@@ -225,7 +215,7 @@ MagNeuroMod::MagNeuroMod(int index, MagNeuron *magneuron, MagNetModel *magnetmod
 }
 
 
-void *MagNeuroMod::Entry()
+void MagNeuroMod::RunTask()
 {
 	wxString text;
 
@@ -233,41 +223,65 @@ void *MagNeuroMod::Entry()
 	net->mod->diagbox->Write(text.Format("Cell %d running\n", celldex));
 	net->diagmute->Unlock();*/
 
-	neuromod();
+	if(hstep != 1) coarsemod();
+	else if(netmod->eventmode && probes.empty()) eventmod();     // probes record from the stepped loop
+	else neuromod();
+	if(!parkfront) netmod->NeuronDone(neurodex);     // parked tasks continue when requeued
 
 	/*net->diagmute->Lock();
 	net->mod->diagbox->Write(text.Format("Cell %d finished\n", celldex));
 	net->diagmute->Unlock();*/
-
-	return NULL;
 }
 
 
+// Mode flag test, constant in specialised variants so dead paths compile out, runtime for MAGMODE_GENERIC
+#define MODEFLAG(flag) ((MODE & MAGMODE_GENERIC) ? (runmode & (flag)) != 0 : (MODE & (flag)) != 0)
+
+
 // Neural model code including integrated spiking, secretion, and synthesis models
 
-void MagNeuroMod::neuromod() 
+template<int MODE> void MagNeuroMod::neuromodloop() 
 {
 	int i, step;
 	int runtime, runtime100;
+	int blockstart, blockend, blocksize;
+	double synthrecval, synthrecend;
+	bool recpsp;
+
+	// Run state, a local copy saved back to 'state' when the task parks
+	MagNeuroState vars = state;
+	int &spikestep = vars.spikestep, &synthlast = vars.synthlast, &inputdone = vars.inputdone;
+	int &nepsp = vars.nepsp, &nipsp = vars.nipsp;
+	bool &flagError = vars.flagError;
+	double &epspt = vars.epspt, &ipspt = vars.ipspt, &epspt1 = vars.epspt1, &ipspt1 = vars.ipspt1, &epspt2 = vars.epspt2;
+	double &inputPSP2 = vars.inputPSP2, &pspsig = vars.pspsig, &V = vars.V;
+	double &tCa = vars.tCa, &tdendCa = vars.tdendCa, &tHAP = vars.tHAP, &tDAP = vars.tDAP, &tAHP = vars.tAHP, &tAHP2 = vars.tAHP2;
+	double &tDyno = vars.tDyno, &storeDyno = vars.storeDyno, &IKL = vars.IKL;
+	double &tB = vars.tB, &tE = vars.tE, &tC = vars.tC, &tR = vars.tR, &tP = vars.tP, &CaEnt = vars.CaEnt, &secX = vars.secX;
+	double &ttime = vars.ttime, &neurotime = vars.neurotime;
+	double &noisig = vars.noisig, &synsig = vars.synsig, &epsprate = vars.epsprate;
+	double &OsmoPress = vars.OsmoPress, &IrOsmoPress = vars.IrOsmoPress;     // instantaneous osmotic pressure and its PSP change
+	double &secRate1s = vars.secRate1s, &secRate60s = vars.secRate60s, &secRate600s = vars.secRate600s, &plasmaRate1s = vars.plasmaRate1s;
+	double &Casum = vars.Casum, &spikeCa = vars.spikeCa;
+
+	// Multi-rate synthesis
+	bool multirate, fastpath;
 	wxString text;
 	unsigned int seed; 
 	double erand, irand;
-	int maxspikes;
-	bool flagError = false;
+	int inputoff;
+	unsigned char inputE[1000], inputI[1000];     // network input counts for the block
 	//sfmt_t sfmt;   // new SFMT random number generator  July 2020
 
-	double epspt, ipspt;
 	double pspRatio;
-	int nepsp, nipsp;
-	double epspt1, ipspt1;
 	int nepsp1, nipsp1;
 
 	double inputPSP, inputPSP1;
-	double ttime, neurotime;
-	bool monitor = true;
+	bool monitor = netmod->neurorec;
+	MagSTA *sta = NULL;
 	bool countflag = false;
 
-	double epsprate, totalepsprate, epspmag;
+	double totalepsprate, epspmag;
 	double ipsprate, totalipsprate, ipspmag;
 	double tauMem;
 	double tauHAP;
@@ -276,55 +290,35 @@ void MagNeuroMod::neuromod()
 	double tauCa, tauDyno;
 	double taudendCa;
 	double absref;
-	double IKL, KLact;
+	double KLact;
 
 	double tauB, tauE, tauC;
 	double tauClear, tauDiff;
 
 	// NMDA synapse EPSPs - new February 2020
-	double epspt2;        
 	int nepsp2;
 	double epsprate2, epspmag2;
-	double inputPSP2;
 	double tauPSP2;
 
 	double inputOsmo;
 
 	// Variables
-	double pspsig;
-	double V;
-	double tCa, tdendCa;
-	double tHAP;
-	double tDAP;
-	double tAHP, tAHP2;
-	double tDyno, storeDyno;
-
-	double tB;
-	double tE, tC;
-	double tR, tP;
 	double tOxyPlasma, tOxyEVF;
-	double CaEnt, Cinh, Einh;
-	double secX, secBinX, DiffRate;
+	double Cinh, Einh;
+	double secBinX, DiffRate;
 	double oldsecX;   // used for updating summed population secretion
 	double netsecX; 
 	double EKpow, CKpow;
 	double Ethpow, Cthpow;
 
-	double secRate1s, plasmaRate1s;
-	double secRate60s, secRate600s;       // new 24/2/21 for vaso synth figures
 	double netsecRate1s, netplasmaRate1s;
 
-	double OsmoPress;  // Instantaneous osmotic pressure
-	double IrOsmoPress;  // Instantaneous PSP change due to the osmotic pressure
 	double OsmoSetPoint, OsmoShift;  // Set point for homeostatic osmolality. Set at 302,5 m-osmole/kg
 
 	int buffdex;
 	double *secXbuffer = new double[buffrate];
-	double *secXpop = magpop->secX.data.data();
 
-	double synsig, noisig;
 	double epsprate1, ipsprate1;
-	int inputgen;
 	double rampinput;
 
 	clock_t timestart, timerun;
@@ -334,8 +328,6 @@ void MagNeuroMod::neuromod()
 	int synthdex;
 	int synthrecrate = 1000 * 60;
 
-	maxspikes = neuron->maxspikes;
-
 	int datsample = netmod->mod->datsample;
 	//if(celldex == netmod->currentcell) countflag = true; 
 	if(neurodex == 0) {
@@ -349,8 +341,6 @@ void MagNeuroMod::neuromod()
 	runtime = netmod->runtime * 1000;
 	runtime100 = runtime / 100;
 
-	inputgen = (*netmod->netflags)["inputgen"];
-
 	//FILE *tofp = fopen("oxynetneuromod.txt", "w");
 
 
@@ -397,137 +387,165 @@ void MagNeuroMod::neuromod()
 	tauTL = log((double)2) / halflifeTL;
 	mRNAtau = log((double)2) / mRNAhalflife;
 
-	double *synthrec = new double[35000];  // record synthrate for delay recall, minute sampled capacity for 24 days
-
-
-	// initialise random number generator
-	//seed = modseed + neurodex;
-	//seed = 1568637350;
-	//para_init_mrand(neurodex, seed);
-	//sfmt_init_gen_rand(&sfmt, seed);
-
-	//thread_local std::mt19937 randgen(seed);
-	//std::uniform_real_distribution<double> unif01(0, 1);
-    
-    rng.seed(static_cast<uint64_t>(modseed), static_cast<uint64_t>(neurodex));
-
-
-
-	// random number test
-	
-	//for(i=0; i<10; i++) {
-	//	erand = sfmt_genrand_real2(&sfmt);
-	//	mod->diagbox->Write(text.Format("SFMT random %.4f\n", erand));
-	//}
-
-	//std::mt19937 randmt (seed);
-	//std::uniform_real_distribution<double> dis (0.0, 1.0);
-	//double randomRealBetweenZeroAndOne = dis(generator);
-
-	//seed = (unsigned)(time(NULL));
-	//para_init_mrand(neurodex, seed + neurodex);  // is it starting randomly from one of the neurones?
-
-	// Initialise
-	totalepsprate = 0;
-	totalipsprate = 0;
-	epspt = 0;
-	ipspt = 0;
-	epspt1 = 0;
-	ipspt1 = 0;
-	pspsig = 0;
-	ttime = 0;
-	neurotime = 0;
-	tHAP = 0;
-	tDAP = 0;
-	tAHP = 0;
-	tAHP2 = 0;
-	tCa = Ca_rest;
-	tdendCa = 0;
-	tDyno = 0;
-	storeDyno = 0.6;
-	V = Vrest;
-
-	// NMDA PSP
-	epspt2 = 0;
-	inputPSP2 = 0;
-
-	// Osmotic pressure
-	OsmoSetPoint = BasalNaConc * 2;
-	OsmoPress = OsmoSetPoint;
-	netmod->OsmoPress = OsmoSetPoint;
-	if(osmomode) IrOsmoPress = (26 * (OsmoPress - 303)) / 1000; // differential PSP due to the hyperosmotic injection
-	else IrOsmoPress = 0;
-
-	/*if (OsmoTimeIv*1000 < modsteps) FlagOsmoIv = true;
-	else FlagOsmoIv = false;*/
-
-	// Secretion model
-	tR = Rinit;  // Reserve Pool
-	tP = Pmax;  // Releasable Pool 
+	// Constants
 	tOxyPlasma = 0;
 	tOxyEVF = 0;
-	tB = 0;  // Broadening
-	tE = 0;  // Fast Ca2+
-	tC = 0.03; // Slow Ca2+
-
 	Ethpow = Ethresh * Ethresh * Ethresh * Ethresh * Ethresh;  // precalculate instead of each loop
 	Cthpow = Cthresh * Cthresh * Cthresh;
+	OsmoSetPoint = BasalNaConc * 2;
 
-	// Synthesis
-	stimTS = 0;
-	stimTL = 0;
-	mRNAstore = mRNAinit;
-	synthrec[0] = 0;
+	// Multi-rate synthesis, stimTS, stimTL, and mRNAstore advanced every 'synthstep' ms
+	// Without spiking there is no Ca input and secretion is constant, zero or secXfix, so the fast path
+	// skips the model dynamics and only steps the store and per step records
+	multirate = synthmulti && synthstep > 1;
+	fastpath = multirate && !MODEFLAG(MAGMODE_SPIKE) && !noiamp && Vrest <= Vthresh;
 
 	// Population secretion and plasma
 	secBinX = 0;
-	secRate1s = 0;
-	secRate60s = 0;
-	secRate600s = 0;
-	plasmaRate1s = 0;
 	netsecRate1s = 0;     // For neuron 0 recording population secretion and plasma in 1s window
 	netplasmaRate1s = 0;
-	secX = 0;
 	oldsecX = 0;
 	buffdex = 0;
+	totalepsprate = 0;
+	totalipsprate = 0;
+	if(netmod->stawin) sta = &neuron->sta;
 
-	neuron->spikecount = 0;
-	neuron->spikecount2 = 0;
+	// Initialise on the first run, a parked task continues from its saved state
+	if(!vars.step) {
 
-	noisig = noimean;
+		// initialise random number generator
+		//seed = modseed + neurodex;
+		//seed = 1568637350;
+		//para_init_mrand(neurodex, seed);
+		//sfmt_init_gen_rand(&sfmt, seed);
 
-	for(double i=0; i<(modsteps/1000); i++) {
-		neuron->Secretion[i] = 0;
-		//neuron->OxyPlasma[i] = 0;		
-	}
+		//thread_local std::mt19937 randgen(seed);
+		//std::uniform_real_distribution<double> unif01(0, 1);
+    
+		rng.seed(static_cast<uint64_t>(modseed), static_cast<uint64_t>(neurodex));
 
-	// Record Initial Values
-	neuron->storeLong[0] = tR;
-	neuron->transLong[0] = 0;
-	neuron->synthstoreLong[0] = mRNAstore;
-	neuron->synthrateLong[0] = rateSR * (stimTL + basalTL) * synscale * mRNAstore * 3600;
-	neurorecord->stimTL[0] = stimTL;
-	neurorecord->stimTS[0] = stimTS;
-	neurorecord->mRNAstore[0] = mRNAstore;
-	neurorecord->Ca[0] = Ca_rest;
-	magpop->inputsignal[0] = psprate;
-	if(prototype == ramp || prototype == rampcurve) magpop->inputLong[0] = rampbase;
-	else magpop->inputLong[0] = psprate;
-
-	// Diagnostic
-	if(netmod->diag && neurodex == 0) {
-		TextFile diagfile;
-		diagfile.New("oxynetcelldiag.txt");
-		diagfile.WriteLine(text.Format("oxynet cell %d running for %d steps\n", neurodex, modsteps));
-		diagfile.WriteLine(text.Format("Vrest %.2f  Vthresh %.2f\n", Vrest, Vthresh));
-		diagfile.WriteLine(text.Format("tauMem %.4f  tauHAP %.4f  tauAHP %.4f\n", tauMem, tauHAP, tauAHP));
-		diagfile.WriteLine(text.Format("kCa %.4f  tauCa %.4f  kDyno %.4f  tauDyno %.4f\n", kCa, tauCa, kDyno, tauDyno));
-		diagfile.Close();
-	}
 
-	//fprintf(tofp, "seed %lu\n", seed);
 
-	//if(prototype == ramp) mod->diagbox->Write(text.Format("ramp base %.2f step %.4f\n", rampbase, rampstep));
+		// random number test
+	
+		//for(i=0; i<10; i++) {
+		//	erand = sfmt_genrand_real2(&sfmt);
+		//	mod->diagbox->Write(text.Format("SFMT random %.4f\n", erand));
+		//}
+
+		//std::mt19937 randmt (seed);
+		//std::uniform_real_distribution<double> dis (0.0, 1.0);
+		//double randomRealBetweenZeroAndOne = dis(generator);
+
+		//seed = (unsigned)(time(NULL));
+		//para_init_mrand(neurodex, seed + neurodex);  // is it starting randomly from one of the neurones?
+
+		// Initialise
+		epspt = 0;
+		ipspt = 0;
+		epspt1 = 0;
+		ipspt1 = 0;
+		pspsig = 0;
+		ttime = 0;
+		neurotime = 0;
+		tHAP = 0;
+		tDAP = 0;
+		tAHP = 0;
+		tAHP2 = 0;
+		tCa = Ca_rest;
+		tdendCa = 0;
+		tDyno = 0;
+		storeDyno = 0.6;
+		V = Vrest;
+
+		// NMDA PSP
+		epspt2 = 0;
+		inputPSP2 = 0;
+
+		// Osmotic pressure
+		OsmoPress = OsmoSetPoint;
+		netmod->OsmoPress = OsmoSetPoint;
+		if(osmomode) IrOsmoPress = (26 * (OsmoPress - 303)) / 1000; // differential PSP due to the hyperosmotic injection
+		else IrOsmoPress = 0;
+
+		/*if (OsmoTimeIv*1000 < modsteps) FlagOsmoIv = true;
+		else FlagOsmoIv = false;*/
+
+		// Secretion model
+		tR = Rinit;  // Reserve Pool
+		tP = Pmax;  // Releasable Pool 
+		tB = 0;  // Broadening
+		tE = 0;  // Fast Ca2+
+		tC = 0.03; // Slow Ca2+
+		CaEnt = 0;
+
+		// Synthesis
+		stimTS = 0;
+		stimTL = 0;
+		mRNAstore = mRNAinit;
+		synthrec.assign((modsteps / synthrecrate < 100000 ? modsteps / synthrecrate : 100000) + 1, 0);     // minute sampled
+		synthrate = (stimTL + basalTL) * mRNAstore;
+		synthlast = 0;
+		Casum = 0;
+
+		// Population secretion and plasma
+		secRate1s = 0;
+		secRate60s = 0;
+		secRate600s = 0;
+		plasmaRate1s = 0;
+		secX = 0;
+
+		neuron->spikecount = 0;
+		neuron->spikecount2 = 0;
+		neuron->sta.RunSize(netmod->stawin);
+		neuron->stats.RunSize(netmod->runtime, netmod->spikestats);
+
+		noisig = noimean;
+
+		for(double i=0; i<(modsteps/1000); i++) {
+			neuron->Secretion[i] = 0;
+			//neuron->OxyPlasma[i] = 0;		
+		}
+
+		// Record Initial Values
+		neuron->storeLong[0] = tR;
+		neuron->transLong[0] = 0;
+		neuron->synthstoreLong[0] = mRNAstore;
+		neuron->synthrateLong[0] = rateSR * (stimTL + basalTL) * synscale * mRNAstore * 3600;
+		neurorecord->stimTL[0] = stimTL;
+		neurorecord->stimTS[0] = stimTS;
+		neurorecord->mRNAstore[0] = mRNAstore;
+		neurorecord->Ca[0] = Ca_rest;
+		magpop->inputsignal[0] = psprate;
+		if(prototype == ramp || prototype == rampcurve) magpop->inputLong[0] = rampbase;
+		else magpop->inputLong[0] = psprate;
+
+		// Diagnostic
+		if(netmod->diag && neurodex == 0) {
+			TextFile diagfile;
+			diagfile.New("oxynetcelldiag.txt");
+			diagfile.WriteLine(text.Format("oxynet cell %d running for %d steps\n", neurodex, modsteps));
+			diagfile.WriteLine(text.Format("Vrest %.2f  Vthresh %.2f\n", Vrest, Vthresh));
+			diagfile.WriteLine(text.Format("tauMem %.4f  tauHAP %.4f  tauAHP %.4f\n", tauMem, tauHAP, tauAHP));
+			diagfile.WriteLine(text.Format("kCa %.4f  tauCa %.4f  kDyno %.4f  tauDyno %.4f\n", kCa, tauCa, kDyno, tauDyno));
+			diagfile.Close();
+		}
+
+		//fprintf(tofp, "seed %lu\n", seed);
+
+		//if(prototype == ramp) mod->diagbox->Write(text.Format("ramp base %.2f step %.4f\n", rampbase, rampstep));
+
+		spikestep = 0;
+		spikeCa = 0;
+		inputdone = 0;
+		nepsp = 0;
+		nipsp = 0;
+		IKL = 0;
+		flagError = false;
+		probestep = 0;
+		if(MODEFLAG(MAGMODE_PROBE)) probestep = ProbeRecord(0, NULL);     // first probed step
+		vars.step = 1;
+	}
 
 	recneuron = 0;
 	recstart = 53000 * 1000;
@@ -535,43 +553,94 @@ void MagNeuroMod::neuromod()
 
 	timestart = clock();
 
-	// Model Loop
-	for(step=1; step<=modsteps; step++) {
-		//ttime = ttime + hstep;
-		//neurotime = neurotime + hstep;
-		ttime++;
-		neurotime++;
-		//if(countflag && (int)neurotime % (runtime / 100) == 0) netmod->mod->dispbox->SetCount(floor(neurotime)/modsteps*100);
+	// Recording block size, every bookkeeping period is a multiple so the step loop only runs dynamics
+	// and spike detection, and the modulo tests for recording, progress, osmotic sync, and secretion
+	// buffer flushes run once per block
+	blocksize = 1000;
+	if(MODEFLAG(MAGMODE_PLASMA) && buffrate) blocksize = stepgcd(blocksize, buffrate);
+	if(osmomode) blocksize = stepgcd(blocksize, osmorate);
+	if(neurodex == 0) blocksize = stepgcd(stepgcd(stepgcd(blocksize, runtime100), datsample), 100);
+	if(multirate) blocksize = stepgcd(blocksize, synthstep);
+	recpsp = neurodex == 0 && monitor;
+	inputoff = 0;
+
+	// Model Loop, outer loop over recording blocks
+	for(blockstart=vars.step; blockstart<=modsteps; blockstart=blockend+1) {
+		blockend = blockstart + blocksize - 1;
+		if(blockend > modsteps) blockend = modsteps;
+
+		// Stage syncs at the block start, a task that has to wait parks here and continues at this block
+		// Osmo Net Sync, osmotic stage past the previous block
+		if(osmomode && blockstart > 1 && (blockstart - 1) % osmorate == 0) {
+			if(Park(netmod->osmofront, blockstart)) break;
+			OsmoPress = netmod->OsmoStore[(blockstart - 1) / netmod->osmo_hstep];
+			IrOsmoPress = (26 * (OsmoPress - 303)) / 1000;
+		}
 
-		if(countflag && (int)neurotime % runtime100 == 0) {
-			progevent.SetInt(floor(neurotime)/modsteps*100);  
-			netbox->GetEventHandler()->AddPendingEvent(progevent);
+		// Secretion ring epoch free
+		if(MODEFLAG(MAGMODE_PLASMA) && netmod->SecPark(this, blockstart)) break;
+
+		// Network input, release windows before the block, park until the input stage fills the block's window,
+		// and merge the block's input cell events
+		if(MODEFLAG(MAGMODE_INPUTGEN)) {
+			while((inputdone + 1) * netmod->inputwin < blockstart) netmod->InputRelease(inputdone++, 1);
+			if(Park(netmod->inputfront, blockend)) break;
+			netmod->InputFill(neurodex, blockstart, blockend, inputE, inputI);
+			inputoff = -blockstart;     // count index for step is step + inputoff
 		}
-		
-		if(step % 1000 == 0 && neuron->spikecount > 0) {
-			plotevent.SetInt(floor(neurotime)/modsteps*100);  
-			netbox->GetEventHandler()->AddPendingEvent(plotevent);
-			if((*netmod->netflags)["realtime"]) Sleep(disprate);
+
+		// Delayed synthesis rate, minute index changes at most at the block end
+		if(synthdel) {
+			if((blockend - 1) / synthrecrate >= synthdel) synthrecval = synthrec[(blockend - 1) / synthrecrate - synthdel];
+			else synthrecval = synthrec[0];
+			if(blockend / synthrecrate >= synthdel) synthrecend = synthrec[blockend / synthrecrate - synthdel];
+			else synthrecend = synthrec[0];
 		}
 
-		// Osmo Net Sync
-		if(osmomode && step % osmorate == 0) {
-			while(step >= netmod->osmotime) {
-				//netmod->diagmute->Lock();
-				//diagbox->Write(text.Format("Neuron %d waiting step %d osmotime %d\n", neurodex, step, netmod->osmotime));
-				//netmod->diagmute->Unlock();
-				Sleep(100);
-			}
-			OsmoPress = netmod->OsmoStore[step / netmod->osmo_hstep];
-			IrOsmoPress = (26 * (OsmoPress - 303)) / 1000;
-			if(step % 100000 == 0) {
-				//oxynetmod->diagmute->Lock();
-				//oxynetmod->mod->diagbox->Write(text.Format("Neuron %d OsmoPress %.2f\n", neurodex, OsmoPress));
-				//oxynetmod->diagmute->Unlock();
+		// Fast path, no spiking
+		if(fastpath) {
+			if(signalmode) synsig = noisig;
+			else synsig = psprate;
+
+			for(step=blockstart; step<=blockend; step++) {
+				ttime++;
+				neurotime++;
+
+				if(MODEFLAG(MAGMODE_PLASMA)) {
+					secXbuffer[buffdex++] = secX / netmod->numneurons;
+					secRate1s += secX;
+					plasmaRate1s += tOxyPlasma;		
+					secRate60s += secX;
+					secRate600s += secX;
+				}
+
+				if(!synthdel) fillR = rateSR * synthrate * 0.001 * 0.03;
+				else {
+					if(step < blockend) fillR = rateSR * synthrecval * 0.001 * 0.03;
+					else fillR = rateSR * synthrecend * 0.001 * 0.03;
+				}
+
+				if (tP < Pmax) fillP = beta * tR / Rmax;
+				else fillP = 0;
+				tP = tP - secX + fillP;
+				tR = tR + fillR - fillP;
+
+				if(recpsp && step < 1000000) netmod->neurodata->pspsig[step] = pspsig;
+
+				if(MODEFLAG(MAGMODE_PROBE) && step == probestep) {
+					double probeval[MAGPROBE_VARS] = {V, pspsig, (double)nepsp, (double)nipsp, tCa, tHAP, tDAP, tAHP, tAHP2, tDyno, IKL,
+						secX, tR, tP, stimTS, stimTL, mRNAstore, synsig};
+					probestep = ProbeRecord(step, probeval);
+				}
 			}
 		}
 
-
+		// Step loop
+		else for(step=blockstart; step<=blockend; step++) {
+			//ttime = ttime + hstep;
+			//neurotime = neurotime + hstep;
+			ttime++;
+			neurotime++;
 
 			// Signal Input     
 			if(noiamp) noisig = noisig + (noimean - noisig) / noitau + noiamp * sqrt(hstep) * rng.normal();
@@ -593,204 +662,352 @@ void MagNeuroMod::neuromod()
 
 
 
-		if (netmod->spikemode) {
+			if (MODEFLAG(MAGMODE_SPIKE)) {
 
 
-			// PSP input signal
-			nepsp = 0;
-			nipsp = 0;
-			nepsp1 = 0;
-			nipsp1 = 0;
-			nepsp2 = 0;
+				// PSP input signal
+				nepsp = 0;
+				nipsp = 0;
+				nepsp1 = 0;
+				nipsp1 = 0;
+				nepsp2 = 0;
 
-			if (inputgen) {
-				nepsp = (neuron->dendinputE)[step];
-				nipsp = (neuron->dendinputI)[step];
-			}
-			else {
-				if (prototype == ramp) {
-					//mod->diagbox->Write("set ramp\n"); 
-					if (step < rampstart) rampinput = rampbase;
-					if (step >= rampstart && step < rampstop) rampinput = rampinit + (step - rampstart) * rampstep;  // * hstep
-					if (step >= rampstop) rampinput = rampafter;
-					if (rampinput < 0) rampinput = 0;
-					epsprate = rampinput / 1000;
-					synsig = rampinput;
-				}
-				if (prototype == rampcurve) {
-					if (step < rampstart) rampinput = rampbase;
-					if (step >= rampstart && step < rampstop) rampinput = rampinit + rampmax - rampmax * exp(-rampgrad * (step - rampstart));
-					if (step >= rampstop) rampinput = rampafter;
-					if (rampinput < 0) rampinput = 0;
-					epsprate = rampinput / 1000;
-					synsig = rampinput;
+				if (MODEFLAG(MAGMODE_INPUTGEN)) {
+					nepsp = inputE[step + inputoff];
+					nipsp = inputI[step + inputoff];
 				}
+				else {
+					if (MODEFLAG(MAGMODE_RAMP)) {
+						//mod->diagbox->Write("set ramp\n"); 
+						if (step < rampstart) rampinput = rampbase;
+						if (step >= rampstart && step < rampstop) rampinput = rampinit + (step - rampstart) * rampstep;  // * hstep
+						if (step >= rampstop) rampinput = rampafter;
+						if (rampinput < 0) rampinput = 0;
+						epsprate = rampinput / 1000;
+						synsig = rampinput;
+					}
+					if (MODEFLAG(MAGMODE_RAMPCURVE)) {
+						if (step < rampstart) rampinput = rampbase;
+						if (step >= rampstart && step < rampstop) rampinput = rampinit + rampmax - rampmax * exp(-rampgrad * (step - rampstart));
+						if (step >= rampstop) rampinput = rampafter;
+						if (rampinput < 0) rampinput = 0;
+						epsprate = rampinput / 1000;
+						synsig = rampinput;
+					}
 
-				// psp rate can be affected by randomly arriving psp but also by stimuli
-				//totalepsprate = (epsprate + IrOsmoPress) * synvar;
-				//totalipsprate = (ipsprate + IrOsmoPress) * pspRatio * synvar;
-
-				totalepsprate = epsprate * synvar;
-				totalipsprate = epsprate * pspRatio * synvar;
-
-				if(totalepsprate > 0) {
-					while (epspt < hstep) {
-						//erand = para_mrand01(neurodex);
-						//erand = sfmt_genrand_real2(&sfmt);
-						//erand = unif01(randgen);
-                        erand = rng.uniform_open01();
-						nepsp++;
-						//epspt = -log(1 - para_mrand01(neurodex)) / totalepsprate + epspt;
-						epspt = -log(1 - erand) / totalepsprate + epspt;
-						//epspt = -log(1 - dis(randmt)) / totalepsprate + epspt;
+					// psp rate can be affected by randomly arriving psp but also by stimuli
+					//totalepsprate = (epsprate + IrOsmoPress) * synvar;
+					//totalipsprate = (ipsprate + IrOsmoPress) * pspRatio * synvar;
+
+					totalepsprate = epsprate * synvar;
+					totalipsprate = epsprate * pspRatio * synvar;
+
+					if(expinput) {
+						// Original exponential inter-arrival generation, one ziggurat exponential draw per PSP
+						if(totalepsprate > 0) {
+							while (epspt < hstep) {
+								//erand = para_mrand01(neurodex);
+								//erand = sfmt_genrand_real2(&sfmt);
+								//erand = unif01(randgen);
+		                        erand = rng.exponential();
+								nepsp++;
+								//epspt = -log(1 - para_mrand01(neurodex)) / totalepsprate + epspt;
+								epspt = erand / totalepsprate + epspt;
+								//epspt = -log(1 - dis(randmt)) / totalepsprate + epspt;
+							}
+							epspt = epspt - hstep;
+						}
+
+						if(!flagError && epspt > 1000) {
+							mod->diagbox->Write(text.Format("epspt %.10f  erand %.10f\n", epspt, erand));
+							flagError = true;
+						}
+
+						if(totalipsprate > 0) {
+							while (ipspt < hstep) {
+								//irand = para_mrand01(neurodex);
+								//irand = sfmt_genrand_real2(&sfmt);
+								//irand = unif01(randgen);
+		                        irand = rng.exponential();
+								nipsp++;
+								//ipspt = -log(1 - para_mrand01(neurodex)) / totalipsprate + ipspt;
+								ipspt = irand / totalipsprate + ipspt;
+								//ipspt = -log(1 - dis(randmt)) / totalipsprate + ipspt;
+							}
+							ipspt = ipspt - hstep;
+						}
+
+
+						if(epsprate1 > 0) {
+							while (epspt1 < hstep) {
+		                        erand = rng.exponential();
+								//erand = para_mrand01(neurodex);
+								nepsp1++;
+								epspt1 = erand / epsprate1 + epspt1;
+							}
+							epspt1 = epspt1 - hstep;
+						}
+
+						if(ipsprate1 > 0) {
+							while (ipspt1 < hstep) {
+								irand = rng.exponential();
+								//irand = para_mrand01(neurodex);
+								nipsp1++;
+								ipspt1 = irand / ipsprate1 + ipspt1;
+							}
+							ipspt1 = ipspt1 - hstep;
+						}
+
+						if(epsprate2 > 0) {
+							while (epspt2 < hstep) {
+								erand = rng.exponential();
+								//erand = para_mrand01(neurodex);
+								//erand = sfmt_genrand_real2(&sfmt);
+								nepsp2++;
+								epspt2 = erand / epsprate2 + epspt2;
+							}
+							epspt2 = epspt2 - hstep;
+						}
+					}
+					else {
+						// Per-step Poisson counts
+						nepsp = epspgen.Count(totalepsprate * hstep, rng);
+						nipsp = ipspgen.Count(totalipsprate * hstep, rng);
+						nepsp1 = epspgen1.Count(epsprate1 * hstep, rng);
+						nipsp1 = ipspgen1.Count(ipsprate1 * hstep, rng);
+						nepsp2 = epspgen2.Count(epsprate2 * hstep, rng);
 					}
-					epspt = epspt - hstep;
-				}
 
-				if(!flagError && epspt > 1000) {
-					mod->diagbox->Write(text.Format("epspt %.10f  erand %.10f\n", epspt, erand));
-					flagError = true;
 				}
 
-				if(totalipsprate > 0) {
-					while (ipspt < hstep) {
-						//irand = para_mrand01(neurodex);
-						//irand = sfmt_genrand_real2(&sfmt);
-						//irand = unif01(randgen);
-                        irand = rng.uniform_open01();
-						nipsp++;
-						//ipspt = -log(1 - para_mrand01(neurodex)) / totalipsprate + ipspt;
-						ipspt = -log(1 - irand) / totalipsprate + ipspt;
-						//ipspt = -log(1 - dis(randmt)) / totalipsprate + ipspt;
-					}
-					ipspt = ipspt - hstep;
+				inputPSP = nepsp * epspmag - nipsp * ipspmag;
+				inputPSP1 = nepsp1 * epspmag - nipsp1 * ipspmag;
+
+				// Input dynamics
+				if(epspmag2) {
+					if (epspsynchflag) nepsp2 = nepsp;   // synchronous AMPA and NMDA EPSPs
+					inputPSP2 = inputPSP2 - (inputPSP2 * tauPSP2) * hstep + nepsp2 * epspmag2;
 				}
 
+				// Spiking model
 
-				if(epsprate1 > 0) {
-					while (epspt1 < hstep) {
-                        erand = rng.uniform_open01();
-						//erand = para_mrand01(neurodex);
-						nepsp1++;
-						epspt1 = -log(1 - erand) / epsprate1 + epspt1;
-					}
-					epspt1 = epspt1 - hstep;
-				}
+				//pspsig = pspsig + (inputPSP2 * tauPSP2 - pspsig * tauMem) * hstep + inputPSP + inputPSP1;
+				pspsig = pspsig + (inputPSP2 * tauPSP2 - pspsig * tauMem) + inputPSP + inputPSP1;
 
-				if(ipsprate1 > 0) {
-					while (ipspt1 < hstep) {
-						irand = rng.uniform_open01();
-						//irand = para_mrand01(neurodex);
-						nipsp1++;
-						ipspt1 = -log(1 - irand) / ipsprate1 + ipspt1;
-					}
-					ipspt1 = ipspt1 - hstep;
-				}
+				//tHAP = tHAP - (tHAP * tauHAP) * hstep;
+				//tDAP = tDAP - (tDAP * tauDAP) * hstep;
+				//tAHP = tAHP - (tAHP * tauAHP) * hstep;
+				//tAHP2 = tAHP2 - (tAHP2 * tauAHP2) * hstep;     // currently redundant hstep removed for speed optimization
 
-				if(epsprate2 > 0) {
-					while (epspt2 < hstep) {
-						erand = rng.uniform_open01();
-						//erand = para_mrand01(neurodex);
-						//erand = sfmt_genrand_real2(&sfmt);
-						nepsp2++;
-						epspt2 = -log(1 - erand) / epsprate2 + epspt2;
-					}
-					epspt2 = epspt2 - hstep;
+				tHAP = tHAP - (tHAP * tauHAP);
+				tDAP = tDAP - (tDAP * tauDAP);
+				tAHP = tAHP - (tAHP * tauAHP);
+				tAHP2 = tAHP2 - (tAHP2 * tauAHP2);
+
+				tCa = tCa - (tCa - Ca_rest) * tauCa;
+				tDyno = tDyno - tDyno * tauDyno;
+
+				//tdendCa = tdendCa - hstep * tdendCa * taudendCa;
+				tdendCa = tdendCa - tdendCa * taudendCa;
+				storeDyno = storeDyno + kstoreDyno * tdendCa;  // - hstep * neuron->storeDyno / taustoreDyno;
+				if (storeDyno > 10) storeDyno = 10;
+
+				// Osmosensitive Depolarisation
+				//inputOsmo = Osmo * gOsmo;
+				inputOsmo = gOsmo;
+
+				// IKleak
+
+				if(MODEFLAG(MAGMODE_KL)) {
+					KLact = vox_tanh((tCa - Ca_rest - tDyno) / ka);
+					//IKL = gKL * (1 - KLact);
+					IKL = gKL - gKL * KLact;
 				}
+				else IKL = 0;
+
+				V = Vrest + pspsig + inputOsmo - tHAP - tAHP - tAHP2 + tDAP - IKL;
 
 			}
 
-			inputPSP = nepsp * epspmag - nipsp * ipspmag;
-			inputPSP1 = nepsp1 * epspmag - nipsp1 * ipspmag;
 
-			// Input dynamics
-			if(epspmag2) {
-				if (epspsynchflag) nepsp2 = nepsp;   // synchronous AMPA and NMDA EPSPs
-				inputPSP2 = inputPSP2 - (inputPSP2 * tauPSP2) * hstep + nepsp2 * epspmag2;
+			// Secretion model
+
+			if(MODEFLAG(MAGMODE_SEC) && !netmod->secfix) {
+				// Secretion dynamics
+				//tB = tB - (tB * tauB) * hstep;   // broadening
+				//tE = tE - (tE * tauE) * hstep;   // fast Ca2+
+				//tC = tC - (tC * tauC) * hstep;   // slow Ca2+
+				tB = tB - (tB * tauB);   // broadening
+				tE = tE - (tE * tauE);   // fast Ca2+
+				tC = tC - (tC * tauC);   // slow Ca2+
+
+				//tC += - shstep * tC * tauC;          // slower Ca accumulation
+				//tE += - shstep * tE * tauE;          // fast Ca for exocytosis
+
+				// Inhibitory feedback from Ca currents in the axonal projection
+				// For oxytocin there is a smaller negative feedback for the fast and slow Ca++
+				//Cinh = 1 - pow(tC, Cgradient) / (pow(tC, Cgradient) + pow(Cthresh, Cgradient));		
+				//Einh = 1 - pow(tE, Egradient) / (pow(tE, Egradient) + pow(Ethresh, Egradient)); 
+			
+				EKpow = tE * tE * tE * tE * tE;
+				//Einh = 1 - EKpow / (EKpow + Ethresh * Ethresh * Ethresh * Ethresh * Ethresh);
+				Einh = 1 - EKpow / (EKpow + Ethpow);
+				CKpow = tC * tC * tC;  // * tC * tC;
+				//Cinh = 1 - CKpow / (CKpow + Cthresh * Cthresh * Cthresh); // * Cthresh * Cthresh);
+				Cinh = 1 - CKpow / (CKpow + Cthpow); 
+
+				CaEnt = Einh * Cinh * (tB + Bbase); // Ca Entry		
+			
+				//secX = pow(tE, secExp) * alpha * tP;			// Rate of secretion (vesicle exocytosis)
+				if(secExp == 3) secX = tE * tE * tE * alpha * tP;             // fixed vaso
+				if(secExp == 2) secX = tE * tE * alpha * tP;                    // fixed oxy
+
+				//secBinX += secX;           // removed 12/5/25, appears redundant
 			}
 
-			// Spiking model
+			if(netmod->secfix) secX = secXfix;
+	
 
-			//pspsig = pspsig + (inputPSP2 * tauPSP2 - pspsig * tauMem) * hstep + inputPSP + inputPSP1;
-			pspsig = pspsig + (inputPSP2 * tauPSP2 - pspsig * tauMem) + inputPSP + inputPSP1;
+			// Plasma model
 
-			//tHAP = tHAP - (tHAP * tauHAP) * hstep;
-			//tDAP = tDAP - (tDAP * tauDAP) * hstep;
-			//tAHP = tAHP - (tAHP * tauAHP) * hstep;
-			//tAHP2 = tAHP2 - (tAHP2 * tauAHP2) * hstep;     // currently redundant hstep removed for speed optimization
+			if(MODEFLAG(MAGMODE_PLASMA)) {
 
-			tHAP = tHAP - (tHAP * tauHAP);
-			tDAP = tDAP - (tDAP * tauDAP);
-			tAHP = tAHP - (tAHP * tauAHP);
-			tAHP2 = tAHP2 - (tAHP2 * tauAHP2);
+				secXbuffer[buffdex++] = secX / netmod->numneurons;
 
-			tCa = tCa - (tCa - Ca_rest) * tauCa;
-			tDyno = tDyno - tDyno * tauDyno;
+				// bin recording of secretion rate and plasma concentration
+				secRate1s += secX;
+				plasmaRate1s += tOxyPlasma;		
+				secRate60s += secX;
+				secRate600s += secX;
+			}  
 
-			//tdendCa = tdendCa - hstep * tdendCa * taudendCa;
-			tdendCa = tdendCa - tdendCa * taudendCa;
-			storeDyno = storeDyno + kstoreDyno * tdendCa;  // - hstep * neuron->storeDyno / taustoreDyno;
-			if (storeDyno > 10) storeDyno = 10;
+			// Synthesis model
 
-			// Osmosensitive Depolarisation
-			//inputOsmo = Osmo * gOsmo;
-			inputOsmo = gOsmo;
+			// 'shstep' is 1 second scale time step
 
-			// IKleak
+			// Synthesis V8               14th July 2021
 
-			KLact = vox_tanh((tCa - Ca_rest - tDyno) / ka);
-			//IKL = gKL * (1 - KLact);
-			IKL = gKL - gKL * KLact;
+			if(!multirate) {
+				stimTS += (kTS * 0.001 * (tCa - Ca_rest) - stimTS * tauTS) * shstep;
 
-			V = Vrest + pspsig + inputOsmo - tHAP - tAHP - tAHP2 + tDAP - IKL;
+				stimTL += (kTL * 0.001 * (tCa - Ca_rest) - stimTL * tauTL) * shstep;
 
-		}
+				synthrate = (stimTL + basalTL) * mRNAstore;
 
+				if(decaymode) mRNAstore += (synscale * stimTS - mRNAstore * mRNAtau) * shstep;	
+				else mRNAstore += synscale * (stimTS - synthrate) * shstep;	
+		
+				if(mRNAmax && mRNAstore > mRNAmax) mRNAstore = mRNAmax;  
+			}
+			else if(MODEFLAG(MAGMODE_SPIKE)) Casum += tCa - Ca_rest;      // Ca input for the coarse synthesis step
 
-		// Secretion model
+			//fillR = rateSR * synthrate; 
+			//fillR = rateSR * synthrate * 0.00003;
+			if(!synthdel) fillR = rateSR * synthrate * 0.001 * 0.03;
+			else {
+				if(step < blockend) fillR = rateSR * synthrecval * 0.001 * 0.03;
+				else fillR = rateSR * synthrecend * 0.001 * 0.03;      // block end may start a new minute
+			}
 
-		if(netmod->secmode && !netmod->secfix) {
-			// Secretion dynamics
-			//tB = tB - (tB * tauB) * hstep;   // broadening
-			//tE = tE - (tE * tauE) * hstep;   // fast Ca2+
-			//tC = tC - (tC * tauC) * hstep;   // slow Ca2+
-			tB = tB - (tB * tauB);   // broadening
-			tE = tE - (tE * tauE);   // fast Ca2+
-			tC = tC - (tC * tauC);   // slow Ca2+
-
-			//tC += - shstep * tC * tauC;          // slower Ca accumulation
-			//tE += - shstep * tE * tauE;          // fast Ca for exocytosis
-
-			// Inhibitory feedback from Ca currents in the axonal projection
-			// For oxytocin there is a smaller negative feedback for the fast and slow Ca++
-			//Cinh = 1 - pow(tC, Cgradient) / (pow(tC, Cgradient) + pow(Cthresh, Cgradient));		
-			//Einh = 1 - pow(tE, Egradient) / (pow(tE, Egradient) + pow(Ethresh, Egradient)); 
-			
-			EKpow = tE * tE * tE * tE * tE;
-			//Einh = 1 - EKpow / (EKpow + Ethresh * Ethresh * Ethresh * Ethresh * Ethresh);
-			Einh = 1 - EKpow / (EKpow + Ethpow);
-			CKpow = tC * tC * tC;  // * tC * tC;
-			//Cinh = 1 - CKpow / (CKpow + Cthresh * Cthresh * Cthresh); // * Cthresh * Cthresh);
-			Cinh = 1 - CKpow / (CKpow + Cthpow); 
-
-			CaEnt = Einh * Cinh * (tB + Bbase); // Ca Entry		
-			
-			//secX = pow(tE, secExp) * alpha * tP;			// Rate of secretion (vesicle exocytosis)
-			if(secExp == 3) secX = tE * tE * tE * alpha * tP;             // fixed vaso
-			if(secExp == 2) secX = tE * tE * alpha * tP;                    // fixed oxy
 
-			//secBinX += secX;           // removed 12/5/25, appears redundant
+			// Reserve Store (tR) and Releasable Pool (tP)     - 12/5/25 moved down from secretion model section
+			if (tP < Pmax) fillP = beta * tR / Rmax;
+			else fillP = 0;
+
+			tP = tP - secX + fillP;
+
+			tR = tR + fillR - fillP;    // Reserve store - linking synthesis to secretion model
+
+			if(recpsp && step < 1000000) {
+				netmod->neurodata->pspsig[step] = pspsig;
+				//netmod->oxyneurodata->synsig[step] = 10;
+			}
+
+			/*if(monitor && neurodex == recneuron)            // 15/7/20, diagnostics used to find random number error
+				if(step >= recstart && step < recstop) {
+					neurorecord->V[step - recstart] = V;
+					neurorecord->syn[step - recstart] = pspsig;
+					neurorecord->psp[step - recstart] = epspt; // erand; //epspt; //nipsp;   // inputPSP;
+					neurorecord->rand[step - recstart] = erand; 
+				}*/
+
+			if(sta) sta->Step(step, pspsig, tCa, secX);
+
+			// Spiking
+			if(V > Vthresh && ttime >= absref) {
+
+				// record spike time
+				neuron->SpikeAdd(neurotime);
+				if(sta) sta->Spike(step);
+
+				// Spike incremented variables
+
+				// Calcium
+				spikestep = step;
+				spikeCa = tCa;
+				tCa = tCa + kCa;
+
+				// afterpotentials
+				tAHP = tAHP + kAHP;
+				tHAP = tHAP + kHAP;
+				tDAP = tDAP + kDAP;
+
+				if(AHP2mode) {
+					if(tCa >= aAHP2) tAHP2 = tAHP2 + kAHP2 * (tCa - aAHP2);
+				}
+				else tAHP2 = tAHP2 + kAHP2;
+
+				// secretion variables
+				if(MODEFLAG(MAGMODE_SEC)) {
+					tB = tB + kB;
+					tE = tE + kE * CaEnt;
+					tC = tC + kC * CaEnt;			
+				}
+
+				// Dynorphin
+				if(dynostoreflag) {
+					if(storeDyno > spikeDyno) {
+						tDyno = tDyno + kDyno;
+						storeDyno = storeDyno - spikeDyno;
+					}
+				}
+				else tDyno = tDyno + kDyno;
+			}
+
+			// Probes, one compare per step until the next probed step
+			if(MODEFLAG(MAGMODE_PROBE) && step == probestep) {
+				double probeval[MAGPROBE_VARS] = {V, pspsig, (double)nepsp, (double)nipsp, tCa, tHAP, tDAP, tAHP, tAHP2, tDyno, IKL,
+					secX, tR, tP, stimTS, stimTL, mRNAstore, synsig};
+				probestep = ProbeRecord(step, probeval);
+			}
 		}
 
-		if(netmod->secfix) secX = secXfix;
-	
+		// Block end bookkeeping
+		step = blockend;
 
-		// Plasma model
+		// Multi-rate synthesis, exact exponential update across the coarse step with the mean Ca input
+		if(multirate && (step % synthstep == 0 || step == modsteps)) {
+			SynthUpdate(Casum / (step - synthlast), step - synthlast);
+			synthlast = step;
+			Casum = 0;
+		}
+
+		//if(countflag && (int)neurotime % (runtime / 100) == 0) netmod->mod->dispbox->SetCount(floor(neurotime)/modsteps*100);
 
-		if(netmod->secmode && netmod->plasmamode) {
+		if(countflag && (int)neurotime % runtime100 == 0) {
+			progevent.SetInt(floor(neurotime)/modsteps*100);  
+			netbox->GetEventHandler()->AddPendingEvent(progevent);
+		}
+		
+		if(step % 1000 == 0 && neuron->spikecount > 0) {
+			plotevent.SetInt(floor(neurotime)/modsteps*100);  
+			netbox->GetEventHandler()->AddPendingEvent(plotevent);
+			if((*netmod->netflags)["realtime"]) wxThread::Sleep(disprate);
+		}
 
-			secXbuffer[buffdex++] = secX / netmod->numneurons;
+		// Plasma model
 
+		if(MODEFLAG(MAGMODE_PLASMA)) {
 			/*if(step >= 2000000 && step < 2000010) {
 			oxynetmod->diagmute->Lock();
 			oxynetmod->mod->diagbox->Write(text.Format("NeuroMod secX %.2f step %d secXtime %d\n", secX, step, magpop->secXtime));
@@ -800,28 +1017,18 @@ void MagNeuroMod::neuromod()
 			// New Buffered Secretion Rate code
 
 			if(buffrate && step >= buffrate && step % buffrate == 0) {
-				netmod->secmute->Lock();
 				//for(i=0; i<buffrate; i++) magpop->secX[step - buffrate + i] += secXbuffer[i];
-				for(i=0; i<buffrate; i++) secXpop[(step - buffrate + i) / plasma_hstep] += secXbuffer[i];
-				magpop->secXcount[step / buffrate]++;
-				if(magpop->secXcount[step / buffrate] == netmod->numneurons) magpop->secXtime = step;
-				netmod->secmute->Unlock();
+				netmod->SecFlush(worker, secXbuffer, buffdex, step, plasma_hstep, 1);     // per worker sum, no shared lock
 				buffdex = 0;
 				if(neurodex == 0 && step < 2000) {
 					//netmod->diagmute->Lock();
-					netmod->mod->DiagWrite(text.Format("Neuron 0 buffer fill step %d secXtime %d secXpop %d buffer %d\n", step, magpop->secXtime, (step - buffrate)/plasma_hstep, buffrate));
+					netmod->mod->DiagWrite(text.Format("Neuron 0 buffer fill step %d secfront %d secXpop %d buffer %d\n", step, netmod->secfront->time, (step - buffrate)/plasma_hstep, buffrate));
 					//netmod->diagmute->Unlock();
 				}
 			}
 
 			// old non-buffered code removed here - see archived versions 2/5/22
 
-			// bin recording of secretion rate and plasma concentration
-			secRate1s += secX;
-			plasmaRate1s += tOxyPlasma;		
-			secRate60s += secX;
-			secRate600s += secX;
-
 			if((step % 1000) == 0) {
 				neuron->Secretion[step/1000] = secRate1s; 
 				//neuron->OxyPlasma[step/1000] = plasmaRate1s;
@@ -839,59 +1046,15 @@ void MagNeuroMod::neuromod()
 				neuron->secHour[step/600000] = secRate600s * 6 / 1000;  // convert pg/min to ng/h
 				secRate600s = 0;
 			}
-		}  
-
-		// Synthesis model
-
-		// 'shstep' is 1 second scale time step
-
-		// Synthesis V8               14th July 2021
-
-		stimTS += (kTS * 0.001 * (tCa - Ca_rest) - stimTS * tauTS) * shstep;
-
-		stimTL += (kTL * 0.001 * (tCa - Ca_rest) - stimTL * tauTL) * shstep;
-
-		synthrate = (stimTL + basalTL) * mRNAstore;
-
-		if(decaymode) mRNAstore += (synscale * stimTS - mRNAstore * mRNAtau) * shstep;	
-		else mRNAstore += synscale * (stimTS - synthrate) * shstep;	
-		
-		if(mRNAmax && mRNAstore > mRNAmax) mRNAstore = mRNAmax;  
-
-		//fillR = rateSR * synthrate; 
-		//fillR = rateSR * synthrate * 0.00003;
-		if(!synthdel) fillR = rateSR * synthrate * 0.001 * 0.03;
-		else {
-			if(step/synthrecrate >= synthdel) fillR = rateSR * synthrec[step/synthrecrate - synthdel] * 0.001 * 0.03;
-			else fillR = rateSR * synthrec[0] * 0.001 * 0.03;
 		}
 
-
-		// Reserve Store (tR) and Releasable Pool (tP)     - 12/5/25 moved down from secretion model section
-		if (tP < Pmax) fillP = beta * tR / Rmax;
-		else fillP = 0;
-
-		tP = tP - secX + fillP;
-
-		tR = tR + fillR - fillP;    // Reserve store - linking synthesis to secretion model
-
 		if(step%1000 == 0 && step/1000 < magpop->maxtime) neuron->store[step/datsample] = tR;
 		
 		// Neuron Monitor
-		if(neurodex == 0 && step%100 == 0 && step<1000000) {
+		if(monitor && neurodex == 0 && step%100 == 0 && step<1000000) {
 			magpop->inputsignal[step/100] = synsig;	         // input signal recording
 		}
 
-		if(neurodex == 0 && step < 1000) {
-			//fprintf(tofp, "Step %d	Input %.2f  EPSP rate %.2f  IPSP rate %.2f  InputSyn %.2f  HAP %.2f  V %.2f\n", 
-			//	step, inputPSP, totalepsprate, totalipsprate, pspsig, HAP, V); 
-		}
-
-		if(neurodex == 0 && step < 1000000) {
-			netmod->neurodata->pspsig[step] = pspsig;
-			//netmod->oxyneurodata->synsig[step] = 10;
-		}
-		
 
 		// Record - minute timescale, sampled
 		if(step < 60000 * maxtimeLong) {
@@ -912,7 +1075,8 @@ void MagNeuroMod::neuromod()
 				neurorecord->stimTS[step/datsample] = stimTS;
 				neurorecord->stimTL[step/datsample] = stimTL;
 				neurorecord->mRNAstore[step/datsample] = mRNAstore;
-				neurorecord->Ca[step/datsample] = tCa;
+				if(spikestep == step) neurorecord->Ca[step/datsample] = spikeCa;   // value before spike increment
+				else neurorecord->Ca[step/datsample] = tCa;
 			}
 		}
 
@@ -926,60 +1090,21 @@ void MagNeuroMod::neuromod()
 			synthrec[synthdex] = synthrate;
 			//diagbox->Write(text.Format("neuromod synthrec step %d dex %d data %.4f\n", step, synthdex, synthrate));
 		}
+	}
 
 
-		/*if(monitor && neurodex == recneuron)            // 15/7/20, diagnostics used to find random number error
-			if(step >= recstart && step < recstop) {
-				neurorecord->V[step - recstart] = V;
-				neurorecord->syn[step - recstart] = pspsig;
-				neurorecord->psp[step - recstart] = epspt; // erand; //epspt; //nipsp;   // inputPSP;
-				neurorecord->rand[step - recstart] = erand; 
-			}*/
-
-		// Spiking
-		if(V > Vthresh && ttime >= absref) {
-
-			// record spike time
-			if(neuron->spikecount < maxspikes) {
-				neuron->times[neuron->spikecount] = neurotime;
-				neuron->spikecount++;
-			}
-
-			neuron->spikecount2++;
-
-			// Spike incremented variables
-
-			// Calcium
-			tCa = tCa + kCa;
-
-			// afterpotentials
-			tAHP = tAHP + kAHP;
-			tHAP = tHAP + kHAP;
-			tDAP = tDAP + kDAP;
-
-			if(AHP2mode) {
-				if(tCa >= aAHP2) tAHP2 = tAHP2 + kAHP2 * (tCa - aAHP2);
-			}
-			else tAHP2 = tAHP2 + kAHP2;
-
-			// secretion variables
-			if(netmod->secmode) {
-				tB = tB + kB;
-				tE = tE + kE * CaEnt;
-				tC = tC + kC * CaEnt;			
-			}
-
-			// Dynorphin
-			if(dynostoreflag) {
-				if(storeDyno > spikeDyno) {
-					tDyno = tDyno + kDyno;
-					storeDyno = storeDyno - spikeDyno;
-				}
-			}
-			else tDyno = tDyno + kDyno;
-		}
+	// Parked, flush the part filled secretion buffer and save the state to continue from this block
+	if(blockstart <= modsteps) {
+		if(MODEFLAG(MAGMODE_PLASMA)) netmod->SecFlush(worker, secXbuffer, buffdex, blockstart - 1, plasma_hstep, 0);
+		vars.step = blockstart;
+		state = vars;
+		delete [] secXbuffer;
+		return;
 	}
+	state.step = 0;
 
+	// Release the remaining input windows
+	if(MODEFLAG(MAGMODE_INPUTGEN)) while(inputdone < netmod->inputwindows) netmod->InputRelease(inputdone++, 1);
 
 	// Store final mRNA store and reserve store value for sequential runs
 	if(!neuron->netinit) {
@@ -998,7 +1123,124 @@ void MagNeuroMod::neuromod()
 	
 	//fclose(tofp);
 	delete [] secXbuffer;
-	delete [] synthrec;
+}
+
+#undef MODEFLAG
+
+
+// Record the probes due at 'step' from 'probeval', model state indexed by MAGPROBE variable, and return the next probed step
+int MagNeuroMod::ProbeRecord(int step, const double *probeval)
+{
+	int p;
+	int next = modsteps + 1;
+	MagProbe *probe;
+
+	for(p=0; p<(int)probes.size(); p++) {
+		probe = probes[p];
+		if(probe->next == step && step <= probe->stop) probe->Add(probeval[probe->var]);
+		if(probe->next <= probe->stop && probe->next < next) next = probe->next;
+	}
+	return next;
+}
+
+
+// Exact exponential synthesis update across 'span' ms with mean Ca input 'Cainput', multi-rate and event engine spans
+void MagNeuroMod::SynthUpdate(double Cainput, int span)
+{
+	double synthh = span * shstep;
+	double TSeq, TLeq, TSmean, TLmean;
+	double fTS, fTL, fm, kdecay;
+
+	TSeq = kTS * 0.001 * Cainput / tauTS;      // equilibrium values for this input
+	TLeq = kTL * 0.001 * Cainput / tauTL;
+	fTS = exp(-tauTS * synthh);
+	fTL = exp(-tauTL * synthh);
+	TSmean = TSeq + (stimTS - TSeq) * (1 - fTS) / (tauTS * synthh);     // means across the step, mRNA input
+	TLmean = TLeq + (stimTL - TLeq) * (1 - fTL) / (tauTL * synthh);
+	stimTS = TSeq + (stimTS - TSeq) * fTS;
+	stimTL = TLeq + (stimTL - TLeq) * fTL;
+
+	if(decaymode) kdecay = mRNAtau;
+	else kdecay = synscale * (TLmean + basalTL);
+	if(kdecay > 0) {
+		fm = exp(-kdecay * synthh);
+		mRNAstore = synscale * TSmean / kdecay + (mRNAstore - synscale * TSmean / kdecay) * fm;
+	}
+	else mRNAstore += synscale * TSmean * synthh;
+	if(mRNAmax && mRNAstore > mRNAmax) mRNAstore = mRNAmax;
+
+	synthrate = (stimTL + basalTL) * mRNAstore;
+}
+
+
+// Reduce mode flags to the variant that runs them, dropping flags with no effect
+static constexpr int CanonMode(int mode)
+{
+	return (mode & MAGMODE_GENERIC) ? MAGMODE_GENERIC
+		: (mode & MAGMODE_PROBE) ? CanonMode(mode & ~MAGMODE_PROBE) | MAGMODE_PROBE                // probes record in any variant
+		: !(mode & MAGMODE_SEC) && (mode & MAGMODE_PLASMA) ? CanonMode(mode & ~MAGMODE_PLASMA)     // plasma buffering only with secretion
+		: !(mode & MAGMODE_SPIKE) ? mode & (MAGMODE_SEC | MAGMODE_PLASMA)                          // input and IKL only with spiking
+		: (mode & MAGMODE_INPUTGEN) ? mode & ~(MAGMODE_RAMP | MAGMODE_RAMPCURVE)                   // pre-generated input overrides protocol
+		: (mode & MAGMODE_RAMP) ? mode & ~MAGMODE_RAMPCURVE
+		: mode;
+}
+
+
+// Dispatch table, one entry per flag combination pointing to its canonical variant
+typedef void (MagNeuroMod::*NeuroModLoop)();
+
+template<int N> struct NeuroModTable
+{
+	static void Fill(NeuroModLoop *table) {
+		NeuroModTable<N-1>::Fill(table);
+		table[N-1] = &MagNeuroMod::neuromodloop<CanonMode(N-1)>;
+	}
+};
+
+template<> struct NeuroModTable<0>
+{
+	static void Fill(NeuroModLoop *table) {}
+};
+
+struct NeuroModDispatch
+{
+	NeuroModLoop table[MAGMODE_GENERIC];
+	NeuroModDispatch() { NeuroModTable<MAGMODE_GENERIC>::Fill(table); }
+};
+
+
+// Mode flags for this neuron's run, chosen once rather than tested each step
+int MagNeuroMod::NeuroMode()
+{
+	int mode = 0;
+
+	if(netmod->spikemode) mode |= MAGMODE_SPIKE;
+	if(netmod->secmode) mode |= MAGMODE_SEC;
+	if(netmod->secmode && netmod->plasmamode) mode |= MAGMODE_PLASMA;
+	if(gKL != 0) mode |= MAGMODE_KL;     // IKL is zero without leak conductance, oxy parameter set
+	if((*netmod->netflags)["inputgen"]) mode |= MAGMODE_INPUTGEN;
+	if(prototype == ramp) mode |= MAGMODE_RAMP;
+	if(prototype == rampcurve) mode |= MAGMODE_RAMPCURVE;
+	if(probes.size()) mode |= MAGMODE_PROBE;
+
+	return CanonMode(mode);
+}
+
+
+void MagNeuroMod::neuromod()
+{
+	neuromod(NeuroMode());
+}
+
+
+// MAGMODE_GENERIC can be combined with other flags, running the generic loop for that configuration
+void MagNeuroMod::neuromod(int mode)
+{
+	static const NeuroModDispatch dispatch;
+
+	runmode = mode & ~MAGMODE_GENERIC;
+	if(mode & MAGMODE_GENERIC) neuromodloop<MAGMODE_GENERIC>();
+	else (this->*dispatch.table[CanonMode(mode)])();
 }
 
 
@@ -46,8 +46,8 @@ void MagPlasmaMod::plasmamodel()
 {
 	int i, step;
 	int runtime, modtime;
+	int bufftime;
 	wxString text;
-	double plasmatime = 0;
 
 	double DiffRate;
 	double tauOxyClear, tauOxyDiff;
@@ -55,6 +55,7 @@ void MagPlasmaMod::plasmamodel()
 	double netsecRate4s;
 	double plasmaRate60s, netsecRate60s;
 	double netsecRate1h;
+	double secX;
 
 	tauOxyClear = log((double)2) / (halflifeOxyClear * 1000);
 	tauOxyDiff = log((double)2) / (halflifeOxyDiff * 1000);
@@ -79,20 +80,18 @@ void MagPlasmaMod::plasmamodel()
 	netmod->mod->diagbox->Write(text.Format("PlasmaMod running secXtime %d modsteps %d\n", magpop->secXtime, modsteps));
 	netmod->diagmute->Unlock();
      */
-    mod->DiagWrite(text.Format("PlasmaMod running secXtime %d modsteps %d\n", magpop->secXtime, modsteps));
+    mod->DiagWrite(text.Format("PlasmaMod running secfront %d modsteps %d\n", netmod->secfront->time, modsteps));
     
 
 	// Model Loop
 	for(step=1; step<=modsteps; step++) {
-		plasmatime += plasma_hstep;
-		// Wait for secX summation buffer
-		if(step % buffrate == 0) {
-			while(plasmatime > magpop->secXtime) {
-				//oxynetmod->diagmute->Lock();
-				//oxynetmod->mod->diagbox->Write(text.Format("PlasmaMod waiting step %d secXtime %d\n", step, oxypop->secXtime));
-				//oxynetmod->diagmute->Unlock();
-				Sleep(100);
-			}
+		// Wait for the secretion buffer holding index 'step', blocks until the neuron tasks complete it
+		// Earlier buffers have been read, freeing their ring epochs for the neuron tasks
+		if(step == 1 || step % buffrate == 0) {
+			netmod->secfree->Advance(step / buffrate * buffrate * plasma_hstep);
+			bufftime = (step / buffrate + 1) * buffrate * plasma_hstep;
+			if(bufftime > runtime) bufftime = runtime;
+			netmod->secfront->WaitFor(bufftime);
 			/*if(step < 10000) {
 				oxynetmod->diagmute->Lock();
 				oxynetmod->mod->diagbox->Write(text.Format("PlasmaMod buffer scaling step %d secXtime %d\n", step, oxypop->secXtime));
@@ -113,16 +112,20 @@ void MagPlasmaMod::plasmamodel()
 			oxynetmod->diagmute->Unlock();
 		}*/
 
-		netmod->tPlasma = netmod->tPlasma + plasma_hstep * (magpop->secX[step] - (netmod->tPlasma * tauOxyClear + DiffRate * tauOxyDiff));  // Oxytocin Plasma Concentration
+		// Population secretion from the ring, indices past the last full buffer were never filled
+		if(step / buffrate < netmod->numepochs) secX = netmod->secbuff[step / buffrate % netmod->secring * netmod->buffrate + step % buffrate];
+		else secX = 0;
+
+		netmod->tPlasma = netmod->tPlasma + plasma_hstep * (secX - (netmod->tPlasma * tauOxyClear + DiffRate * tauOxyDiff));  // Oxytocin Plasma Concentration
 		netmod->tEVF = netmod->tEVF + plasma_hstep * (DiffRate * tauOxyDiff);
 
 		//netsecRate1s =+ netmod->netsecX;
-		netsecRate1s += magpop->secX[step];
-		netsecRate4s += magpop->secX[step];
+		netsecRate1s += secX;
+		netsecRate4s += secX;
 		netplasmaRate1s += netmod->tPlasma;	
 		plasmaRate60s += netmod->tPlasma;
-		netsecRate60s += magpop->secX[step];         
-		netsecRate1h += magpop->secX[step];                  // long timescale secretion rate for fitting to Robinson 1989 
+		netsecRate60s += secX;         
+		netsecRate1h += secX;                  // long timescale secretion rate for fitting to Robinson 1989 
 
 		if(step % (1000 / plasma_hstep) == 0) {
 			magpop->OxySecretionNet[step/(1000/plasma_hstep)] = mod->popscale * netsecRate1s; 
@@ -157,5 +160,5 @@ void MagPlasmaMod::plasmamodel()
 	netmod->diagmute->Unlock();
      */
     
-    mod->DiagWrite(text.Format("PlasmaMod finished secXtime %d plasma maxdex %d\n", magpop->secXtime, magpop->OxyPlasmaNet.maxdex()));
+    mod->DiagWrite(text.Format("PlasmaMod finished secfront %d plasma maxdex %d\n", netmod->secfront->time, magpop->OxyPlasmaNet.maxdex()));
 }
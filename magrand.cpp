@@ -0,0 +1,208 @@
+/*
+*  magrand.cpp
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*  Counter based random number generator, see magrand.h
+*
+*  Refill() runs the ten Philox rounds for all counters of a block together, one 32 x 32 -> 64 bit multiply pair
+*  per lane per round, written as loops over lanes so that the compiler vectorises them. Ziggurat draws
+*  fall to ExpTail() or NormTail() about 1% of the time, for the wedge test or the tail.
+*
+*/
+
+
+#include "magrand.h"
+#include <math.h>
+
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_LANES (MAGRANDBLOCK / 2)
+
+
+const MagZiggurat magzig;
+
+
+// Table set up as in Marsaglia and Tsang's zigset()
+MagZiggurat::MagZiggurat()
+{
+	int i;
+	double m1 = 2147483648.0, m2 = 4294967296.0;
+	double dn = 3.442619855899, tn = dn, vn = 9.91256303526217e-3;
+	double de = 7.697117470131487, te = de, ve = 3.949659822581572e-3;
+	double q;
+
+	// Normal
+	q = vn / exp(-0.5 * dn * dn);
+	kn[0] = (uint32_t)((dn / q) * m1);
+	kn[1] = 0;
+	wn[0] = q / m1;
+	wn[127] = dn / m1;
+	fn[0] = 1;
+	fn[127] = exp(-0.5 * dn * dn);
+	for(i=126; i>=1; i--) {
+		dn = sqrt(-2 * log(vn / dn + exp(-0.5 * dn * dn)));
+		kn[i + 1] = (uint32_t)((dn / tn) * m1);
+		tn = dn;
+		fn[i] = exp(-0.5 * dn * dn);
+		wn[i] = dn / m1;
+	}
+
+	// Exponential
+	q = ve / exp(-de);
+	ke[0] = (uint32_t)((de / q) * m2);
+	ke[1] = 0;
+	we[0] = q / m2;
+	we[255] = de / m2;
+	fe[0] = 1;
+	fe[255] = exp(-de);
+	for(i=254; i>=1; i--) {
+		de = -log(ve / de + exp(-de));
+		ke[i + 1] = (uint32_t)((de / te) * m2);
+		te = de;
+		fe[i] = exp(-de);
+		we[i] = de / m2;
+	}
+}
+
+
+void MagRand::seed(uint64_t seedval, uint64_t streamval)
+{
+	key[0] = (uint32_t)seedval;
+	key[1] = (uint32_t)(seedval >> 32);
+	stream[0] = (uint32_t)streamval;
+	stream[1] = (uint32_t)(streamval >> 32);
+	block = 0;
+	rdex = MAGRANDBLOCK;
+}
+
+
+// Generate block 'block' into raw
+void MagRand::Refill()
+{
+	int i, round;
+	uint32_t c0[PHILOX_LANES], c1[PHILOX_LANES], c2[PHILOX_LANES], c3[PHILOX_LANES];
+	uint32_t k0 = key[0], k1 = key[1];
+	uint64_t counter = block * PHILOX_LANES;
+
+	for(i=0; i<PHILOX_LANES; i++) {
+		c0[i] = (uint32_t)(counter + i);
+		c1[i] = (uint32_t)((counter + i) >> 32);
+		c2[i] = stream[0];
+		c3[i] = stream[1];
+	}
+
+	for(round=0; round<10; round++) {
+		for(i=0; i<PHILOX_LANES; i++) {
+			uint64_t p0 = (uint64_t)PHILOX_M0 * c0[i];
+			uint64_t p1 = (uint64_t)PHILOX_M1 * c2[i];
+			c0[i] = (uint32_t)(p1 >> 32) ^ c1[i] ^ k0;
+			c2[i] = (uint32_t)(p0 >> 32) ^ c3[i] ^ k1;
+			c1[i] = (uint32_t)p1;
+			c3[i] = (uint32_t)p0;
+		}
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	for(i=0; i<PHILOX_LANES; i++) {
+		raw[2 * i] = (uint64_t)c1[i] << 32 | c0[i];
+		raw[2 * i + 1] = (uint64_t)c3[i] << 32 | c2[i];
+	}
+	block++;
+	rdex = 0;
+}
+
+
+// Values drawn so far, each draw takes one value, tails take more
+uint64_t MagRand::Position()
+{
+	return block * MAGRANDBLOCK - (MAGRANDBLOCK - rdex);
+}
+
+
+void MagRand::SetPosition(uint64_t position)
+{
+	block = position / MAGRANDBLOCK;
+	Refill();
+	rdex = position % MAGRANDBLOCK;
+}
+
+
+void MagRand::Uniform(double *out, int count)
+{
+	int i, n;
+
+	while(count > 0) {
+		if(rdex == MAGRANDBLOCK) Refill();
+		n = MAGRANDBLOCK - rdex;
+		if(n > count) n = count;
+		for(i=0; i<n; i++) out[i] = ((raw[rdex + i] >> 12) + 0.5) * (1.0 / 4503599627370496.0);
+		rdex += n;
+		out += n;
+		count -= n;
+	}
+}
+
+
+void MagRand::Exponential(double *out, int count)
+{
+	for(int i=0; i<count; i++) out[i] = exponential();
+}
+
+
+void MagRand::Normal(double *out, int count)
+{
+	for(int i=0; i<count; i++) out[i] = normal();
+}
+
+
+// Exponential wedge and tail, Marsaglia and Tsang's efix()
+double MagRand::ExpTail(uint32_t jz, int iz)
+{
+	double x;
+	uint64_t r;
+
+	while(true) {
+		if(iz == 0) return 7.69711747013104972 - log(uniform_open01());
+		x = jz * magzig.we[iz];
+		if(magzig.fe[iz] + uniform_open01() * (magzig.fe[iz - 1] - magzig.fe[iz]) < exp(-x)) return x;
+
+		r = next();
+		jz = (uint32_t)(r >> 32);
+		iz = r & 255;
+		if(jz < magzig.ke[iz]) return jz * magzig.we[iz];
+	}
+}
+
+
+// Normal wedge and tail, Marsaglia and Tsang's nfix()
+double MagRand::NormTail(int32_t hz, int iz)
+{
+	const double r = 3.442619855899;
+	double x, y;
+	uint64_t u;
+
+	while(true) {
+		x = hz * magzig.wn[iz];
+		if(iz == 0) {
+			do {
+				x = -log(uniform_open01()) / r;
+				y = -log(uniform_open01());
+			} while(y + y < x * x);
+			return hz > 0 ? r + x : -r - x;
+		}
+		if(magzig.fn[iz] + uniform_open01() * (magzig.fn[iz - 1] - magzig.fn[iz]) < exp(-0.5 * x * x)) return x;
+
+		u = next();
+		hz = (int32_t)(u >> 32);
+		iz = u & 127;
+		if((hz < 0 ? 0u - (uint32_t)hz : (uint32_t)hz) < magzig.kn[iz]) return hz * magzig.wn[iz];
+	}
+}
@@ -0,0 +1,102 @@
+/*
+*  magrand.h
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*
+*    Counter based random number generator for neuron tasks (see magrand.cpp)
+*
+*        - Philox4x32-10 (Salmon et al. 2011), keyed by the seed, counter words hold the block index and stream
+*        - draws are served from a block of MAGRANDBLOCK 64-bit values generated in one lane loop
+*        - exponential and normal draws by ziggurat (Marsaglia and Tsang 2000), one table compare per draw
+*
+*    A stream's values depend only on (seed, stream, position), not on which thread runs it or what
+*    ran before, and Position()/SetPosition() jump anywhere in the stream, for checkpoints.
+*    The interface follows HypoRand so it replaces it in MagNeuroMod.
+*
+*/
+
+
+#ifndef MAGRAND_H
+#define MAGRAND_H
+
+
+#include <stdint.h>
+
+
+#define MAGRANDBLOCK 32     // 64-bit values per generated block, 16 Philox counters
+
+
+// Ziggurat tables, 256 layers for exponential, 128 for normal
+struct MagZiggurat
+{
+    uint32_t ke[256], kn[128];
+    double we[256], fe[256];
+    double wn[128], fn[128];
+
+    MagZiggurat();
+};
+
+extern const MagZiggurat magzig;
+
+
+class MagRand
+{
+public:
+    uint32_t key[2];       // seed
+    uint32_t stream[2];    // counter words 2 and 3
+    uint64_t block;        // next block index, counter words 0 and 1 are block * MAGRANDBLOCK / 2 + lane
+    int rdex;              // next unused value in raw
+    uint64_t raw[MAGRANDBLOCK];
+
+    MagRand() { seed(1); }
+    MagRand(uint64_t seedval) { seed(seedval); }
+
+    void seed(uint64_t seedval, uint64_t streamval = 0);
+    void Refill();
+    uint64_t Position();
+    void SetPosition(uint64_t position);
+
+    // Block draws
+    void Uniform(double *out, int count);
+    void Exponential(double *out, int count);
+    void Normal(double *out, int count);
+
+    inline uint64_t next() {
+        if(rdex == MAGRANDBLOCK) Refill();
+        return raw[rdex++];
+    }
+
+    // [0, 1)
+    inline double uniform01() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    // (0, 1)
+    inline double uniform_open01() { return ((next() >> 12) + 0.5) * (1.0 / 4503599627370496.0); }
+
+    // Unit mean exponential, layer index from the low bits, value from the high 32 bits
+    inline double exponential() {
+        uint64_t r = next();
+        uint32_t jz = (uint32_t)(r >> 32);
+        int iz = r & 255;
+        if(jz < magzig.ke[iz]) return jz * magzig.we[iz];
+        return ExpTail(jz, iz);
+    }
+
+    // Standard normal
+    inline double normal() {
+        uint64_t r = next();
+        int32_t hz = (int32_t)(r >> 32);
+        int iz = r & 127;
+        if((hz < 0 ? 0u - (uint32_t)hz : (uint32_t)hz) < magzig.kn[iz]) return hz * magzig.wn[iz];
+        return NormTail(hz, iz);
+    }
+
+    double ExpTail(uint32_t jz, int iz);
+    double NormTail(int32_t hz, int iz);
+};
+
+
+#endif
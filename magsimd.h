@@ -0,0 +1,130 @@
+/*
+*  magsimd.h
+*  HypoModel
+*
+*  Created by Duncan MacGregor
+*  University of Edinburgh 2022
+*  Released under MIT license, see https://opensource.org/licenses/MIT
+*
+*
+*    Minimal double precision SIMD wrapper for the batched neuron engine (see magneuroblock.cpp)
+*
+*        - AVX-512   8 lanes per vector
+*        - AVX/AVX2  4 lanes per vector
+*        - otherwise scalar, 1 lane, so the block engine still builds and runs unvectorised
+*
+*    'vdouble' holds MAGSIMD doubles, 'vmask' the result of a lane comparison.
+*    Only the operations used by the engine are provided, all with IEEE semantics matching the scalar code.
+*
+*/
+
+
+#ifndef MAGSIMD_H
+#define MAGSIMD_H
+
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+#include <math.h>
+
+
+#if defined(__AVX512F__)
+
+#define MAGSIMD 8
+
+struct vdouble { __m512d v; };
+struct vmask { __mmask8 m; };
+
+inline vdouble vset(double x) { vdouble r; r.v = _mm512_set1_pd(x); return r; }
+inline vdouble vload(const double *p) { vdouble r; r.v = _mm512_loadu_pd(p); return r; }
+inline void vstore(double *p, vdouble a) { _mm512_storeu_pd(p, a.v); }
+
+inline vdouble operator+(vdouble a, vdouble b) { vdouble r; r.v = _mm512_add_pd(a.v, b.v); return r; }
+inline vdouble operator-(vdouble a, vdouble b) { vdouble r; r.v = _mm512_sub_pd(a.v, b.v); return r; }
+inline vdouble operator*(vdouble a, vdouble b) { vdouble r; r.v = _mm512_mul_pd(a.v, b.v); return r; }
+inline vdouble operator/(vdouble a, vdouble b) { vdouble r; r.v = _mm512_div_pd(a.v, b.v); return r; }
+inline vdouble vabs(vdouble a) { vdouble r; r.v = _mm512_abs_pd(a.v); return r; }
+
+inline vmask operator>(vdouble a, vdouble b) { vmask r; r.m = _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ); return r; }
+inline vmask operator>=(vdouble a, vdouble b) { vmask r; r.m = _mm512_cmp_pd_mask(a.v, b.v, _CMP_GE_OQ); return r; }
+inline vmask operator<(vdouble a, vdouble b) { vmask r; r.m = _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ); return r; }
+inline vmask operator==(vdouble a, vdouble b) { vmask r; r.m = _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ); return r; }
+inline vmask operator!=(vdouble a, vdouble b) { vmask r; r.m = _mm512_cmp_pd_mask(a.v, b.v, _CMP_NEQ_UQ); return r; }
+inline vmask operator&(vmask a, vmask b) { vmask r; r.m = a.m & b.m; return r; }
+
+// lanes where 'mask' set take 'a', others keep 'b'
+inline vdouble vselect(vmask mask, vdouble a, vdouble b) { vdouble r; r.v = _mm512_mask_blend_pd(mask.m, b.v, a.v); return r; }
+inline int vbits(vmask mask) { return mask.m; }
+
+
+#elif defined(__AVX__)
+
+#define MAGSIMD 4
+
+struct vdouble { __m256d v; };
+struct vmask { __m256d m; };
+
+inline vdouble vset(double x) { vdouble r; r.v = _mm256_set1_pd(x); return r; }
+inline vdouble vload(const double *p) { vdouble r; r.v = _mm256_loadu_pd(p); return r; }
+inline void vstore(double *p, vdouble a) { _mm256_storeu_pd(p, a.v); }
+
+inline vdouble operator+(vdouble a, vdouble b) { vdouble r; r.v = _mm256_add_pd(a.v, b.v); return r; }
+inline vdouble operator-(vdouble a, vdouble b) { vdouble r; r.v = _mm256_sub_pd(a.v, b.v); return r; }
+inline vdouble operator*(vdouble a, vdouble b) { vdouble r; r.v = _mm256_mul_pd(a.v, b.v); return r; }
+inline vdouble operator/(vdouble a, vdouble b) { vdouble r; r.v = _mm256_div_pd(a.v, b.v); return r; }
+inline vdouble vabs(vdouble a) { vdouble r; r.v = _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); return r; }
+
+inline vmask operator>(vdouble a, vdouble b) { vmask r; r.m = _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); return r; }
+inline vmask operator>=(vdouble a, vdouble b) { vmask r; r.m = _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ); return r; }
+inline vmask operator<(vdouble a, vdouble b) { vmask r; r.m = _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); return r; }
+inline vmask operator==(vdouble a, vdouble b) { vmask r; r.m = _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ); return r; }
+inline vmask operator!=(vdouble a, vdouble b) { vmask r; r.m = _mm256_cmp_pd(a.v, b.v, _CMP_NEQ_UQ); return r; }
+inline vmask operator&(vmask a, vmask b) { vmask r; r.m = _mm256_and_pd(a.m, b.m); return r; }
+
+inline vdouble vselect(vmask mask, vdouble a, vdouble b) { vdouble r; r.v = _mm256_blendv_pd(b.v, a.v, mask.m); return r; }
+inline int vbits(vmask mask) { return _mm256_movemask_pd(mask.m); }
+
+
+#else
+
+#define MAGSIMD 1
+
+struct vdouble { double v; };
+struct vmask { bool m; };
+
+inline vdouble vset(double x) { vdouble r; r.v = x; return r; }
+inline vdouble vload(const double *p) { vdouble r; r.v = *p; return r; }
+inline void vstore(double *p, vdouble a) { *p = a.v; }
+
+inline vdouble operator+(vdouble a, vdouble b) { vdouble r; r.v = a.v + b.v; return r; }
+inline vdouble operator-(vdouble a, vdouble b) { vdouble r; r.v = a.v - b.v; return r; }
+inline vdouble operator*(vdouble a, vdouble b) { vdouble r; r.v = a.v * b.v; return r; }
+inline vdouble operator/(vdouble a, vdouble b) { vdouble r; r.v = a.v / b.v; return r; }
+inline vdouble vabs(vdouble a) { vdouble r; r.v = fabs(a.v); return r; }
+
+inline vmask operator>(vdouble a, vdouble b) { vmask r; r.m = a.v > b.v; return r; }
+inline vmask operator>=(vdouble a, vdouble b) { vmask r; r.m = a.v >= b.v; return r; }
+inline vmask operator<(vdouble a, vdouble b) { vmask r; r.m = a.v < b.v; return r; }
+inline vmask operator==(vdouble a, vdouble b) { vmask r; r.m = a.v == b.v; return r; }
+inline vmask operator!=(vdouble a, vdouble b) { vmask r; r.m = a.v != b.v; return r; }
+inline vmask operator&(vmask a, vmask b) { vmask r; r.m = a.m && b.m; return r; }
+
+inline vdouble vselect(vmask mask, vdouble a, vdouble b) { return mask.m ? a : b; }
+inline int vbits(vmask mask) { return mask.m ? 1 : 0; }
+
+#endif
+
+
+// vox_tanh() fast tanh approximation, same operation order as the scalar version in magnetmod.h
+inline vdouble vox_tanh(vdouble x)
+{
+	const vdouble ax = vabs(x);
+	const vdouble x2 = x * x;
+	const vdouble z = x * (vset(1.0) + ax + (vset(1.05622909486427) + vset(0.215166815390934) * x2 * ax) * x2);
+
+	return z / (vset(1.02718982441289) + vabs(z));
+}
+
+
+#endif